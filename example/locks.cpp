@@ -3,34 +3,33 @@
 #define PICOBENCH_DEFAULT_ITERATIONS {1000, 10000, 100000, 1000000}
 #include "picobench/picobench.hpp"
 
-#include <future>
 #include <mutex>
 #include <atomic>
-#include <functional>
+#include <thread>
 
 volatile int sum;
 
-template <typename Locker>
-int calc_sum(bool inc, const int n, Locker& lock)
-{
-    for(int i=0; i<n; ++i)
-    {
-        std::lock_guard<Locker> guard(lock);
-        if (inc) sum += 2;
-        else sum -= 3;
-    }
-    return n;
-}
-
 template <typename Locker>
 void bench(picobench::state& s)
 {
     Locker lock;
     sum = 0;
-    picobench::scope time(s);
-    auto f = std::async(std::launch::async, std::bind(calc_sum<Locker>, true, s.iterations(), std::ref(lock)));
-    calc_sum(false, s.iterations(), lock);
-    f.wait();
+    picobench::roles r(s);
+    r.add("inc", [&lock](picobench::state& is) {
+        for (auto _ : is)
+        {
+            std::lock_guard<Locker> guard(lock);
+            sum += 2;
+        }
+    });
+    r.add("dec", [&lock](picobench::state& ds) {
+        for (auto _ : ds)
+        {
+            std::lock_guard<Locker> guard(lock);
+            sum -= 3;
+        }
+    });
+    r.run();
     s.set_result(picobench::result_t(sum));
 }
 
@@ -72,3 +71,7 @@ inline void pause() { _mm_pause(); }
 using pause_spin = spinlock<pause>;
 PICOBENCH(bench<pause_spin>);
 #endif
+
+// more threads (the results differ, so it's another suite)
+PICOBENCH_SUITE("contention");
+PICOBENCH(bench<mutex>).param("inc", {1, 2, 4}).param("dec", {1, 2});
@@ -0,0 +1,30 @@
+// a plugin with benchmarks for tools/load.cpp
+// $ picobench-load ./libpicobench-example-plugin.so
+#define PICOBENCH_IMPLEMENT_PLUGIN
+#include "picobench/picobench.hpp"
+
+#include <vector>
+#include <list>
+#include <cstdlib>
+
+PICOBENCH_SUITE("push_back");
+
+void push_vector(picobench::state& s)
+{
+    std::vector<int> v;
+    for (auto _ : s)
+    {
+        v.push_back(rand());
+    }
+}
+PICOBENCH(push_vector);
+
+void push_list(picobench::state& s)
+{
+    std::list<int> l;
+    for (auto _ : s)
+    {
+        l.push_back(rand());
+    }
+}
+PICOBENCH(push_list);
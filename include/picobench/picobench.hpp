@@ -127,8 +127,11 @@
 #define PICOBENCH_HPP_INCLUDED
 
 #include <cstdint>
+#include <cstring>
 #include <chrono>
 #include <vector>
+#include <utility>
+#include <atomic>
 
 #if defined(PICOBENCH_STD_FUNCTION_BENCHMARKS)
 #   include <functional>
@@ -156,6 +159,30 @@
 #   define PICOBENCH_NAMESPACE picobench
 #endif
 
+// the largest number of calls per check of the loop counter which state::run chooses
+#if !defined(PICOBENCH_MAX_UNROLL)
+#   define PICOBENCH_MAX_UNROLL 64
+#endif
+
+// the registry of the global benchmarks is local to each module (executable or shared object)
+// which has the implementation, so that the benchmarks of plugins don't end up in the registry
+// of the executable which loads them or the other way around
+// define PICOBENCH_SHARED_REGISTRY if the implementation is in a shared library which is used
+// by other modules with benchmarks
+#if defined(__GNUC__) && !defined(_WIN32) && !defined(PICOBENCH_SHARED_REGISTRY)
+#   define I_PICOBENCH_LOCAL __attribute__((visibility("hidden")))
+#else
+#   define I_PICOBENCH_LOCAL
+#endif
+
+#if defined(_WIN32)
+#   define I_PICOBENCH_EXPORT __declspec(dllexport)
+#elif defined(__GNUC__)
+#   define I_PICOBENCH_EXPORT __attribute__((visibility("default")))
+#else
+#   define I_PICOBENCH_EXPORT
+#endif
+
 namespace PICOBENCH_NAMESPACE
 {
 
@@ -170,23 +197,137 @@ struct high_res_clock
 
     static time_point now();
 };
+
+namespace test
+{
+void this_thread_sleep_for_ns(uint64_t ns);
+}
 #else
 using high_res_clock = std::chrono::high_resolution_clock;
 #endif
 
 using result_t = intptr_t;
 
+// arrivals of the operations of open-loop benchmarks (see state::open_loop)
+enum class arrivals
+{
+    constant, // at equal intervals
+    poisson, // at random times (a Poisson process)
+};
+
+// a histogram of latencies in log-linear buckets
+// values below 2^sub_bits ns are exact and larger ones have a relative error below 2^-sub_bits
+class latency_histogram
+{
+public:
+    static const int sub_bits = 5;
+
+    PICOBENCH_INLINE
+    void record(int64_t ns)
+    {
+        if (ns < 0) ns = 0;
+        auto v = uint64_t(ns);
+        size_t index = size_t(v);
+        if (v >= (1u << sub_bits))
+        {
+#if defined(__GNUC__)
+            int msb = 63 - __builtin_clzll(v);
+#else
+            int msb = 63;
+            while (!(v >> msb)) --msb;
+#endif
+            auto shift = msb - sub_bits;
+            index = (size_t(shift + 1) << sub_bits) + size_t((v >> shift) & ((1u << sub_bits) - 1));
+        }
+        if (index >= _buckets.size()) _buckets.resize(index + 1);
+        ++_buckets[index];
+        ++_count;
+        if (ns > _max) _max = ns;
+    }
+
+    // the latency which p percent of the values don't exceed (0 <= p <= 100)
+    // it's the upper bound of its bucket (but no more than the maximum)
+    int64_t percentile(double p) const;
+
+    int64_t count() const { return _count; }
+    int64_t max() const { return _max; }
+
+    void clear()
+    {
+        _buckets.clear();
+        _count = 0;
+        _max = 0;
+    }
+
+private:
+    std::vector<int64_t> _buckets;
+    int64_t _count = 0;
+    int64_t _max = 0;
+};
+
+// the intended start times of the operations of an open-loop sample in ns from its start
+// the sample is one second long
+// the random times of poisson arrivals are generated from the seed
+void make_open_loop_schedule(std::vector<int64_t>& schedule, int64_t operations, arrivals arr, uint32_t seed);
+
+// waits for the intended start of an operation of an open-loop sample
+void open_loop_wait(high_res_clock::time_point t);
+
+// makes N calls of an operation without a loop (used by state::run)
+template <int N>
+struct unroll
+{
+    template <typename Op>
+    PICOBENCH_INLINE
+    static void call(Op& op)
+    {
+        op();
+        unroll<N - 1>::call(op);
+    }
+};
+
+template <>
+struct unroll<0>
+{
+    template <typename Op>
+    PICOBENCH_INLINE
+    static void call(Op&) {}
+};
+
 class state
 {
 public:
-    explicit state(int num_iterations, uintptr_t user_data = 0)
+    explicit state(int64_t num_iterations, uintptr_t user_data = 0)
         : _user_data(user_data)
         , _iterations(num_iterations)
     {
         I_PICOBENCH_ASSERT(_iterations > 0);
     }
 
-    int iterations() const { return _iterations; }
+    int64_t iterations() const { return _iterations; }
+
+    // the value of a param of the benchmark (see benchmark::param) or def if it has no such param
+    int param(const char* name, int def = 0) const
+    {
+        if (!_params) return def;
+        for (auto& p : *_params)
+        {
+            if (strcmp(p.first, name) == 0) return p.second;
+        }
+        return def;
+    }
+
+    // in the threads of roles (see class roles): whether the roles which do iterations()
+    // operations are done, so that the others should stop
+    bool stop_requested() const { return _stop && _stop->load(std::memory_order_relaxed); }
+
+    // the number of operations done in the state, if it's not iterations() (like in a role
+    // which runs until stop_requested)
+    void set_operations(int64_t n) { _operations = n; }
+    int64_t operations() const { return _operations < 0 ? _iterations : _operations; }
+
+    // the cpus on which roles placed their threads (see roles::place) or nullptr
+    const char* placement() const { return _placement; }
 
     int64_t duration_ns() const { return _duration_ns; }
     void add_custom_duration(int64_t duration_ns) { _duration_ns += duration_ns; }
@@ -199,6 +340,92 @@ public:
     void set_result(uintptr_t data) { _result = data; }
     result_t result() const { return _result; }
 
+    // optionally set a named value measured by the benchmark (like memory used)
+    // the report has the counters of the fastest sample of each problem space
+    // the name should outlive the runner (a string literal is best)
+    void set_counter(const char* name, double value)
+    {
+        for (auto& c : _counters)
+        {
+            if (strcmp(c.first, name) == 0)
+            {
+                c.second = value;
+                return;
+            }
+        }
+        _counters.emplace_back(name, value);
+    }
+    const std::vector<std::pair<const char*, double>>& counters() const { return _counters; }
+
+    // runs the benchmark open-loop: op is called iterations() times during one second, with
+    // the operations released on a schedule (at the target rate of iterations() per second)
+    // instead of right after the previous one
+    // the latency of each operation is measured from its intended start, so when an operation
+    // delays the next ones, the delay is in all of their latencies (there's no coordinated
+    // omission)
+    // the sample time is from the first intended start until the last operation is done, so
+    // the ops/second in the report is the achieved rate
+    // the latencies are in latencies() and the counters achieved_rate, lat_p50_ns,
+    // lat_p90_ns, lat_p99_ns, lat_p999_ns and lat_max_ns
+    // sweep the target rate with the iterations of the benchmark
+    template <typename Op>
+    void open_loop(Op op, arrivals arr = arrivals::constant)
+    {
+        std::vector<int64_t> schedule;
+        make_open_loop_schedule(schedule, _iterations, arr, _seed);
+        _latencies.clear();
+
+        start_timer();
+        for (auto offset : schedule)
+        {
+            auto intended = _start + std::chrono::nanoseconds(offset);
+            open_loop_wait(intended);
+            op();
+            _latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(high_res_clock::now() - intended).count());
+        }
+        stop_timer();
+
+        set_open_loop_counters();
+    }
+
+    const latency_histogram& latencies() const { return _latencies; }
+
+    // calls op iterations() times in a timed loop which checks its counter once per K calls
+    // the K calls are unrolled, so the loop overhead (counting, comparing and branching) is
+    // not a part of the time of very short operations (like the ones of a nanosecond)
+    // if K is 0, it's chosen from the iterations (see unroll_calls)
+    // the calls left after the last batch are made one by one, so there are exactly
+    // iterations() of them and the time per operation in the report is accurate
+    template <int K = 0, typename Op>
+    PICOBENCH_INLINE
+    void run(Op op)
+    {
+        static_assert(K >= 0, "the calls per check can't be negative");
+        if (K > 0) return run_unrolled<(K > 0 ? K : 1)>(op);
+
+        const int k = unroll_calls(_iterations);
+        if (k == unroll_large) run_unrolled<unroll_large>(op);
+        else if (k == unroll_medium) run_unrolled<unroll_medium>(op);
+        else if (k == unroll_small) run_unrolled<unroll_small>(op);
+        else run_unrolled<1>(op);
+    }
+
+    // the calls per check of run for a number of iterations
+    // it's the largest of PICOBENCH_MAX_UNROLL, a quarter and a sixteenth of it (or 1) which
+    // leaves at least 8 batches, so that the calls made one by one after them are at most
+    // an eighth of all calls
+    // the cost of the operation doesn't matter: for longer ones the loop overhead is negligible
+    // with any number of calls per check
+    static int unroll_calls(int64_t iterations)
+    {
+        const int calls[] = { unroll_large, unroll_medium, unroll_small };
+        for (int k : calls)
+        {
+            if (iterations >= 8 * int64_t(k)) return k;
+        }
+        return 1;
+    }
+
     PICOBENCH_INLINE
     void start_timer()
     {
@@ -247,14 +474,14 @@ public:
         }
 
         PICOBENCH_INLINE
-        int operator*() const
+        int64_t operator*() const
         {
             return _counter;
         }
 
     private:
-        int _counter;
-        const int _lim;
+        int64_t _counter;
+        const int64_t _lim;
         state* _state;
     };
 
@@ -272,11 +499,60 @@ public:
     }
 
 private:
+    // the calls per check which run chooses from
+    enum
+    {
+        unroll_large = PICOBENCH_MAX_UNROLL,
+        unroll_medium = PICOBENCH_MAX_UNROLL / 4 > 0 ? PICOBENCH_MAX_UNROLL / 4 : 1,
+        unroll_small = PICOBENCH_MAX_UNROLL / 16 > 0 ? PICOBENCH_MAX_UNROLL / 16 : 1,
+    };
+
+    template <int K, typename Op>
+    PICOBENCH_INLINE
+    void run_unrolled(Op& op)
+    {
+        const int64_t batches = _iterations / K;
+        const int64_t rest = _iterations % K;
+
+        start_timer();
+        for (int64_t b = 0; b < batches; ++b)
+        {
+            unroll<K>::call(op);
+        }
+        for (int64_t i = 0; i < rest; ++i)
+        {
+            op();
+        }
+        stop_timer();
+    }
+
+    friend class runner;
+    friend class roles;
+
     high_res_clock::time_point _start;
     int64_t _duration_ns = 0;
     uintptr_t _user_data;
-    int _iterations;
+    int64_t _iterations;
+    int64_t _operations = -1;
     result_t _result = 0;
+    std::vector<std::pair<const char*, double>> _counters;
+    latency_histogram _latencies; // of open-loop samples
+    const std::vector<std::pair<const char*, int>>* _params = nullptr;
+    const std::atomic<bool>* _stop = nullptr;
+    const char* _placement_policy = nullptr; // the default for roles (see runner::set_placement)
+    const char* _placement = nullptr;
+    uint32_t _seed = 0; // of the random numbers of the sample (see runner::run_benchmarks)
+
+    void set_open_loop_counters();
+
+    // a seed for the n-th of the things which are seeded with seed (a splitmix64 step)
+    static uint32_t derive_seed(uint32_t seed, uint64_t n)
+    {
+        uint64_t z = (uint64_t(seed) << 32 | 0x9e3779b9u) + (n + 1) * 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return uint32_t(z ^ (z >> 31));
+    }
 };
 
 // this can be used for manual measurement
@@ -299,6 +575,120 @@ private:
     state& _state;
 };
 
+// runs the roles of a concurrent benchmark (like producers and consumers) in threads
+// the threads of a role call its function, each with its own state
+// all threads start together and when the ones of the roles added with add are done (after
+// iterations() operations each), the others (added with add_until_stopped) see
+// state::stop_requested and stop
+// the sample time is from the start until all threads are done and each role has the counters
+// <role>_ops_per_sec (the operations of all of its threads per second) and <role>_ns_per_op
+// (the average time of an operation in a thread) along with the sums of the counters set by its
+// threads as <role>_<counter>
+// the thread count of a role is the param named after it, so it can be swept:
+//
+//     void queue(picobench::state& s)
+//     {
+//         my_queue q;
+//         picobench::roles r(s);
+//         r.add("producer", [&](picobench::state& ps) { for (auto _ : ps) q.push(_); });
+//         r.add_until_stopped("consumer", [&](picobench::state& cs) {
+//             int64_t n = 0;
+//             while (!cs.stop_requested()) n += q.try_pop();
+//             cs.set_operations(n);
+//         });
+//         r.run();
+//     }
+//     PICOBENCH(queue).param("producer", { 1, 2, 4 }).param("consumer", { 1, 2 });
+class roles
+{
+public:
+    explicit roles(state& s)
+        : _state(s)
+        , _placement(s._placement_policy)
+    {}
+
+    ~roles()
+    {
+        for (auto r : _roles) delete r;
+    }
+
+    roles(const roles&) = delete;
+    roles& operator=(const roles&) = delete;
+
+    // adds a role whose threads do iterations() operations each
+    // the thread count is the param named after the role or 1 if there's no such param
+    template <typename F>
+    roles& add(const char* name, F f) { return add(name, _state.param(name, 1), std::move(f)); }
+    template <typename F>
+    roles& add(const char* name, int threads, F f)
+    {
+        _roles.push_back(new role_impl<F>(name, threads, false, std::move(f)));
+        return *this;
+    }
+
+    // adds a role whose threads run until stop_requested and set the number of operations they
+    // did with state::set_operations
+    template <typename F>
+    roles& add_until_stopped(const char* name, F f) { return add_until_stopped(name, _state.param(name, 1), std::move(f)); }
+    template <typename F>
+    roles& add_until_stopped(const char* name, int threads, F f)
+    {
+        _roles.push_back(new role_impl<F>(name, threads, true, std::move(f)));
+        return *this;
+    }
+
+    // places the threads on cpus (on linux) with a policy:
+    //  * compact: one thread per core, filling the cores which share a last level cache first
+    //  * scatter: one thread per last level cache and numa node, then the next core of each
+    //  * smt: the SMT siblings of a core first
+    //  * l3: only the cpus which share the last level cache of the first one
+    //  * node: one thread per numa node, then the next cpu of each
+    // or a list of cpus like "0,2,4-7"
+    // a policy can be followed by :<type> to use only the cores of a type of heterogeneous
+    // cpus (like "compact:atom", see the core_types of the environment)
+    // the threads are numbered in the order of their roles and if there are more threads than
+    // cpus, the cpus are used again
+    // the default is the placement of the runner (see runner::set_placement), if any
+    // the cpus of each role are in the report
+    roles& place(const char* spec) { _placement = spec; return *this; }
+
+    // runs the threads of all roles and sets the time, result (the sum of the results of the
+    // threads) and counters of the state
+    void run();
+
+private:
+    struct role
+    {
+        role(const char* n, int t, bool u)
+            : name(n)
+            , threads(t)
+            , until_stopped(u)
+        {}
+        virtual ~role() {}
+        virtual void call(state& s) = 0;
+
+        const char* name;
+        int threads;
+        bool until_stopped;
+    };
+
+    template <typename F>
+    struct role_impl : public role
+    {
+        role_impl(const char* n, int t, bool u, F fn)
+            : role(n, t, u)
+            , f(std::move(fn))
+        {}
+        void call(state& s) override { f(s); }
+
+        F f;
+    };
+
+    state& _state;
+    std::vector<role*> _roles;
+    const char* _placement;
+};
+
 #if defined(PICOBENCH_STD_FUNCTION_BENCHMARKS)
 using benchmark_proc = std::function<void(state&)>;
 #else
@@ -310,11 +700,33 @@ class benchmark
 public:
     const char* name() const { return _name; }
 
-    benchmark& iterations(std::vector<int> data) { _state_iterations = std::move(data); return *this; }
+    benchmark& iterations(std::vector<int64_t> data) { _state_iterations = std::move(data); return *this; }
+    // for vectors of other integer types, like the std::vector<int> of earlier versions
+    // (a template, so that brace lists still choose the one above)
+    template <typename Int>
+    benchmark& iterations(const std::vector<Int>& data) { _state_iterations.assign(data.begin(), data.end()); return *this; }
     benchmark& samples(int n) { _samples = n; return *this; }
     benchmark& label(const char* label) { _name = label; return *this; }
     benchmark& baseline(bool b = true) { _baseline = b; return *this; }
     benchmark& user_data(uintptr_t data) { _user_data = data; return *this; }
+    benchmark& tag(const char* t) { _tags.push_back(t); return *this; }
+
+    // runs the benchmark for each value of a param, which it reads with state::param (like the
+    // thread counts of roles)
+    // with several params there's a benchmark for each combination of their values, named
+    // like "name [a=1] [b=2]"
+    benchmark& param(const char* name, std::vector<int> values) { _params.emplace_back(name, std::move(values)); return *this; }
+
+    // evict the data caches (and optionally pollute the instruction cache) before each sample
+    benchmark& cold(bool data = true, bool instructions = false) { _cold_data = data; _cold_instructions = instructions; return *this; }
+    // a buffer to be flushed from the caches before each sample of a cold benchmark
+    benchmark& flush(const void* data, size_t size) { _flush_buffers.emplace_back(data, size); return *this; }
+
+    // the iterations are a parameter of the benchmark (like the size of its input) rather than a
+    // number of operations, so the time per operation in reports is the time of a sample
+    benchmark& param_dimensions(bool b = true) { _param_dimensions = b; return *this; }
+
+    const std::vector<const char*>& tags() const { return _tags; }
 
 protected:
     friend class runner;
@@ -326,13 +738,20 @@ protected:
     bool _baseline = false;
 
     uintptr_t _user_data = 0;
-    std::vector<int> _state_iterations;
+    std::vector<int64_t> _state_iterations;
     int _samples = 0;
+    std::vector<const char*> _tags; // used by filters
+    std::vector<std::pair<const char*, std::vector<int>>> _params;
+
+    bool _cold_data = false;
+    bool _cold_instructions = false;
+    std::vector<std::pair<const void*, size_t>> _flush_buffers;
+    bool _param_dimensions = false;
 };
 
 // used for globally  functions
 // note that you can instantiate a runner and register local benchmarks for it alone
-class global_registry
+class I_PICOBENCH_LOCAL global_registry
 {
 public:
     static int set_bench_suite(const char* name);
@@ -364,6 +783,12 @@ public:
 #   define PICOBENCH_IMPLEMENT_MAIN
 #endif
 
+// a plugin is a shared object with benchmarks which is loaded by a driver (like tools/load.cpp)
+// it has the implementation and entry points through which the driver takes its benchmarks
+#if defined(PICOBENCH_IMPLEMENT_PLUGIN)
+#   define PICOBENCH_IMPLEMENT
+#endif
+
 #endif // PICOBENCH_HPP_INCLUDED
 
 #if defined(PICOBENCH_IMPLEMENT)
@@ -376,7 +801,25 @@ public:
 #include <memory>
 #include <cstring>
 #include <cstdlib>
+#include <climits>
+#include <cstdio>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#   include <emmintrin.h>
+#endif
 #include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <sstream>
+#include <regex>
+#include <thread>
+#include <tuple>
+#if defined(__linux__)
+#   include <sched.h>
+#endif
 
 namespace PICOBENCH_NAMESPACE
 {
@@ -391,444 +834,2902 @@ enum error_t
     error_unknown_cmd_line_argument, // command argument looks like a picobench one, but isn't
     error_sample_compare, // benchmark produced different results across samples
     error_benchmark_compare, // two benchmarks of the same suite and dimension produced different results
+    error_regression, // a benchmark is slower than in the report it was compared to
+    error_checkpoint, // checkpoint file can't be read or written or doesn't match the run
+    error_noisy_environment, // the pre-flight check found a noisy configuration in strict mode
+    error_bad_report, // the report to compare to can't be read
 };
 
-class report
+// minimal reader for the json files written by picobench
+// there is no dom: the users pull values in the order they expect them
+class json_reader
 {
 public:
-    struct benchmark_problem_space
+    json_reader(const char* begin, const char* end)
+        : _p(begin)
+        , _end(end)
+    {}
+
+    bool ok() const { return !_error; }
+
+    // object iteration:
+    //     if (!r.begin_object()) return false;
+    //     while (r.next_key(key)) { read or skip value }
+    bool begin_object() { return expect('{'); }
+
+    bool next_key(std::string& key)
     {
-        int dimension; // number of iterations for the problem space
-        int samples; // number of samples taken
-        int64_t total_time_ns; // fastest sample!!!
-        result_t result; // result of fastest sample
-    };
-    struct benchmark
+        if (!next_item('}')) return false;
+        return read_string(key) && expect(':');
+    }
+
+    bool begin_array() { return expect('['); }
+    bool next_element() { return next_item(']'); }
+
+    bool read_null()
     {
-        const char* name;
-        bool is_baseline;
-        std::vector<benchmark_problem_space> data;
-    };
+        skip_ws();
+        if (_end - _p >= 4 && strncmp(_p, "null", 4) == 0)
+        {
+            _p += 4;
+            return true;
+        }
+        return fail();
+    }
 
-    struct suite
+    bool is_null()
     {
-        const char* name;
-        std::vector<benchmark> benchmarks; // benchmark view
+        skip_ws();
+        return _p != _end && *_p == 'n';
+    }
 
-        const benchmark* find_benchmark(const char* bname) const
+    bool read_bool(bool& out)
+    {
+        skip_ws();
+        if (_end - _p >= 4 && strncmp(_p, "true", 4) == 0)
         {
-            for (auto& b : benchmarks)
-            {
-                if (strcmp(b.name, bname) == 0)
-                    return &b;
-            }
-
-            return nullptr;
+            _p += 4;
+            out = true;
+            return true;
         }
-
-        const benchmark* find_baseline() const
+        if (_end - _p >= 5 && strncmp(_p, "false", 5) == 0)
         {
-            for (auto& b : benchmarks)
-            {
-                if (b.is_baseline)
-                    return &b;
-            }
-
-            return nullptr;
+            _p += 5;
+            out = false;
+            return true;
         }
-    };
+        return fail();
+    }
 
-    std::vector<suite> suites;
-    error_t error = no_error;
+    bool read_int(int64_t& out)
+    {
+        auto num = number_token();
+        if (num.empty()) return fail();
+        char* e;
+        out = strtoll(num.c_str(), &e, 10);
+        if (*e) return fail(); // not an integer
+        return true;
+    }
 
-    const suite* find_suite(const char* name) const
+    bool read_int(int& out)
+    {
+        int64_t i;
+        if (!read_int(i)) return false;
+        out = int(i);
+        return true;
+    }
+
+    // null is read as nan
+    bool read_double(double& out)
     {
-        for (auto& s : suites)
+        if (is_null())
         {
-            if (strcmp(s.name, name) == 0)
-                return &s;
+            out = std::nan("");
+            return read_null();
         }
-
-        return nullptr;
+        auto num = number_token();
+        if (num.empty()) return fail();
+        out = strtod(num.c_str(), nullptr);
+        return true;
     }
 
-    void to_text(std::ostream& out) const
+    bool read_string(std::string& out)
     {
-        using namespace std;
-        for (auto& suite : suites)
+        if (!expect('"')) return false;
+        out.clear();
+        while (_p != _end && *_p != '"')
         {
-            if (suite.name)
+            char c = *_p++;
+            if (c != '\\')
             {
-                out << "## " << suite.name << ":\n";
+                out.push_back(c);
+                continue;
             }
 
-            out.put('\n');
-            out <<
-                " Name (* = baseline)      |   Dim   |  Total ms |  ns/op  |Baseline| Ops/second\n";
-            out <<
-                "--------------------------|--------:|----------:|--------:|-------:|----------:\n";
-
-            auto problem_space_view = get_problem_space_view(suite);
-            for (auto& ps : problem_space_view)
+            if (_p == _end) return fail();
+            c = *_p++;
+            switch (c)
             {
-                const problem_space_benchmark* baseline = nullptr;
-                for (auto& bm : ps.second)
+            case 'n': out.push_back('\n'); break;
+            case 'r': out.push_back('\r'); break;
+            case 't': out.push_back('\t'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'u':
+            {
+                if (_end - _p < 4) return fail();
+                auto cp = strtoul(std::string(_p, 4).c_str(), nullptr, 16);
+                _p += 4;
+                // we only write control chars like this, so a simple utf-8 encoding is enough
+                if (cp < 0x80)
                 {
-                    if (bm.is_baseline)
-                    {
-                        baseline = &bm;
-                        break;
-                    }
+                    out.push_back(char(cp));
                 }
-
-                for (auto& bm : ps.second)
+                else if (cp < 0x800)
                 {
-                    out << ' ' << bm.name;
-                    auto pad = 24 - int(strlen(bm.name));
-                    if (bm.is_baseline)
-                    {
-                        out << " *";
-                        pad -= 2;
-                    }
-                    for (int i = 0; i < pad; ++i) {
-                        out.put(' ');
-                    }
+                    out.push_back(char(0xc0 | (cp >> 6)));
+                    out.push_back(char(0x80 | (cp & 0x3f)));
+                }
+                else
+                {
+                    out.push_back(char(0xe0 | (cp >> 12)));
+                    out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+                    out.push_back(char(0x80 | (cp & 0x3f)));
+                }
+                break;
+            }
+            default: out.push_back(c); // ", \, /
+            }
+        }
+        return expect('"');
+    }
 
-                    out << " |"
-                        << setw(8) << ps.first << " |"
-                        << setw(10) << fixed << setprecision(3) << double(bm.total_time_ns) / 1000000.0 << " |";
+    bool skip_value()
+    {
+        skip_ws();
+        if (_p == _end) return fail();
+        std::string str;
+        bool b;
+        switch (*_p)
+        {
+        case '{':
+            begin_object();
+            while (next_key(str))
+            {
+                skip_value();
+            }
+            return ok();
+        case '[':
+            begin_array();
+            while (next_element())
+            {
+                skip_value();
+            }
+            return ok();
+        case '"': return read_string(str);
+        case 'n': return read_null();
+        case 't': case 'f': return read_bool(b);
+        default: return !number_token().empty() || fail();
+        }
+    }
 
-                    auto ns_op = (bm.total_time_ns / ps.first);
-                    if (ns_op > 99999999)
-                    {
-                        int e = 0;
-                        while (ns_op > 999999)
-                        {
-                            ++e;
-                            ns_op /= 10;
-                        }
-                        out << ns_op << 'e' << e;
-                    }
-                    else
-                    {
-                        out << setw(8) << ns_op;
+private:
+    const char* _p;
+    const char* _end;
+    bool _error = false;
+
+    bool fail()
+    {
+        _error = true;
+        _p = _end;
+        return false;
+    }
+
+    void skip_ws()
+    {
+        while (_p != _end && isspace(static_cast<unsigned char>(*_p))) ++_p;
+    }
+
+    bool expect(char c)
+    {
+        skip_ws();
+        if (_p == _end || *_p != c) return fail();
+        ++_p;
+        return true;
+    }
+
+    bool next_item(char close)
+    {
+        if (_error) return false;
+        skip_ws();
+        if (_p == _end) return fail();
+        if (*_p == close)
+        {
+            ++_p;
+            return false;
+        }
+        if (*_p == ',') ++_p;
+        return true;
+    }
+
+    std::string number_token()
+    {
+        skip_ws();
+        auto begin = _p;
+        while (_p != _end && (isdigit(static_cast<unsigned char>(*_p)) || (*_p && strchr("+-.eE", *_p)))) ++_p;
+        return std::string(begin, _p);
+    }
+};
+
+// hash index of elements with a `name` in a vector
+// it's built lazily and rebuilt when elements are added or removed, or when a hit doesn't match
+// a miss is final, so call invalidate after changing the names of elements in place
+// a nullptr name finds the first element with a nullptr name
+class name_index
+{
+public:
+    template <typename T>
+    const T* find(const std::vector<T>& vec, const char* name) const
+    {
+        auto i = index_of(vec, name);
+        return i < vec.size() ? &vec[i] : nullptr;
+    }
+
+    // returns size_t(-1) if there is no such element
+    template <typename T>
+    size_t index_of(const std::vector<T>& vec, const char* name) const
+    {
+        if (_indexed != vec.size()) rebuild(vec);
+
+        auto i = lookup(name);
+        if (i == size_t(-1) || same_name(vec[i].name, name)) return i;
+
+        // elements were changed in place
+        rebuild(vec);
+        return lookup(name);
+    }
+
+    // for elements which also have a group (elements in different groups can have the same name)
+    template <typename T>
+    size_t index_of(const std::vector<T>& vec, const char* name, const char* group) const
+    {
+        // the index finds the first element with the name
+        auto i = index_of(vec, name);
+        if (i >= vec.size() || same_name(vec[i].group, group)) return i;
+        for (i = 0; i < vec.size(); ++i)
+        {
+            if (same_name(vec[i].name, name) && same_name(vec[i].group, group)) return i;
+        }
+        return size_t(-1);
+    }
+
+    // call after adding an element to the end of the vector to avoid rebuilding the index
+    void push_back(const char* name, size_t i)
+    {
+        if (_indexed != i) return; // out of date anyway, so it will be rebuilt on the next lookup
+        if (name) _map.emplace(name, i);
+        else if (_unnamed == size_t(-1)) _unnamed = i;
+        _indexed = i + 1;
+    }
+
+    // the index is rebuilt on the next lookup
+    void invalidate()
+    {
+        _indexed = size_t(-1);
+    }
+
+    // names can be null
+    static bool same_name(const char* a, const char* b)
+    {
+        if (!a || !b) return a == b;
+        return strcmp(a, b) == 0;
+    }
+
+private:
+
+    size_t lookup(const char* name) const
+    {
+        if (!name) return _unnamed;
+        auto f = _map.find(name);
+        return f == _map.end() ? size_t(-1) : f->second;
+    }
+
+    template <typename T>
+    void rebuild(const std::vector<T>& vec) const
+    {
+        _map.clear();
+        _map.reserve(vec.size());
+        _unnamed = size_t(-1);
+        // iterate backwards so that the first element with a given name is indexed
+        for (size_t i = vec.size(); i-- > 0; )
+        {
+            if (vec[i].name) _map[vec[i].name] = i;
+            else _unnamed = i;
+        }
+        _indexed = vec.size();
+    }
+
+    mutable std::unordered_map<std::string, size_t> _map;
+    mutable size_t _unnamed = size_t(-1);
+    mutable size_t _indexed = 0;
+};
+
+class report
+{
+public:
+    // build with the fields which are known and leave the others to their defaults
+    struct benchmark_problem_space
+    {
+        int64_t dimension = 0; // number of iterations for the problem space
+        int samples = 0; // number of samples taken
+        int64_t total_time_ns = 0; // fastest sample!!!
+        result_t result = 0; // result of fastest sample
+
+        // statistics of all samples
+        int64_t median_time_ns = 0;
+        int64_t max_time_ns = 0; // slowest sample
+        double mean_time_ns = 0;
+        double stddev_ns = 0;
+
+        // statistics of the ratios of samples to the baseline samples run next to them
+        // (only in paired runs, otherwise pairs is zero)
+        int pairs = 0;
+        double pair_ratio_median = 0;
+        double pair_ratio_mean = 0;
+        double pair_ratio_stddev = 0;
+
+        // samples next to a disturbed interference probe (only in runs with a probe)
+        int suspect_samples = 0;
+
+        // counters of the fastest sample (see state::set_counter)
+        std::vector<std::pair<const char*, double>> counters;
+
+        // the cpus of the threads of roles (see roles::place) or nullptr
+        const char* placement = nullptr;
+    };
+    struct benchmark
+    {
+        const char* name;
+        bool is_baseline;
+        std::vector<benchmark_problem_space> data;
+        bool is_cold; // the caches were evicted before each sample
+        bool has_param_dimensions; // a sample is a single operation (see benchmark::param_dimensions)
+    };
+
+    // the operations of a sample, which its time is divided by for the time per operation
+    static int64_t operations(const benchmark& bm, const benchmark_problem_space& d)
+    {
+        return bm.has_param_dimensions ? 1 : d.dimension;
+    }
+
+    struct suite
+    {
+        const char* name;
+        // a grouping above suites, like the executable of the suite in a report combined
+        // from several executables (nullptr if none)
+        // suites in different groups can have the same name
+        const char* group;
+        std::vector<benchmark> benchmarks; // benchmark view
+
+        const benchmark* find_benchmark(const char* bname) const
+        {
+            return benchmark_index.find(benchmarks, bname);
+        }
+
+        const benchmark* find_baseline() const
+        {
+            for (auto& b : benchmarks)
+            {
+                if (b.is_baseline)
+                    return &b;
+            }
+
+            return nullptr;
+        }
+
+        name_index benchmark_index; // used by find_benchmark
+    };
+
+    struct machine_metric
+    {
+        const char* name; // the suffix of the name is the unit (like _ns or _gbs)
+        double value;
+    };
+
+    std::vector<suite> suites;
+    error_t error = no_error;
+    int random_seed = 0; // seed with which the benchmarks were run
+
+    struct probe_sample
+    {
+        int64_t time_ns; // since the start of the run
+        int64_t duration_ns;
+        bool disturbed; // slower than probe_threshold times probe_reference_ns
+    };
+
+    // the interference probe which ran between samples (see runner::set_probe)
+    // the timeline is empty if there was no probe
+    int64_t probe_reference_ns = 0; // typical duration of the probe
+    double probe_threshold = 0;
+    std::vector<probe_sample> probe_timeline;
+
+    // the machine and build which ran the benchmarks as key-value pairs
+    // (cpu_model, governor, compiler... see environment_info::collect)
+    std::vector<std::pair<std::string, std::string>> environment;
+
+    const std::string* find_environment(const char* key) const
+    {
+        for (auto& e : environment)
+        {
+            if (e.first == key) return &e.second;
+        }
+        return nullptr;
+    }
+
+    // characteristics of the machine which ran the benchmarks (see runner::set_profile_machine)
+    // can be used to normalize results from different machines
+    std::vector<machine_metric> machine_profile;
+
+    const machine_metric* find_machine_metric(const char* name) const
+    {
+        for (auto& m : machine_profile)
+        {
+            if (strcmp(m.name, name) == 0) return &m;
+        }
+        return nullptr;
+    }
+
+    const suite* find_suite(const char* name) const
+    {
+        return _suite_index.find(suites, name);
+    }
+
+    // call after renaming suites or benchmarks in place, so that find_suite and
+    // find_benchmark find them by their new names
+    void invalidate_indices()
+    {
+        _suite_index.invalidate();
+        for (auto& s : suites) s.benchmark_index.invalidate();
+    }
+
+    // the saturation point of an open-loop benchmark (see state::open_loop), whose dimensions
+    // are target rates
+    struct saturation_point
+    {
+        int64_t target_rate; // the lowest target rate which was not reached
+        double achieved_rate; // the highest achieved rate
+    };
+
+    // returns false if the benchmark is not open-loop or if it reached all target rates
+    // a target rate is reached if the achieved rate is at least 95% of it
+    static bool find_saturation(const benchmark& bm, saturation_point& sp)
+    {
+        bool open_loop = false, saturated = false;
+        sp.target_rate = INT64_MAX;
+        sp.achieved_rate = 0;
+        for (auto& d : bm.data)
+        {
+            bool has_rate = false;
+            for (auto& c : d.counters)
+            {
+                has_rate = has_rate || strcmp(c.first, "achieved_rate") == 0;
+            }
+            if (!has_rate || d.total_time_ns <= 0) continue;
+            open_loop = true;
+
+            auto achieved = d.dimension * 1e9 / double(d.total_time_ns);
+            sp.achieved_rate = std::max(sp.achieved_rate, achieved);
+            if (achieved < 0.95 * d.dimension)
+            {
+                saturated = true;
+                sp.target_rate = std::min(sp.target_rate, d.dimension);
+            }
+        }
+        return open_loop && saturated;
+    }
+
+    const suite* find_suite(const char* name, const char* group) const
+    {
+        auto si = suite_index_of(name, group);
+        return si < suites.size() ? &suites[si] : nullptr;
+    }
+
+    // stores the counter names and placement of a problem space from another report in this one
+    void store_counter_names(benchmark_problem_space& d)
+    {
+        for (auto& c : d.counters) c.first = store_string(c.first);
+        if (d.placement) d.placement = store_string(d.placement);
+    }
+
+    // stores a copy of the string in the report
+    // use it for names which don't outlive the report (like ones loaded from files)
+    const char* store_string(const std::string& str)
+    {
+        if (!_strings) _strings = std::make_shared<std::deque<std::string>>();
+        _strings->push_back(str);
+        return _strings->back().c_str();
+    }
+
+    // reads a report written by to_json
+    // returns false if the input is not such a report
+    bool from_json(std::istream& in)
+    {
+        std::string buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        json_reader r(buf.data(), buf.data() + buf.size());
+
+        suites.clear();
+        environment.clear();
+        machine_profile.clear();
+        probe_timeline.clear();
+        std::string key, str;
+        auto read_name = [&](const char*& name) {
+            if (r.is_null())
+            {
+                name = nullptr;
+                return r.read_null();
+            }
+            if (!r.read_string(str)) return false;
+            name = store_string(str);
+            return true;
+        };
+
+        if (!r.begin_object()) return false;
+        while (r.next_key(key))
+        {
+            if (key == "random_seed") r.read_int(random_seed);
+            else if (key == "environment")
+            {
+                r.begin_object();
+                while (r.next_key(key))
+                {
+                    r.read_string(str);
+                    environment.emplace_back(key, str);
+                }
+            }
+            else if (key == "probe")
+            {
+                r.begin_object();
+                while (r.next_key(key))
+                {
+                    if (key == "reference_ns") r.read_int(probe_reference_ns);
+                    else if (key == "threshold") r.read_double(probe_threshold);
+                    else if (key == "timeline")
+                    {
+                        // [time, duration, disturbed] for each probe
+                        r.begin_array();
+                        while (r.next_element())
+                        {
+                            probe_sample ps = {0, 0, false};
+                            int disturbed = 0;
+                            r.begin_array();
+                            if (r.next_element()) r.read_int(ps.time_ns);
+                            if (r.next_element()) r.read_int(ps.duration_ns);
+                            if (r.next_element()) r.read_int(disturbed);
+                            while (r.next_element()) r.skip_value();
+                            ps.disturbed = disturbed != 0;
+                            probe_timeline.push_back(ps);
+                        }
+                    }
+                    else r.skip_value();
+                }
+            }
+            else if (key == "machine_profile")
+            {
+                r.begin_object();
+                while (r.next_key(key))
+                {
+                    machine_profile.push_back({store_string(key), 0.0});
+                    r.read_double(machine_profile.back().value);
+                }
+            }
+            else if (key == "error")
+            {
+                int e = 0;
+                r.read_int(e);
+                error = error_t(e);
+            }
+            else if (key == "suites")
+            {
+                r.begin_array();
+                while (r.next_element())
+                {
+                    suites.emplace_back();
+                    auto& suite = suites.back();
+                    suite.name = nullptr;
+                    r.begin_object();
+                    while (r.next_key(key))
+                    {
+                        if (key == "name") read_name(suite.name);
+                        else if (key == "group") read_name(suite.group);
+                        else if (key == "benchmarks")
+                        {
+                            r.begin_array();
+                            while (r.next_element())
+                            {
+                                suite.benchmarks.push_back({nullptr, false, {}, false, false});
+                                auto& bm = suite.benchmarks.back();
+                                r.begin_object();
+                                while (r.next_key(key))
+                                {
+                                    if (key == "name") read_name(bm.name);
+                                    else if (key == "baseline") r.read_bool(bm.is_baseline);
+                                    else if (key == "cold") r.read_bool(bm.is_cold);
+                                    else if (key == "param_dimensions") r.read_bool(bm.has_param_dimensions);
+                                    else if (key == "data")
+                                    {
+                                        r.begin_array();
+                                        while (r.next_element())
+                                        {
+                                            bm.data.emplace_back();
+                                            auto& d = bm.data.back();
+                                            int64_t result = 0;
+                                            r.begin_object();
+                                            while (r.next_key(key))
+                                            {
+                                                if (key == "dimension") r.read_int(d.dimension);
+                                                else if (key == "samples") r.read_int(d.samples);
+                                                else if (key == "total_ns") r.read_int(d.total_time_ns);
+                                                else if (key == "result") r.read_int(result);
+                                                else if (key == "median_ns") r.read_int(d.median_time_ns);
+                                                else if (key == "max_ns") r.read_int(d.max_time_ns);
+                                                else if (key == "mean_ns") r.read_double(d.mean_time_ns);
+                                                else if (key == "stddev_ns") r.read_double(d.stddev_ns);
+                                                else if (key == "pairs") r.read_int(d.pairs);
+                                                else if (key == "pair_ratio_median") r.read_double(d.pair_ratio_median);
+                                                else if (key == "pair_ratio_mean") r.read_double(d.pair_ratio_mean);
+                                                else if (key == "pair_ratio_stddev") r.read_double(d.pair_ratio_stddev);
+                                                else if (key == "suspect_samples") r.read_int(d.suspect_samples);
+                                                else if (key == "counters")
+                                                {
+                                                    r.begin_object();
+                                                    while (r.next_key(key))
+                                                    {
+                                                        d.counters.emplace_back(store_string(key), 0.0);
+                                                        r.read_double(d.counters.back().second);
+                                                    }
+                                                }
+                                                else if (key == "placement")
+                                                {
+                                                    std::string placement;
+                                                    r.read_string(placement);
+                                                    d.placement = store_string(placement);
+                                                }
+                                                else r.skip_value();
+                                            }
+                                            d.result = result_t(result);
+                                        }
+                                    }
+                                    else r.skip_value();
+                                }
+                                if (!bm.name) return false;
+                            }
+                        }
+                        else r.skip_value();
+                    }
+                }
+            }
+            else r.skip_value();
+        }
+
+        return r.ok();
+    }
+
+    // reads a report written by to_csv (with or without a header)
+    // csv has only the fastest sample of each problem space, so the median and max are
+    // set to it and the mean and standard deviation are unknown (nan)
+    // returns false if the input is not such a report
+    bool from_csv(std::istream& in)
+    {
+        suites.clear();
+
+        std::string line;
+        std::vector<std::string> fields;
+        std::vector<bool> quoted;
+        while (std::getline(in, line))
+        {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+
+            // split to fields, unquoting them
+            fields.clear();
+            quoted.clear();
+            size_t i = 0;
+            while (true)
+            {
+                fields.emplace_back();
+                auto& f = fields.back();
+                quoted.push_back(i < line.size() && line[i] == '"');
+                if (quoted.back())
+                {
+                    ++i;
+                    while (i < line.size())
+                    {
+                        if (line[i] == '"')
+                        {
+                            if (i + 1 < line.size() && line[i + 1] == '"') ++i; // escaped quote
+                            else break;
+                        }
+                        f.push_back(line[i++]);
                     }
+                    if (i == line.size()) return false; // no closing quote
+                    ++i;
+                }
+                while (i < line.size() && line[i] != ',') f.push_back(line[i++]);
+                if (i == line.size()) break;
+                ++i;
+            }
+
+            if (fields.size() < 7) return false;
+            if (fields[0] == "Suite" && fields[1] == "Benchmark") continue; // header
+
+            const char* sname = quoted[0] || !fields[0].empty() ? fields[0].c_str() : nullptr;
+            auto si = _suite_index.index_of(suites, sname);
+            if (si >= suites.size())
+            {
+                si = suites.size();
+                suites.emplace_back();
+                suites.back().name = sname ? store_string(sname) : nullptr;
+                _suite_index.push_back(suites.back().name, si);
+            }
+            auto& suite = suites[si];
+
+            auto bi = suite.benchmark_index.index_of(suite.benchmarks, fields[1].c_str());
+            if (bi >= suite.benchmarks.size())
+            {
+                bi = suite.benchmarks.size();
+                suite.benchmarks.push_back({store_string(fields[1]), false, {}, false, false});
+                suite.benchmark_index.push_back(suite.benchmarks.back().name, bi);
+            }
+            auto& bm = suite.benchmarks[bi];
+            // the flags column has '*' for the baseline, 'c' for cold benchmarks and 'p' for
+            // benchmarks with param dimensions
+            bm.is_baseline = bm.is_baseline || fields[2].find('*') != std::string::npos;
+            bm.is_cold = bm.is_cold || fields[2].find('c') != std::string::npos;
+            bm.has_param_dimensions = bm.has_param_dimensions || fields[2].find('p') != std::string::npos;
+
+            char* end;
+            bm.data.emplace_back();
+            auto& d = bm.data.back();
+            // csv has only the fastest sample
+            d.mean_time_ns = std::nan("");
+            d.stddev_ns = std::nan("");
+            d.dimension = strtoll(fields[3].c_str(), &end, 10);
+            if (*end || d.dimension <= 0) return false;
+            d.samples = int(strtol(fields[4].c_str(), &end, 10));
+            if (*end) return false;
+            d.total_time_ns = strtoll(fields[5].c_str(), &end, 10);
+            if (*end) return false;
+            d.result = result_t(strtoll(fields[6].c_str(), &end, 10));
+            if (*end) return false;
+            d.median_time_ns = d.max_time_ns = d.total_time_ns;
+        }
+
+        return true;
+    }
+
+    // merges the suites and benchmarks of another report into this one (for example
+    // reports from different shards of a run)
+    // benchmarks which are in both get the problem spaces which are missing here
+    // names are copied, so the other report doesn't need to outlive this one
+    // if a suite ends up with more than one baseline, only the first one is kept
+    void merge(const report& other)
+    {
+        if (suites.empty()) random_seed = other.random_seed;
+        if (environment.empty()) environment = other.environment;
+        if (probe_timeline.empty())
+        {
+            probe_reference_ns = other.probe_reference_ns;
+            probe_threshold = other.probe_threshold;
+            probe_timeline = other.probe_timeline;
+        }
+        for (auto& m : other.machine_profile)
+        {
+            if (!find_machine_metric(m.name)) machine_profile.push_back({store_string(m.name), m.value});
+        }
+        if (error == no_error) error = other.error;
+
+        for (auto& os : other.suites)
+        {
+            auto si = suite_index_of(os.name, os.group);
+            if (si >= suites.size())
+            {
+                si = suites.size();
+                suites.emplace_back();
+                suites.back().name = os.name ? store_string(os.name) : nullptr;
+                suites.back().group = os.group ? store_string(os.group) : nullptr;
+                _suite_index.push_back(suites.back().name, si);
+            }
+            auto& suite = suites[si];
+
+            for (auto& ob : os.benchmarks)
+            {
+                auto bi = suite.benchmark_index.index_of(suite.benchmarks, ob.name);
+                if (bi >= suite.benchmarks.size())
+                {
+                    suite.benchmarks.push_back({store_string(ob.name), ob.is_baseline, ob.data, ob.is_cold, ob.has_param_dimensions});
+                    for (auto& d : suite.benchmarks.back().data) store_counter_names(d);
+                    suite.benchmark_index.push_back(suite.benchmarks.back().name, suite.benchmarks.size() - 1);
+                    continue;
+                }
+
+                auto& bm = suite.benchmarks[bi];
+                bm.is_baseline = bm.is_baseline || ob.is_baseline;
+                auto dims = index_dimensions(&bm);
+                for (auto& od : ob.data)
+                {
+                    if (dims.find(od.dimension) != dims.end()) continue;
+                    bm.data.push_back(od);
+                    store_counter_names(bm.data.back());
+                }
+            }
+
+            bool has_baseline = false;
+            for (auto& bm : suite.benchmarks)
+            {
+                if (has_baseline) bm.is_baseline = false;
+                has_baseline = has_baseline || bm.is_baseline;
+            }
+        }
+    }
+
+    void to_text(std::ostream& out) const
+    {
+        using namespace std;
+        for (auto& suite : suites)
+        {
+            group_to_text(out, suite);
+            if (suite.name)
+            {
+                out << "## " << suite.name << ":\n";
+            }
+
+            out.put('\n');
+            out <<
+                " Name (* = baseline)      |   Dim   |  Total ms |  ns/op  |Baseline| Ops/second\n";
+            out <<
+                "--------------------------|--------:|----------:|--------:|-------:|----------:\n";
+
+            auto problem_space_view = get_problem_space_view(suite);
+            for (auto& ps : problem_space_view)
+            {
+                const problem_space_benchmark* baseline = nullptr;
+                for (auto& bm : ps.second)
+                {
+                    if (bm.is_baseline)
+                    {
+                        baseline = &bm;
+                        break;
+                    }
+                }
+
+                for (auto& bm : ps.second)
+                {
+                    out << ' ' << bm.name;
+                    auto pad = 24 - int(strlen(bm.name));
+                    if (bm.is_baseline)
+                    {
+                        out << " *";
+                        pad -= 2;
+                    }
+                    if (bm.is_cold)
+                    {
+                        out << " (cold)";
+                        pad -= 7;
+                    }
+                    for (int i = 0; i < pad; ++i) {
+                        out.put(' ');
+                    }
+
+                    out << " |"
+                        << setw(8) << ps.first << " |"
+                        << setw(10) << fixed << setprecision(3) << double(bm.total_time_ns) / 1000000.0 << " |";
+
+                    ns_per_op_to_text(out, double(bm.total_time_ns) / double(bm.operations), 8);
+                    out << " |";
+
+                    if (baseline == &bm)
+                    {
+                        out << "      - |";
+                    }
+                    else if (bm.pair_ratio > 0)
+                    {
+                        out << setw(7) << fixed << setprecision(3) << bm.pair_ratio << " |";
+                    }
+                    else if (baseline)
+                    {
+                        out << setw(7) << fixed << setprecision(3)
+                            << double(bm.total_time_ns) / double(baseline->total_time_ns) << " |";
+                    }
+                    else
+                    {
+                        // no baseline to compare to
+                        out << "    ??? |";
+                    }
+
+                    auto ops_per_sec = double(bm.operations) * (1000000000.0 / double(bm.total_time_ns));
+                    out << setw(11) << fixed << setprecision(1) << ops_per_sec << "\n";
+                }
+            }
+            out.put('\n');
+            counters_to_text(out, suite);
+            placement_to_text(out, suite);
+            saturation_to_text(out, suite);
+        }
+
+        probe_to_text(out);
+        machine_profile_to_text(out);
+    }
+
+    void to_text_concise(std::ostream& out) const
+    {
+        using namespace std;
+        for (auto& suite : suites)
+        {
+            group_to_text(out, suite);
+            if (suite.name)
+            {
+                out << "## " << suite.name << ":\n";
+            }
+
+            out.put('\n');
+            out <<
+                " Name (* = baseline)      |  ns/op  | Baseline |  Ops/second\n";
+            out <<
+                "--------------------------|--------:|---------:|-----------:\n";
+
+            const benchmark* baseline = nullptr;
+            for (auto& bm : suite.benchmarks)
+            {
+                if (bm.is_baseline)
+                {
+                    baseline = &bm;
+                    break;
+                }
+            }
+            // a suite can have no baseline in a report from a shard
+            double baseline_ns_per_op = 0;
+            if (baseline)
+            {
+                int64_t baseline_total_time = 0;
+                int64_t baseline_total_iterations = 0;
+                for (auto& d : baseline->data)
+                {
+                    baseline_total_time += d.total_time_ns;
+                    baseline_total_iterations += operations(*baseline, d);
+                }
+                baseline_ns_per_op = double(baseline_total_time) / double(baseline_total_iterations);
+            }
+
+            for (auto& bm : suite.benchmarks)
+            {
+                out << ' ' << bm.name;
+                auto pad = 24 - int(strlen(bm.name));
+                if (bm.is_baseline)
+                {
+                    out << " *";
+                    pad -= 2;
+                }
+                if (bm.is_cold)
+                {
+                    out << " (cold)";
+                    pad -= 7;
+                }
+                for (int i = 0; i < pad; ++i) {
+                    out.put(' ');
+                }
+
+                int64_t total_time = 0;
+                int64_t total_iterations = 0;
+                for (auto& d : bm.data)
+                {
+                    total_time += d.total_time_ns;
+                    total_iterations += operations(bm, d);
+                }
+                auto ns_per_op = double(total_time) / double(total_iterations);
+
+                out << " |";
+                ns_per_op_to_text(out, ns_per_op, 8);
+                out << " |";
+
+                if (&bm == baseline)
+                {
+                    out << "        - |";
+                }
+                else if (baseline)
+                {
+                    out << setw(9) << fixed << setprecision(3)
+                        << ns_per_op / baseline_ns_per_op << " |";
+                }
+                else
+                {
+                    out << "      ??? |";
+                }
+
+                auto ops_per_sec = double(total_iterations) * (1000000000.0 / double(total_time));
+                out << setw(12) << fixed << setprecision(1) << ops_per_sec << "\n";
+            }
+
+            out.put('\n');
+            counters_to_text(out, suite);
+            placement_to_text(out, suite);
+            saturation_to_text(out, suite);
+        }
+
+        probe_to_text(out);
+        machine_profile_to_text(out);
+    }
+
+    void to_csv(std::ostream& out, bool header = true) const
+    {
+        using namespace std;
+
+        if (header)
+        {
+            out << "Suite,Benchmark,b,D,S,\"Total ns\",Result,\"ns/op\",Baseline\n";
+        }
+
+        for (auto& suite : suites)
+        {
+            const benchmark* baseline = nullptr;
+            for (auto& bm : suite.benchmarks)
+            {
+                if (bm.is_baseline)
+                {
+                    baseline = &bm;
+                    break;
+                }
+            }
+            auto baseline_data = index_dimensions(baseline); // empty if there's no baseline
+
+            for (auto& bm : suite.benchmarks)
+            {
+                for (auto& d : bm.data)
+                {
+                    // csv has no groups, so they are a prefix of the suite names
+                    if (suite.group)
+                    {
+                        out << '"' << suite.group << '/' << (suite.name ? suite.name : "") << '"';
+                    }
+                    else if (suite.name)
+                    {
+                        out << '"' << suite.name << '"';;
+                    }
+                    out << ",\"" << bm.name << "\",";
+                    if (&bm == baseline)
+                    {
+                        out << '*';
+                    }
+                    if (bm.is_cold)
+                    {
+                        out << 'c';
+                    }
+                    if (bm.has_param_dimensions)
+                    {
+                        out << 'p';
+                    }
+                    out << ','
+                        << d.dimension << ','
+                        << d.samples << ','
+                        << d.total_time_ns << ','
+                        << d.result << ','
+                        << fixed << setprecision(3) << double(d.total_time_ns) / double(operations(bm, d)) << ',';
+
+                    auto bd = baseline_data.find(d.dimension);
+                    if (d.pairs)
+                    {
+                        out << fixed << setprecision(3) << d.pair_ratio_median;
+                    }
+                    else if (bd != baseline_data.end())
+                    {
+                        out << fixed << setprecision(3) << (double(d.total_time_ns) / double(bd->second->total_time_ns));
+                    }
+
+                    out << '\n';
+                }
+            }
+        }
+    }
+
+    // the json is written directly to the stream as it's being generated
+    void to_json(std::ostream& out) const
+    {
+        using namespace std;
+
+        auto flags = out.flags();
+        auto precision = out.precision();
+        out << setprecision(17);
+        out.unsetf(ios_base::floatfield);
+
+        out << "{\n"
+               "  \"picobench_version\": \"" PICOBENCH_VERSION_STR "\",\n"
+               "  \"random_seed\": " << random_seed << ",\n";
+        if (!environment.empty())
+        {
+            out << "  \"environment\": ";
+            environment_to_json(out, environment);
+            out << ",\n";
+        }
+        if (!machine_profile.empty())
+        {
+            out << "  \"machine_profile\": ";
+            machine_profile_to_json(out, machine_profile);
+            out << ",\n";
+        }
+        if (!probe_timeline.empty())
+        {
+            out << "  \"probe\": {\"reference_ns\": " << probe_reference_ns << ", \"threshold\": ";
+            json_num(out, probe_threshold);
+            out << ", \"timeline\": [";
+            for (auto& ps : probe_timeline)
+            {
+                if (&ps != &probe_timeline.front()) out << ", ";
+                out << '[' << ps.time_ns << ", " << ps.duration_ns << ", " << int(ps.disturbed) << ']';
+            }
+            out << "]},\n";
+        }
+        out << "  \"error\": " << int(error) << ",\n"
+               "  \"suites\": [";
+
+        for (auto& suite : suites)
+        {
+            if (&suite != &suites.front()) out.put(',');
+            out << "\n    {\n";
+            if (suite.group)
+            {
+                out << "      \"group\": ";
+                json_str(out, suite.group);
+                out << ",\n";
+            }
+            out << "      \"name\": ";
+            json_str(out, suite.name);
+            out << ",\n"
+                   "      \"benchmarks\": [";
+
+            auto baseline_data = index_dimensions(suite.find_baseline());
+            for (auto& bm : suite.benchmarks)
+            {
+                if (&bm != &suite.benchmarks.front()) out.put(',');
+                out << "\n        {\n"
+                       "          \"name\": ";
+                json_str(out, bm.name);
+                out << ",\n"
+                       "          \"baseline\": " << (bm.is_baseline ? "true" : "false") << ",\n";
+                if (bm.is_cold) out << "          \"cold\": true,\n";
+                if (bm.has_param_dimensions) out << "          \"param_dimensions\": true,\n";
+                saturation_point sp;
+                if (find_saturation(bm, sp))
+                {
+                    out << "          \"saturation\": {\"target_rate\": " << sp.target_rate << ", \"achieved_rate\": ";
+                    json_num(out, sp.achieved_rate);
+                    out << "},\n";
+                }
+                out <<
+                       "          \"data\": [";
+
+                for (auto& d : bm.data)
+                {
+                    if (&d != &bm.data.front()) out.put(',');
+                    out << "\n            ";
+
+                    auto bd = baseline_data.find(d.dimension);
+                    problem_space_to_json(out, d, operations(bm, d), bd == baseline_data.end() ? nullptr : bd->second);
+                }
+
+                out << (bm.data.empty() ? "]\n" : "\n          ]\n")
+                    << "        }";
+            }
+
+            out << (suite.benchmarks.empty() ? "]\n" : "\n      ]\n")
+                << "    }";
+        }
+
+        out << (suites.empty() ? "]\n" : "\n  ]\n")
+            << "}\n";
+
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    static void environment_to_json(std::ostream& out, const std::vector<std::pair<std::string, std::string>>& env)
+    {
+        out.put('{');
+        for (auto& e : env)
+        {
+            if (&e != &env.front()) out << ", ";
+            json_str(out, e.first.c_str());
+            out << ": ";
+            json_str(out, e.second.c_str());
+        }
+        out.put('}');
+    }
+
+    static void machine_profile_to_json(std::ostream& out, const std::vector<machine_metric>& profile)
+    {
+        out.put('{');
+        for (auto& m : profile)
+        {
+            if (&m != &profile.front()) out << ", ";
+            json_str(out, m.name);
+            out << ": ";
+            json_num(out, m.value);
+        }
+        out.put('}');
+    }
+
+    // a header for the group of a suite if it's the first one in the group
+    void group_to_text(std::ostream& out, const suite& s) const
+    {
+        if (!s.group) return;
+        if (&s != &suites.front() && name_index::same_name((&s - 1)->group, s.group)) return;
+        out << "# " << s.group << ":\n\n";
+    }
+
+    // a table of the counters of the benchmarks in a suite (if any)
+    // with a column for each counter name
+    static void counters_to_text(std::ostream& out, const suite& s)
+    {
+        using namespace std;
+        std::vector<const char*> names;
+        for (auto& bm : s.benchmarks)
+        {
+            for (auto& d : bm.data)
+            {
+                for (auto& c : d.counters)
+                {
+                    bool found = false;
+                    for (auto n : names) found = found || strcmp(n, c.first) == 0;
+                    if (!found) names.push_back(c.first);
+                }
+            }
+        }
+        if (names.empty()) return;
+
+        out << " Name (counters)          |   Dim   |";
+        for (auto n : names) out << ' ' << setw(max(int(strlen(n)), 11)) << n << " |";
+        out << "\n--------------------------|--------:|";
+        for (auto n : names) out << string(size_t(max(int(strlen(n)), 11) + 1), '-') << ":|";
+        out.put('\n');
+
+        for (auto& bm : s.benchmarks)
+        {
+            for (auto& d : bm.data)
+            {
+                if (d.counters.empty()) continue;
+                out << ' ' << left << setw(24) << bm.name << right << " |" << setw(8) << d.dimension << " |";
+                for (auto n : names)
+                {
+                    out << ' ' << setw(max(int(strlen(n)), 11));
+                    const std::pair<const char*, double>* counter = nullptr;
+                    for (auto& c : d.counters)
+                    {
+                        if (strcmp(c.first, n) == 0) counter = &c;
+                    }
+                    if (counter) out << fixed << setprecision(3) << counter->second;
+                    else out << '-';
+                    out << " |";
+                }
+                out.put('\n');
+            }
+        }
+        out.put('\n');
+    }
+
+    // writes a time per operation in a column of at least width characters (8 or more) with
+    // as many digits after the point as fit (3 for picoseconds if it's small enough)
+    static void ns_per_op_to_text(std::ostream& out, double ns, int width)
+    {
+        using namespace std;
+        double limit = pow(10.0, width - 4);
+        if (ns >= limit * 10000)
+        {
+            auto v = int64_t(ns);
+            int e = 0;
+            while (v > 999999)
+            {
+                ++e;
+                v /= 10;
+            }
+            out << v << 'e' << e;
+            return;
+        }
+
+        int precision = 3;
+        for (; precision > 0 && ns >= limit; limit *= 10) --precision;
+        out << setw(width) << fixed << setprecision(precision) << ns;
+    }
+
+    // the placements of the threads of the benchmarks of a suite (if any)
+    static void placement_to_text(std::ostream& out, const suite& s)
+    {
+        using namespace std;
+        bool any = false;
+        for (auto& bm : s.benchmarks)
+        {
+            for (auto& d : bm.data)
+            {
+                if (!d.placement) continue;
+                if (!any)
+                {
+                    out << " Name (placement)         |   Dim   | CPUs\n"
+                           "--------------------------|--------:|:-----\n";
+                    any = true;
+                }
+                out << ' ' << left << setw(24) << bm.name << right << " |" << setw(8) << d.dimension << " | " << d.placement << '\n';
+            }
+        }
+        if (any) out.put('\n');
+    }
+
+    // the saturation points of the open-loop benchmarks of a suite (if any)
+    static void saturation_to_text(std::ostream& out, const suite& s)
+    {
+        using namespace std;
+        bool any = false;
+        for (auto& bm : s.benchmarks)
+        {
+            saturation_point sp;
+            if (!find_saturation(bm, sp)) continue;
+            any = true;
+            out << ' ' << bm.name << " saturates at " << fixed << setprecision(1) << sp.achieved_rate
+                << " ops/second (target " << sp.target_rate << " was not reached)\n";
+        }
+        if (any) out.put('\n');
+    }
+
+    // a summary of the interference probe: the periods in which it was disturbed
+    // and the benchmarks with suspect samples
+    void probe_to_text(std::ostream& out) const
+    {
+        using namespace std;
+        if (probe_timeline.empty()) return;
+
+        size_t disturbed = 0;
+        for (auto& ps : probe_timeline)
+        {
+            if (ps.disturbed) ++disturbed;
+        }
+
+        out << "## Interference probe:\n\n"
+            << probe_timeline.size() << " probes with a typical time of " << probe_reference_ns << " ns, "
+            << disturbed << " disturbed (slower than " << setprecision(2) << fixed << probe_threshold << "x)\n";
+
+        // disturbed probes less than a second apart are in the same period
+        const int64_t gap = 1000000000;
+        for (size_t i = 0; i < probe_timeline.size(); )
+        {
+            if (!probe_timeline[i].disturbed)
+            {
+                ++i;
+                continue;
+            }
+
+            auto begin = probe_timeline[i].time_ns;
+            auto end = begin;
+            size_t count = 0;
+            for (; i < probe_timeline.size(); ++i)
+            {
+                auto& ps = probe_timeline[i];
+                if (!ps.disturbed) continue;
+                if (ps.time_ns - end > gap) break;
+                end = ps.time_ns;
+                ++count;
+            }
+
+            out << " * disturbed from " << setprecision(3) << double(begin) / 1e9 << "s to "
+                << double(end) / 1e9 << "s (" << count << " probes)\n";
+        }
+
+        for (auto& suite : suites)
+        {
+            for (auto& bm : suite.benchmarks)
+            {
+                for (auto& d : bm.data)
+                {
+                    if (!d.suspect_samples) continue;
+                    out << " * suspect samples of ";
+                    if (suite.name) out << suite.name << '/';
+                    out << bm.name << " @" << d.dimension << ": " << d.suspect_samples << " of " << d.samples << '\n';
+                }
+            }
+        }
+        out.put('\n');
+    }
+
+    void machine_profile_to_text(std::ostream& out) const
+    {
+        using namespace std;
+        if (machine_profile.empty()) return;
+
+        out << "## Machine profile:\n\n"
+               " Metric                   |         Value\n"
+               "--------------------------|-------------:\n";
+        for (auto& m : machine_profile)
+        {
+            out << ' ' << left << setw(24) << m.name << right << " |"
+                << setw(14) << fixed << setprecision(3) << m.value << '\n';
+        }
+        out.put('\n');
+    }
+
+    // writes a json string or null if str is nullptr
+    static void json_str(std::ostream& out, const char* str)
+    {
+        if (!str)
+        {
+            out << "null";
+            return;
+        }
+
+        out.put('"');
+        for (auto p = str; *p; ++p)
+        {
+            auto c = *p;
+            switch (c)
+            {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    const char* hex = "0123456789abcdef";
+                    out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+                }
+                else
+                {
+                    out.put(c);
+                }
+            }
+        }
+        out.put('"');
+    }
+
+    static void json_num(std::ostream& out, double d)
+    {
+        // json has no representation for inf and nan
+        if (d != d || d - d != 0)
+        {
+            out << "null";
+        }
+        else
+        {
+            out << d;
+        }
+    }
+
+    // writes a single-line json object for the problem space
+    // ops is the operations of a sample (see operations)
+    // baseline_data can be nullptr if there is no data for the baseline of this dimension
+    // expects the stream to be configured like in to_json
+    static void problem_space_to_json(std::ostream& out, const benchmark_problem_space& d, int64_t ops, const benchmark_problem_space* baseline_data)
+    {
+        out << "{\"dimension\": " << d.dimension
+            << ", \"samples\": " << d.samples
+            << ", \"total_ns\": " << d.total_time_ns
+            << ", \"result\": " << d.result
+            << ", \"median_ns\": " << d.median_time_ns
+            << ", \"max_ns\": " << d.max_time_ns
+            << ", \"mean_ns\": ";
+        json_num(out, d.mean_time_ns);
+        out << ", \"stddev_ns\": ";
+        json_num(out, d.stddev_ns);
+        out << ", \"ns_per_op\": ";
+        json_num(out, double(d.total_time_ns) / double(ops));
+        out << ", \"ops_per_sec\": ";
+        json_num(out, double(ops) * (1000000000.0 / double(d.total_time_ns)));
+        out << ", \"baseline_ratio\": ";
+        if (baseline_data)
+        {
+            json_num(out, double(d.total_time_ns) / double(baseline_data->total_time_ns));
+        }
+        else
+        {
+            out << "null";
+        }
+        if (d.pairs)
+        {
+            out << ", \"pairs\": " << d.pairs << ", \"pair_ratio_median\": ";
+            json_num(out, d.pair_ratio_median);
+            out << ", \"pair_ratio_mean\": ";
+            json_num(out, d.pair_ratio_mean);
+            out << ", \"pair_ratio_stddev\": ";
+            json_num(out, d.pair_ratio_stddev);
+        }
+        if (d.suspect_samples)
+        {
+            out << ", \"suspect_samples\": " << d.suspect_samples;
+        }
+        if (!d.counters.empty())
+        {
+            out << ", \"counters\": {";
+            for (auto& c : d.counters)
+            {
+                if (&c != &d.counters.front()) out << ", ";
+                json_str(out, c.first);
+                out << ": ";
+                json_num(out, c.second);
+            }
+            out << '}';
+        }
+        if (d.placement)
+        {
+            out << ", \"placement\": ";
+            json_str(out, d.placement);
+        }
+        out << '}';
+    }
+
+    // fills the pair statistics of a problem space from the ratios of its samples to their
+    // baseline pairs
+    // the ratios will be sorted
+    static void calc_pair_stats(benchmark_problem_space& d, std::vector<double>& ratios)
+    {
+        d.pairs = int(ratios.size());
+        if (ratios.empty()) return;
+
+        std::sort(ratios.begin(), ratios.end());
+        auto size = ratios.size();
+
+        d.pair_ratio_median = ratios[size / 2];
+        if (size % 2 == 0)
+        {
+            d.pair_ratio_median = (d.pair_ratio_median + ratios[size / 2 - 1]) / 2;
+        }
+
+        double sum = 0;
+        for (auto r : ratios) sum += r;
+        d.pair_ratio_mean = sum / double(size);
+
+        double sq = 0;
+        for (auto r : ratios) sq += (r - d.pair_ratio_mean) * (r - d.pair_ratio_mean);
+        d.pair_ratio_stddev = size > 1 ? std::sqrt(sq / double(size - 1)) : 0;
+    }
+
+    // fills the statistics of a problem space from the durations of its samples
+    // the sample times will be sorted
+    static void calc_stats(benchmark_problem_space& d, std::vector<int64_t>& sample_times)
+    {
+        if (sample_times.empty()) return;
+
+        std::sort(sample_times.begin(), sample_times.end());
+        auto size = sample_times.size();
+
+        d.median_time_ns = sample_times[size / 2];
+        if (size % 2 == 0)
+        {
+            d.median_time_ns = (d.median_time_ns + sample_times[size / 2 - 1]) / 2;
+        }
+        d.max_time_ns = sample_times.back();
+
+        double sum = 0;
+        for (auto t : sample_times) sum += double(t);
+        d.mean_time_ns = sum / double(size);
+
+        double sq = 0;
+        for (auto t : sample_times) sq += (double(t) - d.mean_time_ns) * (double(t) - d.mean_time_ns);
+        d.stddev_ns = size > 1 ? std::sqrt(sq / double(size - 1)) : 0;
+    }
+
+    struct problem_space_benchmark
+    {
+        const char* name;
+        bool is_baseline;
+        int64_t total_time_ns; // fastest sample!!!
+        result_t result; // result of fastest sample
+        double pair_ratio; // median ratio to the baseline from paired samples (0 if not paired)
+        bool is_cold;
+        int64_t operations; // of a sample (see report::operations)
+    };
+
+    static std::map<int64_t, std::vector<problem_space_benchmark>> get_problem_space_view(const suite& s)
+    {
+        std::map<int64_t, std::vector<problem_space_benchmark>> res;
+        for (auto& bm : s.benchmarks)
+        {
+            for (auto& d : bm.data)
+            {
+                auto& pvbs = res[d.dimension];
+                pvbs.push_back({ bm.name, bm.is_baseline, d.total_time_ns, d.result, d.pairs ? d.pair_ratio_median : 0.0, bm.is_cold, operations(bm, d) });
+            }
+        }
+        return res;
+    }
+
+    // comparison of a report to an older one (typically loaded from a file)
+    struct comparison
+    {
+        struct entry
+        {
+            const char* suite;
+            const char* benchmark;
+            int64_t dimension;
+            int64_t operations; // of a sample (see report::operations)
+            int64_t old_time_ns; // fastest sample
+            int64_t new_time_ns; // fastest sample
+            double change; // relative change in time: 0.1 means 10% slower
+            bool significant; // the change is bigger than the noise of the samples
+        };
+        std::vector<entry> entries;
+
+        // returns true if a significant slowdown bigger than the threshold was found
+        // threshold is relative: 0.05 means 5%
+        bool has_regression(double threshold) const
+        {
+            for (auto& e : entries)
+            {
+                if (e.significant && e.change > threshold) return true;
+            }
+            return false;
+        }
+
+        void to_text(std::ostream& out, double threshold) const
+        {
+            using namespace std;
+            for (auto& e : entries)
+            {
+                if (&e == &entries.front() || e.suite != (&e - 1)->suite)
+                {
+                    if (&e != &entries.front()) out.put('\n');
+                    if (e.suite)
+                    {
+                        out << "## " << e.suite << ":\n\n";
+                    }
+                    out <<
+                        " Name                     |   Dim   | Old ns/op | New ns/op |  Change  | Note\n";
+                    out <<
+                        "--------------------------|--------:|----------:|----------:|---------:|:-----------\n";
+                }
+
+                out << ' ' << e.benchmark;
+                for (int i = 24 - int(strlen(e.benchmark)); i > 0; --i)
+                {
+                    out.put(' ');
+                }
+
+                out << " |" << setw(8) << e.dimension << " |";
+                ns_per_op_to_text(out, double(e.old_time_ns) / double(e.operations), 10);
+                out << " |";
+                ns_per_op_to_text(out, double(e.new_time_ns) / double(e.operations), 10);
+                out << " |" << setw(8) << fixed << setprecision(1) << showpos << e.change * 100 << noshowpos << "% | ";
+
+                if (!e.significant) out << "noise";
+                else if (e.change > threshold) out << "REGRESSION";
+                else if (e.change < -threshold) out << "improvement";
+                out << '\n';
+            }
+            if (!entries.empty()) out.put('\n');
+        }
+    };
+
+    // dimension to problem space of a benchmark (or an empty map for nullptr)
+    static std::unordered_map<int64_t, const benchmark_problem_space*> index_dimensions(const benchmark* bm)
+    {
+        std::unordered_map<int64_t, const benchmark_problem_space*> ret;
+        if (!bm) return ret;
+        for (auto& d : bm->data)
+        {
+            ret.emplace(d.dimension, &d);
+        }
+        return ret;
+    }
+
+    // compares this report to an older one
+    // only the problem spaces which exist in both reports are compared
+    // a change is considered significant if it's bigger than the spread of the faster half
+    // of the samples (from fastest to median) in both reports
+    comparison compare(const report& old) const
+    {
+        comparison ret;
+        for (auto& suite : suites)
+        {
+            const report::suite* old_suite = old.find_suite(suite.name, suite.group);
+            if (!old_suite) continue;
+
+            for (auto& bm : suite.benchmarks)
+            {
+                auto old_bm = old_suite->find_benchmark(bm.name);
+                if (!old_bm) continue;
+                if (old_bm->is_cold != bm.is_cold) continue; // cold and warm times can't be compared
+                if (old_bm->has_param_dimensions != bm.has_param_dimensions) continue; // neither can operations
+
+                auto old_data = index_dimensions(old_bm);
+                for (auto& d : bm.data)
+                {
+                    auto iod = old_data.find(d.dimension);
+                    if (iod != old_data.end())
+                    {
+                        auto& od = *iod->second;
+                        if (od.total_time_ns == 0) continue;
+
+                        comparison::entry e;
+                        e.suite = suite.name;
+                        e.benchmark = bm.name;
+                        e.dimension = d.dimension;
+                        e.operations = operations(bm, d);
+                        e.old_time_ns = od.total_time_ns;
+                        e.new_time_ns = d.total_time_ns;
+                        e.change = double(d.total_time_ns) / double(od.total_time_ns) - 1;
+
+                        auto noise = std::max(od.median_time_ns - od.total_time_ns, d.median_time_ns - d.total_time_ns);
+                        e.significant = std::abs(d.total_time_ns - od.total_time_ns) > noise;
+
+                        ret.entries.push_back(e);
+                    }
+                }
+            }
+        }
+        return ret;
+    }
+
+private:
+    name_index _suite_index;
+
+    // returns suites.size() if there is no such suite
+    size_t suite_index_of(const char* name, const char* group) const
+    {
+        return std::min(_suite_index.index_of(suites, name, group), suites.size());
+    }
+
+    // storage for the strings which the report owns
+    // shared so that copies of the report don't invalidate names
+    std::shared_ptr<std::deque<std::string>> _strings;
+};
+
+class benchmark_impl : public benchmark
+{
+public:
+    benchmark_impl(const char* name, benchmark_proc proc)
+        : benchmark(name, proc)
+    {}
+
+private:
+    friend class runner;
+
+    // state
+    std::vector<state> _states; // length is _samples * _state_iterations.size()
+
+    // in paired runs the baseline which has the pairs of the states of this benchmark
+    // the pair of state i is _pair_baseline->_states[_pair_base + i]
+    benchmark_impl* _pair_baseline = nullptr;
+    size_t _pair_base = 0;
+
+    // samples which were next to a disturbed interference probe, by state index
+    std::vector<bool> _suspect;
+
+    // of a benchmark expanded from one with params
+    std::vector<std::pair<const char*, int>> _param_values;
+    std::string _expanded_name;
+};
+
+class picostring
+{
+public:
+    picostring() = default;
+    explicit picostring(const char* text)
+        : str(text)
+        , len(int(strlen(text)))
+    {}
+    picostring(const char* text, int len)
+        : str(text)
+        , len(len)
+    {}
+
+    const char* str;
+    int len = 0;
+
+    // checks whether other begins with this string
+    bool is_start_of(const char* other) const
+    {
+        return strncmp(str, other, size_t(len)) == 0;
+    }
+
+    bool operator==(const picostring& other) const
+    {
+        if (len != other.len) return false;
+        return strncmp(str, other.str, size_t(len)) == 0;
+    }
+
+    bool operator==(const char* other) const
+    {
+        return operator==(picostring(other));
+    }
+};
+
+class null_streambuf : public std::streambuf
+{
+public:
+    virtual int overflow(int c) override { return c; }
+};
+
+struct null_stream : public std::ostream
+{
+    null_stream() : std::ostream(&_buf) {}
+private:
+    null_streambuf _buf;
+} cnull;
+
+enum class report_output_format
+{
+    text,
+    concise_text,
+    csv,
+    json,
+    jsonl, // json lines: one line per benchmark written as soon as it's complete
+};
+
+// receives notifications from the runner while the benchmarks are running
+class reporter
+{
+public:
+    virtual ~reporter() {}
+
+    struct run_info
+    {
+        size_t benchmarks; // number of benchmarks to run
+        size_t samples; // total number of samples to take
+        int random_seed;
+    };
+    virtual void run_started(const run_info&) {}
+
+    struct sample_info
+    {
+        const char* suite;
+        const char* benchmark;
+        int64_t dimension;
+        int64_t duration_ns; // measured time
+        int64_t wall_time_ns; // time to run the sample including setup
+        size_t samples_done; // including this one
+        size_t samples_total;
+    };
+    virtual void sample_done(const sample_info&) {}
+
+    // called after the last sample of a benchmark
+    // the results are final but not compared to other benchmarks
+    virtual void benchmark_done(const char* /*suite*/, const report::benchmark&) {}
+
+    // called by runner::run with the final report
+    virtual void run_done(const report&) {}
+};
+
+class text_reporter : public reporter
+{
+public:
+    explicit text_reporter(std::ostream& out) : _out(out) {}
+    virtual void run_done(const report& r) override { r.to_text(_out); }
+private:
+    std::ostream& _out;
+};
+
+class concise_text_reporter : public reporter
+{
+public:
+    explicit concise_text_reporter(std::ostream& out) : _out(out) {}
+    virtual void run_done(const report& r) override { r.to_text_concise(_out); }
+private:
+    std::ostream& _out;
+};
+
+class csv_reporter : public reporter
+{
+public:
+    explicit csv_reporter(std::ostream& out) : _out(out) {}
+    virtual void run_done(const report& r) override { r.to_csv(_out); }
+private:
+    std::ostream& _out;
+};
+
+class json_reporter : public reporter
+{
+public:
+    explicit json_reporter(std::ostream& out) : _out(out) {}
+    virtual void run_done(const report& r) override { r.to_json(_out); }
+private:
+    std::ostream& _out;
+};
+
+// writes a line for each benchmark as soon as it's complete and flushes it
+// thus if the run is interrupted, the completed benchmarks are not lost
+// baseline ratios are not available in these lines, since the baseline may not be complete
+class jsonl_reporter : public reporter
+{
+public:
+    explicit jsonl_reporter(std::ostream& out) : _out(out) {}
+
+    virtual void run_started(const run_info& info) override
+    {
+        _out << "{\"picobench_version\": \"" PICOBENCH_VERSION_STR "\", \"random_seed\": " << info.random_seed
+             << ", \"benchmarks\": " << info.benchmarks << ", \"samples\": " << info.samples << "}\n";
+        _out.flush();
+    }
+
+    virtual void benchmark_done(const char* suite, const report::benchmark& bm) override
+    {
+        auto flags = _out.flags();
+        auto precision = _out.precision();
+        _out << std::setprecision(17);
+        _out.unsetf(std::ios_base::floatfield);
+
+        _out << "{\"suite\": ";
+        report::json_str(_out, suite);
+        _out << ", \"name\": ";
+        report::json_str(_out, bm.name);
+        _out << ", \"baseline\": " << (bm.is_baseline ? "true" : "false");
+        if (bm.is_cold) _out << ", \"cold\": true";
+        if (bm.has_param_dimensions) _out << ", \"param_dimensions\": true";
+        _out << ", \"data\": [";
+        for (auto& d : bm.data)
+        {
+            if (&d != &bm.data.front()) _out << ", ";
+            report::problem_space_to_json(_out, d, report::operations(bm, d), nullptr);
+        }
+        _out << "]}\n";
+        _out.flush();
+
+        _out.flags(flags);
+        _out.precision(precision);
+    }
+
+    virtual void run_done(const report& r) override
+    {
+        _out << "{\"done\": true, \"error\": " << int(r.error);
+        if (!r.environment.empty())
+        {
+            _out << ", \"environment\": ";
+            report::environment_to_json(_out, r.environment);
+        }
+        if (!r.machine_profile.empty())
+        {
+            auto flags = _out.flags();
+            auto precision = _out.precision();
+            _out << std::setprecision(17);
+            _out.unsetf(std::ios_base::floatfield);
+            _out << ", \"machine_profile\": ";
+            report::machine_profile_to_json(_out, r.machine_profile);
+            _out.flags(flags);
+            _out.precision(precision);
+        }
+        _out << "}\n";
+        _out.flush();
+    }
+
+private:
+    std::ostream& _out;
+};
+
+// shows a progress line with an estimated time to completion
+// since the samples are shuffled, the average time of the ones so far is a good
+// estimate for the average time of the remaining ones
+class progress_reporter : public reporter
+{
+public:
+    explicit progress_reporter(std::ostream& out) : _out(out) {}
+
+    virtual void run_started(const run_info&) override
+    {
+        _wall_ns = 0;
+        _last_shown = std::chrono::steady_clock::now();
+    }
+
+    virtual void sample_done(const sample_info& info) override
+    {
+        _wall_ns += info.wall_time_ns;
+
+        // redraw a few times per second at most
+        auto now = std::chrono::steady_clock::now();
+        if (info.samples_done != info.samples_total && now - _last_shown < std::chrono::milliseconds(200)) return;
+        _last_shown = now;
+
+        auto eta_ns = double(_wall_ns) / double(info.samples_done) * double(info.samples_total - info.samples_done);
+
+        auto flags = _out.flags();
+        _out << "\r[" << std::fixed << std::setprecision(1) << std::setw(5)
+             << 100.0 * double(info.samples_done) / double(info.samples_total) << "%] "
+             << info.samples_done << '/' << info.samples_total << " samples, elapsed ";
+        write_time(int64_t(_wall_ns / 1000000000));
+        _out << ", ETA ";
+        write_time(int64_t(eta_ns / 1000000000));
+        _out << "   ";
+        _out.flush();
+        _out.flags(flags);
+    }
+
+    virtual void run_done(const report&) override
+    {
+        _out << '\n';
+    }
+
+private:
+    void write_time(int64_t sec)
+    {
+        auto fill = _out.fill('0');
+        _out << sec / 3600 << ':' << std::setw(2) << sec / 60 % 60 << ':' << std::setw(2) << sec % 60;
+        _out.fill(fill);
+    }
+
+    std::ostream& _out;
+    int64_t _wall_ns = 0;
+    std::chrono::steady_clock::time_point _last_shown;
+};
+
+inline std::unique_ptr<reporter> make_reporter(report_output_format fmt, std::ostream& out)
+{
+    switch (fmt)
+    {
+    case report_output_format::text: return std::unique_ptr<reporter>(new text_reporter(out));
+    case report_output_format::concise_text: return std::unique_ptr<reporter>(new concise_text_reporter(out));
+    case report_output_format::csv: return std::unique_ptr<reporter>(new csv_reporter(out));
+    case report_output_format::json: return std::unique_ptr<reporter>(new json_reporter(out));
+    case report_output_format::jsonl: return std::unique_ptr<reporter>(new jsonl_reporter(out));
+    }
+    return nullptr;
+}
+
+#if !defined(PICOBENCH_DEFAULT_ITERATIONS)
+#   define PICOBENCH_DEFAULT_ITERATIONS { 8, 64, 512, 4096, 8192 }
+#endif
+
+#if !defined(PICOBENCH_DEFAULT_SAMPLES)
+#   define PICOBENCH_DEFAULT_SAMPLES 2
+#endif
+
+using benchmarks_vector = std::vector<std::unique_ptr<benchmark_impl>>;
+struct rsuite
+{
+    const char* name;
+    const char* group; // the module of the suite (see registry::add_module)
+    benchmarks_vector benchmarks;
+};
+
+class registry
+{
+public:
+    benchmark& add_benchmark(const char* name, benchmark_proc proc)
+    {
+        auto b = new benchmark_impl(name, proc);
+        benchmarks_for_current_suite().emplace_back(b);
+        return *b;
+    }
+
+    void set_suite(const char* name)
+    {
+        _current_suite_name = name;
+    }
+
+    const char*& current_suite_name()
+    {
+        return _current_suite_name;
+    }
+
+    benchmarks_vector& benchmarks_for_current_suite()
+    {
+        return suite(_current_suite_name, nullptr).benchmarks;
+    }
+
+    // moves the benchmarks of another registry (like the one of a plugin) to this one
+    // their suites are in the group (which is in the reports as report::suite::group)
+    // the names and functions of the benchmarks belong to the other module, so it must
+    // outlive this registry
+    void add_module(registry& other, const char* group)
+    {
+        for (auto& os : other._suites)
+        {
+            auto& benchmarks = suite(os.name, group).benchmarks;
+            for (auto& b : os.benchmarks)
+            {
+                benchmarks.push_back(std::move(b));
+            }
+        }
+        other._suites.clear();
+        other._suite_index = name_index();
+    }
+
+protected:
+    friend class runner;
+    const char* _current_suite_name = nullptr;
+    std::vector<rsuite> _suites;
+    name_index _suite_index;
+
+    rsuite& suite(const char* name, const char* group)
+    {
+        auto i = _suite_index.index_of(_suites, name, group);
+        if (i < _suites.size()) return _suites[i];
+
+        _suite_index.push_back(name, _suites.size());
+        _suites.push_back({ name, group, {} });
+        return _suites.back();
+    }
+};
+
+I_PICOBENCH_LOCAL registry& g_registry()
+{
+    static registry r;
+    return r;
+}
+
+// identifies the layout of the registry and benchmarks, so that a driver rejects plugins built
+// with a different version or configuration of picobench
+inline uint64_t plugin_abi()
+{
+    uint64_t abi = uint64_t(PICOBENCH_VERSION) << 32;
+    abi |= uint64_t(sizeof(registry) & 0xff) << 24;
+    abi |= uint64_t(sizeof(rsuite) & 0xff) << 16;
+    abi |= uint64_t(sizeof(benchmark_impl) & 0x7fff) << 1;
+#if defined(PICOBENCH_STD_FUNCTION_BENCHMARKS)
+    abi |= 1;
+#endif
+    return abi;
+}
+
+// the entry points of a plugin (see PICOBENCH_IMPLEMENT_PLUGIN)
+using plugin_abi_proc = uint64_t(*)();
+using plugin_registry_proc = registry*(*)();
+
+// functions with distinct code which are called to pollute the instruction cache
+// each is a few dozen bytes of code, so the 2048 of them (about 128 KB) are several times the
+// size of L1i, but they fit in L2 (the unified caches are evicted by the data buffer)
+template <int N>
+#if defined(__GNUC__)
+__attribute__((noinline))
+#elif defined(_MSC_VER)
+__declspec(noinline)
+#endif
+uintptr_t icache_pollution_func(uintptr_t x)
+{
+    x = x * uintptr_t(2 * N + 1) + uintptr_t(N);
+    x ^= x >> (N % 7 + 1);
+    x = x * uintptr_t(4 * N + 3) + uintptr_t(N * 5);
+    x ^= x >> (N % 5 + 2);
+    x = x * uintptr_t(8 * N + 5) - uintptr_t(N * 3);
+    x ^= x << (N % 3 + 1);
+    return x;
+}
+
+using icache_pollution_proc = uintptr_t(*)(uintptr_t);
+
+// fills a table of icache_pollution_func<B>...icache_pollution_func<E-1>
+// split in halves to not hit template recursion limits
+template <int B, int E>
+struct icache_pollution_table
+{
+    static void fill(icache_pollution_proc* table)
+    {
+        icache_pollution_table<B, (B + E) / 2>::fill(table);
+        icache_pollution_table<(B + E) / 2, E>::fill(table);
+    }
+};
+
+template <int B>
+struct icache_pollution_table<B, B + 1>
+{
+    static void fill(icache_pollution_proc* table)
+    {
+        table[B] = icache_pollution_func<B>;
+    }
+};
+
+// evicts the caches before samples of cold benchmarks
+class cache_evictor
+{
+public:
+    // size in bytes of the last level data cache of cpu0, or 0 if it's unknown
+    static size_t llc_size()
+    {
+        auto sizes = cache_sizes();
+        return sizes.empty() ? 0 : sizes.back();
+    }
+
+    // sizes in bytes of the data caches of cpu0 by level, starting from L1
+    // read from /sys/devices/system/cpu/cpu0/cache on linux (empty elsewhere)
+    static std::vector<size_t> cache_sizes()
+    {
+        std::map<int, size_t> levels;
+        char path[128];
+        for (int i = 0; i < 16; ++i)
+        {
+            std::string type, level, size;
+            auto dir = "/sys/devices/system/cpu/cpu0/cache/index";
+            snprintf(path, sizeof(path), "%s%d/type", dir, i);
+            if (!read_line(path, type)) break;
+            if (type == "Instruction") continue;
+            snprintf(path, sizeof(path), "%s%d/level", dir, i);
+            if (!read_line(path, level)) continue;
+            snprintf(path, sizeof(path), "%s%d/size", dir, i);
+            if (!read_line(path, size)) continue;
+
+            auto sz = parse_size(size);
+            if (sz) levels[atoi(level.c_str())] = sz;
+        }
+
+        std::vector<size_t> ret;
+        for (auto& l : levels) ret.push_back(l.second);
+        return ret;
+    }
+
+    // parses sizes like "32K" or "16M" as in sysfs
+    static size_t parse_size(const std::string& str)
+    {
+        char* end;
+        auto n = size_t(strtoull(str.c_str(), &end, 10));
+        switch (*end)
+        {
+        case 'K': case 'k': return n * 1024;
+        case 'M': case 'm': return n * 1024 * 1024;
+        case 'G': case 'g': return n * 1024 * 1024 * 1024;
+        default: return n;
+        }
+    }
+
+    // reads the first line of a file
+    static bool read_line(const char* path, std::string& line)
+    {
+        std::ifstream fin(path);
+        return fin.is_open() && std::getline(fin, line);
+    }
+
+    // evicts the data caches by touching a buffer bigger than the last level cache
+    // and flushes the given buffers (if supported by the platform)
+    void evict_data(const std::vector<std::pair<const void*, size_t>>& flush_buffers)
+    {
+        if (_buf.empty())
+        {
+            auto size = llc_size();
+            // twice the size, for caches which aren't inclusive
+            _buf.resize(size ? size * 2 : 64 * 1024 * 1024, 1);
+        }
+
+        // write a byte per cache line, so that dirty lines are written back as well
+        auto p = _buf.data();
+        for (size_t i = 0; i < _buf.size(); i += 64)
+        {
+            p[i] = uint8_t(p[i] + 1);
+        }
+
+        for (auto& fb : flush_buffers)
+        {
+            flush(fb.first, fb.second);
+        }
+    }
+
+    // calls enough different functions to evict the instruction caches
+    void evict_instructions()
+    {
+        if (!_icache_table[0])
+        {
+            icache_pollution_table<0, icache_table_size>::fill(_icache_table);
+        }
+
+        uintptr_t x = _sink;
+        for (auto f : _icache_table)
+        {
+            x = f(x);
+        }
+        _sink = x;
+    }
 
-                    out << " |";
+    static void flush(const void* data, size_t size)
+    {
+        auto p = static_cast<const char*>(data);
+        for (size_t i = 0; i < size; i += 64)
+        {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+            _mm_clflush(p + i);
+#elif defined(__aarch64__) && defined(__GNUC__)
+            asm volatile("dc civac, %0" : : "r"(p + i) : "memory");
+#else
+            (void)p;
+#endif
+        }
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        _mm_mfence();
+#elif defined(__aarch64__) && defined(__GNUC__)
+        asm volatile("dsb ish" : : : "memory");
+#endif
+    }
 
-                    if (baseline == &bm)
-                    {
-                        out << "      - |";
-                    }
-                    else if (baseline)
-                    {
-                        out << setw(7) << fixed << setprecision(3)
-                            << double(bm.total_time_ns) / double(baseline->total_time_ns) << " |";
-                    }
-                    else
-                    {
-                        // no baseline to compare to
-                        out << "    ??? |";
-                    }
+private:
+    std::vector<uint8_t> _buf;
 
-                    auto ops_per_sec = ps.first * (1000000000.0 / double(bm.total_time_ns));
-                    out << setw(11) << fixed << setprecision(1) << ops_per_sec << "\n";
-                }
-            }
-            out.put('\n');
-        }
+    static const int icache_table_size = 2048;
+    icache_pollution_proc _icache_table[icache_table_size] = {};
+    volatile uintptr_t _sink = 0;
+};
+
+// the cpus on which the process can run as described by sysfs (linux only)
+// used to place the threads of roles (see roles::place)
+class cpu_topology
+{
+public:
+    struct cpu
+    {
+        int id;
+        int core; // the first cpu of its core (the cpus of a core are SMT siblings)
+        int llc; // the first cpu which shares its last level cache
+        int node; // numa node
+        int type; // index in types
+    };
+
+    std::vector<cpu> cpus; // by id
+
+    // the core types of heterogeneous cpus (like "core" and "atom" or "capacity 1024" and
+    // "capacity 512"), empty if all cores are the same
+    std::vector<std::string> types;
+
+    // the topology of this machine (empty if it's unknown)
+    static const cpu_topology& get()
+    {
+        static const cpu_topology t = read();
+        return t;
     }
 
-    void to_text_concise(std::ostream& out)
+    static cpu_topology read()
     {
-        using namespace std;
-        for (auto& suite : suites)
+        cpu_topology t;
+#if defined(__linux__)
+        std::string str;
+        std::vector<int> ids, list;
+        if (!cache_evictor::read_line("/sys/devices/system/cpu/online", str) || !parse_cpu_list(str.c_str(), ids)) return t;
+
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool has_allowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        char path[128];
+        for (auto id : ids)
         {
-            if (suite.name)
+            if (has_allowed && (id >= CPU_SETSIZE || !CPU_ISSET(id, &allowed))) continue;
+
+            cpu c = { id, id, ids.front(), 0, 0 };
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", id);
+            if (cache_evictor::read_line(path, str) && parse_cpu_list(str.c_str(), list) && !list.empty())
             {
-                out << "## " << suite.name << ":\n";
+                c.core = *std::min_element(list.begin(), list.end());
             }
 
-            out.put('\n');
-            out <<
-                " Name (* = baseline)      |  ns/op  | Baseline |  Ops/second\n";
-            out <<
-                "--------------------------|--------:|---------:|-----------:\n";
-
-            const benchmark* baseline = nullptr;
-            for (auto& bm : suite.benchmarks)
+            // the cache with the highest level
+            int llc_level = 0;
+            for (int i = 0; i < 16; ++i)
             {
-                if (bm.is_baseline)
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", id, i);
+                if (!cache_evictor::read_line(path, str)) break;
+                auto level = atoi(str.c_str());
+                if (level < llc_level) continue;
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", id, i);
+                if (cache_evictor::read_line(path, str) && parse_cpu_list(str.c_str(), list) && !list.empty())
                 {
-                    baseline = &bm;
-                    break;
+                    llc_level = level;
+                    c.llc = *std::min_element(list.begin(), list.end());
                 }
             }
-            I_PICOBENCH_ASSERT(baseline);
-            int64_t baseline_total_time = 0;
-            int baseline_total_iterations = 0;
-            for (auto& d : baseline->data)
-            {
-                baseline_total_time += d.total_time_ns;
-                baseline_total_iterations += d.dimension;
-            }
-            int64_t baseline_ns_per_op = baseline_total_time / baseline_total_iterations;
+            t.cpus.push_back(c);
+        }
 
-            for (auto& bm : suite.benchmarks)
+        std::vector<int> nodes;
+        if (cache_evictor::read_line("/sys/devices/system/node/online", str) && parse_cpu_list(str.c_str(), nodes))
+        {
+            for (auto n : nodes)
             {
-                out << ' ' << bm.name;
-                auto pad = 24 - int(strlen(bm.name));
-                if (bm.is_baseline)
+                snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+                if (!cache_evictor::read_line(path, str) || !parse_cpu_list(str.c_str(), list)) continue;
+                for (auto id : list)
                 {
-                    out << " *";
-                    pad -= 2;
-                }
-                for (int i = 0; i < pad; ++i) {
-                    out.put(' ');
+                    if (auto c = t.find(id)) c->node = n;
                 }
+            }
+        }
 
-                int64_t total_time = 0;
-                int total_iterations = 0;
-                for (auto& d : bm.data)
+        // hybrid intel cpus have a pmu for each core type
+        for (auto type : { "core", "atom", "lowpower" })
+        {
+            snprintf(path, sizeof(path), "/sys/devices/cpu_%s/cpus", type);
+            if (!cache_evictor::read_line(path, str) || !parse_cpu_list(str.c_str(), list) || list.empty()) continue;
+            for (auto id : list)
+            {
+                if (auto c = t.find(id)) c->type = int(t.types.size());
+            }
+            t.types.push_back(type);
+        }
+
+        // other heterogeneous cpus (like arm big.LITTLE) have different capacities
+        if (t.types.empty())
+        {
+            std::map<int, std::vector<int>, std::greater<int>> capacities;
+            for (auto& c : t.cpus)
+            {
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", c.id);
+                if (cache_evictor::read_line(path, str)) capacities[atoi(str.c_str())].push_back(c.id);
+            }
+            for (auto& cap : capacities)
+            {
+                for (auto id : cap.second)
                 {
-                    total_time += d.total_time_ns;
-                    total_iterations += d.dimension;
+                    t.find(id)->type = int(t.types.size());
                 }
-                int64_t ns_per_op = total_time / total_iterations;
+                t.types.push_back("capacity " + std::to_string(cap.first));
+            }
+        }
 
-                out << " |" << setw(8) << ns_per_op << " |";
+        if (t.types.size() < 2)
+        {
+            t.types.clear();
+            for (auto& c : t.cpus) c.type = 0;
+        }
+#endif
+        return t;
+    }
 
-                if (&bm == baseline)
-                {
-                    out << "        - |";
-                }
-                else
-                {
-                    out << setw(9) << fixed << setprecision(3)
-                        << double(ns_per_op) / double(baseline_ns_per_op) << " |";
-                }
+    cpu* find(int id)
+    {
+        for (auto& c : cpus)
+        {
+            if (c.id == id) return &c;
+        }
+        return nullptr;
+    }
 
-                auto ops_per_sec = total_iterations * (1000000000.0 / double(total_time));
-                out << setw(12) << fixed << setprecision(1) << ops_per_sec << "\n";
+    // parses lists like "0-3,8,10-11" (as in sysfs)
+    static bool parse_cpu_list(const char* str, std::vector<int>& out)
+    {
+        out.clear();
+        auto p = str;
+        while (*p)
+        {
+            char* end;
+            auto first = strtol(p, &end, 10);
+            if (end == p || first < 0) return false;
+            auto last = first;
+            p = end;
+            if (*p == '-')
+            {
+                last = strtol(p + 1, &end, 10);
+                if (end == p + 1 || last < first) return false;
+                p = end;
+            }
+            for (auto i = first; i <= last; ++i)
+            {
+                out.push_back(int(i));
             }
+            if (*p == ',') ++p;
+            else if (*p) return false;
+        }
+        return true;
+    }
 
-            out.put('\n');
+    // the opposite of parse_cpu_list (ascending runs become ranges)
+    static std::string cpu_list_to_string(const std::vector<int>& ids)
+    {
+        std::string ret;
+        for (size_t i = 0; i < ids.size(); )
+        {
+            auto j = i;
+            while (j + 1 < ids.size() && ids[j + 1] == ids[j] + 1) ++j;
+            if (!ret.empty()) ret += ',';
+            ret += std::to_string(ids[i]);
+            if (j > i) ret += '-' + std::to_string(ids[j]);
+            i = j + 1;
         }
+        return ret;
     }
 
-    void to_csv(std::ostream& out, bool header = true) const
+    // checks the syntax of a placement (see roles::place)
+    static bool valid_placement(const char* spec)
     {
-        using namespace std;
+        std::string policy, type;
+        std::vector<int> list;
+        return split_placement(spec, policy, type) && (is_policy(policy) || parse_cpu_list(policy.c_str(), list));
+    }
 
-        if (header)
+    // the cpus of threads placed as in the placement (see roles::place)
+    // if there are more threads than cpus, the cpus are used again
+    // returns false if the placement is invalid or has no cpus here
+    bool place(const char* spec, size_t threads, std::vector<int>& out) const
+    {
+        out.clear();
+        std::string policy, type;
+        if (!split_placement(spec, policy, type)) return false;
+
+        std::vector<int> order;
+        if (!is_policy(policy))
         {
-            out << "Suite,Benchmark,b,D,S,\"Total ns\",Result,\"ns/op\",Baseline\n";
+            // an explicit list
+            if (!parse_cpu_list(policy.c_str(), order)) return false;
         }
-
-        for (auto& suite : suites)
+        else
         {
-            const benchmark* baseline = nullptr;
-            for (auto& bm : suite.benchmarks)
+            int type_index = -1;
+            if (!type.empty())
             {
-                if (bm.is_baseline)
+                auto f = std::find(types.begin(), types.end(), type);
+                if (f == types.end()) return false;
+                type_index = int(f - types.begin());
+            }
+
+            // the index of each cpu among the SMT siblings of its core
+            struct key
+            {
+                int node, llc, rank, core, id;
+            };
+            std::vector<key> keys;
+            for (auto& c : cpus)
+            {
+                if (type_index >= 0 && c.type != type_index) continue;
+                int rank = 0;
+                for (auto& o : cpus)
                 {
-                    baseline = &bm;
-                    break;
+                    if (o.core == c.core && o.id < c.id) ++rank;
                 }
+                keys.push_back({ c.node, c.llc, rank, c.core, c.id });
             }
-            I_PICOBENCH_ASSERT(baseline);
 
-            for (auto& bm : suite.benchmarks)
+            // one thread per core in a cache, then their siblings, then the next cache
+            std::sort(keys.begin(), keys.end(), [](const key& a, const key& b) {
+                return std::make_tuple(a.node, a.llc, a.rank, a.core) < std::make_tuple(b.node, b.llc, b.rank, b.core);
+            });
+
+            if (policy == "compact")
             {
-                for (auto& d : bm.data)
+                for (auto& k : keys) order.push_back(k.id);
+            }
+            else if (policy == "smt")
+            {
+                std::stable_sort(keys.begin(), keys.end(), [](const key& a, const key& b) {
+                    return std::make_tuple(a.node, a.llc, a.core) < std::make_tuple(b.node, b.llc, b.core);
+                });
+                for (auto& k : keys) order.push_back(k.id);
+            }
+            else if (policy == "l3")
+            {
+                for (auto& k : keys)
                 {
-                    if (suite.name)
-                    {
-                        out << '"' << suite.name << '"';;
-                    }
-                    out << ",\"" << bm.name << "\",";
-                    if (&bm == baseline)
-                    {
-                        out << '*';
-                    }
-                    out << ','
-                        << d.dimension << ','
-                        << d.samples << ','
-                        << d.total_time_ns << ','
-                        << d.result << ','
-                        << (d.total_time_ns / d.dimension) << ',';
-
-                    if (baseline)
+                    if (k.llc == keys.front().llc && k.node == keys.front().node) order.push_back(k.id);
+                }
+            }
+            else
+            {
+                // scatter interleaves the caches and node interleaves the numa nodes
+                bool by_node = policy == "node";
+                std::vector<std::vector<int>> groups;
+                for (size_t i = 0; i < keys.size(); ++i)
+                {
+                    bool same = i > 0 && keys[i].node == keys[i - 1].node && (by_node || keys[i].llc == keys[i - 1].llc);
+                    if (!same) groups.emplace_back();
+                    groups.back().push_back(keys[i].id);
+                }
+                for (size_t i = 0; order.size() < keys.size(); ++i)
+                {
+                    for (auto& g : groups)
                     {
-                        for (auto& bd : baseline->data)
-                        {
-                            if (bd.dimension == d.dimension)
-                            {
-                                out << fixed << setprecision(3) << (double(d.total_time_ns) / double(bd.total_time_ns));
-                            }
-                        }
+                        if (i < g.size()) order.push_back(g[i]);
                     }
-
-                    out << '\n';
                 }
             }
         }
+
+        if (order.empty()) return false;
+        for (size_t i = 0; i < threads; ++i)
+        {
+            out.push_back(order[i % order.size()]);
+        }
+        return true;
     }
 
-    struct problem_space_benchmark
+    // binds the calling thread to a cpu
+    static bool set_thread_cpu(int id)
     {
-        const char* name;
-        bool is_baseline;
-        int64_t total_time_ns; // fastest sample!!!
-        result_t result; // result of fastest sample
-    };
+#if defined(__linux__)
+        if (id >= CPU_SETSIZE) return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(id, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)id;
+        return false;
+#endif
+    }
 
-    static std::map<int, std::vector<problem_space_benchmark>> get_problem_space_view(const suite& s)
+private:
+    static bool is_policy(const std::string& policy)
     {
-        std::map<int, std::vector<problem_space_benchmark>> res;
-        for (auto& bm : s.benchmarks)
+        return policy == "compact" || policy == "scatter" || policy == "smt" || policy == "l3" || policy == "node";
+    }
+
+    // splits "policy:type"
+    static bool split_placement(const char* spec, std::string& policy, std::string& type)
+    {
+        policy = spec;
+        type.clear();
+        auto colon = policy.find(':');
+        if (colon != std::string::npos)
         {
-            for (auto& d : bm.data)
-            {
-                auto& pvbs = res[d.dimension];
-                pvbs.push_back({ bm.name, bm.is_baseline, d.total_time_ns, d.result });
-            }
+            type = policy.substr(colon + 1);
+            policy.resize(colon);
+            if (type.empty()) return false;
         }
-        return res;
+        return !policy.empty();
     }
-
-private:
 };
 
-class benchmark_impl : public benchmark
+// the environment in which the benchmarks run
+class environment_info
 {
 public:
-    benchmark_impl(const char* name, benchmark_proc proc)
-        : benchmark(name, proc)
-    {}
+    using entries = std::vector<std::pair<std::string, std::string>>;
 
-private:
-    friend class runner;
+    // collects the current environment
+    // the compiler and build entries describe the translation unit with PICOBENCH_IMPLEMENT
+    // entries which can't be determined on this platform are omitted
+    static entries collect()
+    {
+        entries ret;
+        std::string str;
 
-    // state
-    std::vector<state> _states; // length is _samples * _state_iterations.size()
-    std::vector<state>::iterator _istate;
-};
+        ret.emplace_back("picobench_version", PICOBENCH_VERSION_STR);
 
-class picostring
-{
-public:
-    picostring() = default;
-    explicit picostring(const char* text)
-        : str(text)
-        , len(int(strlen(text)))
-    {}
-    picostring(const char* text, int len)
-        : str(text)
-        , len(len)
-    {}
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        while (std::getline(cpuinfo, str))
+        {
+            auto colon = str.find(':');
+            if (colon == std::string::npos) continue;
+            auto key = trim(str.substr(0, colon));
+            if (key == "model name" || key == "Model")
+            {
+                ret.emplace_back("cpu_model", trim(str.substr(colon + 1)));
+                break;
+            }
+        }
 
-    const char* str;
-    int len = 0;
+        ret.emplace_back("cores", std::to_string(std::thread::hardware_concurrency()));
 
-    // checks whether other begins with this string
-    bool is_start_of(const char* other) const
-    {
-        return strncmp(str, other, size_t(len)) == 0;
+        auto caches = cache_evictor::cache_sizes();
+        if (!caches.empty())
+        {
+            str.clear();
+            for (size_t i = 0; i < caches.size(); ++i)
+            {
+                if (i) str += ", ";
+                str += "L" + std::to_string(i + 1) + ' ' + std::to_string(caches[i] / 1024) + 'K';
+            }
+            ret.emplace_back("caches", str);
+        }
+
+        auto& topology = cpu_topology::get();
+        if (!topology.types.empty())
+        {
+            // heterogeneous cores
+            str.clear();
+            for (size_t t = 0; t < topology.types.size(); ++t)
+            {
+                std::vector<int> ids;
+                for (auto& c : topology.cpus)
+                {
+                    if (c.type == int(t)) ids.push_back(c.id);
+                }
+                if (t) str += "; ";
+                str += topology.types[t] + ": " + cpu_topology::cpu_list_to_string(ids);
+            }
+            ret.emplace_back("core_types", str);
+        }
+
+        if (cache_evictor::read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor", str))
+        {
+            ret.emplace_back("governor", str);
+        }
+
+        if (cache_evictor::read_line("/sys/devices/system/cpu/intel_pstate/no_turbo", str))
+        {
+            ret.emplace_back("turbo", str == "1" ? "off" : "on");
+        }
+        else if (cache_evictor::read_line("/sys/devices/system/cpu/cpufreq/boost", str))
+        {
+            ret.emplace_back("turbo", str == "1" ? "on" : "off");
+        }
+
+        if (cache_evictor::read_line("/sys/devices/system/cpu/smt/active", str))
+        {
+            ret.emplace_back("smt", str == "1" ? "on" : "off");
+        }
+
+        if (cache_evictor::read_line("/proc/loadavg", str))
+        {
+            // the 1, 5 and 15 minute averages
+            size_t end = 0;
+            for (int i = 0; i < 3 && end != std::string::npos; ++i)
+            {
+                end = str.find(' ', end + 1);
+            }
+            ret.emplace_back("loadavg", str.substr(0, end));
+        }
+
+        std::string os;
+        if (cache_evictor::read_line("/proc/sys/kernel/ostype", os)
+            && cache_evictor::read_line("/proc/sys/kernel/osrelease", str))
+        {
+            ret.emplace_back("kernel", os + ' ' + str);
+        }
+
+        ret.emplace_back("compiler", compiler());
+        ret.emplace_back("optimized", optimized() ? "yes" : "no");
+        ret.emplace_back("build_flags", build_flags());
+
+        return ret;
     }
 
-    bool operator==(const picostring& other) const
+    // returns descriptions of the problems which make the environment noisy
+    static std::vector<std::string> problems(const entries& env)
     {
-        if (len != other.len) return false;
-        return strncmp(str, other.str, size_t(len)) == 0;
+        std::vector<std::string> ret;
+        for (auto& e : env)
+        {
+            if (e.first == "governor" && e.second != "performance")
+            {
+                ret.push_back("The CPU frequency scaling governor is `" + e.second + "` instead of `performance`");
+            }
+            else if (e.first == "turbo" && e.second == "on")
+            {
+                ret.push_back("Turbo boost is on");
+            }
+            else if (e.first == "loadavg" && atof(e.second.c_str()) >= 1)
+            {
+                ret.push_back("The load average is " + e.second);
+            }
+            else if (e.first == "optimized" && e.second == "no")
+            {
+                ret.push_back("The benchmarks are built without optimizations");
+            }
+        }
+        return ret;
     }
 
-    bool operator==(const char* other) const
+    static std::string compiler()
     {
-        return operator==(picostring(other));
+#if defined(__clang__)
+        return "clang " __clang_version__;
+#elif defined(__GNUC__)
+        return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+        return "msvc " + std::to_string(_MSC_FULL_VER);
+#else
+        return "unknown";
+#endif
     }
-};
-
-class null_streambuf : public std::streambuf
-{
-public:
-    virtual int overflow(int c) override { return c; }
-};
-
-struct null_stream : public std::ostream
-{
-    null_stream() : std::ostream(&_buf) {}
-private:
-    null_streambuf _buf;
-} cnull;
-
-enum class report_output_format
-{
-    text,
-    concise_text,
-    csv,
-};
 
-#if !defined(PICOBENCH_DEFAULT_ITERATIONS)
-#   define PICOBENCH_DEFAULT_ITERATIONS { 8, 64, 512, 4096, 8192 }
+    static bool optimized()
+    {
+#if defined(__OPTIMIZE__) || (defined(_MSC_VER) && !defined(_DEBUG))
+        return true;
+#else
+        return false;
 #endif
+    }
 
-#if !defined(PICOBENCH_DEFAULT_SAMPLES)
-#   define PICOBENCH_DEFAULT_SAMPLES 2
+    // define PICOBENCH_BUILD_FLAGS (for example to the flags from your build system)
+    // when compiling PICOBENCH_IMPLEMENT to have them in the reports
+    // otherwise the flags which can be detected by predefined macros are listed
+    static std::string build_flags()
+    {
+#if defined(PICOBENCH_BUILD_FLAGS)
+        return PICOBENCH_BUILD_FLAGS;
+#else
+        std::string ret;
+        auto add = [&ret](const char* flag) {
+            if (!ret.empty()) ret += ' ';
+            ret += flag;
+        };
+#   if defined(__OPTIMIZE_SIZE__)
+        add("-Os");
+#   elif defined(__OPTIMIZE__)
+        add("-O");
+#   endif
+#   if defined(NDEBUG)
+        add("-DNDEBUG");
+#   endif
+#   if defined(__FAST_MATH__)
+        add("-ffast-math");
+#   endif
+#   if defined(__AVX512F__)
+        add("-mavx512f");
+#   elif defined(__AVX2__)
+        add("-mavx2");
+#   elif defined(__AVX__)
+        add("-mavx");
+#   endif
+#   if defined(__ARM_NEON)
+        add("neon");
+#   endif
+#   if defined(__SANITIZE_ADDRESS__)
+        add("-fsanitize=address");
+#   elif defined(__has_feature)
+#       if __has_feature(address_sanitizer)
+        add("-fsanitize=address");
+#       endif
+#   endif
+        (void)add;
+        return ret;
 #endif
+    }
 
-using benchmarks_vector = std::vector<std::unique_ptr<benchmark_impl>>;
-struct rsuite
-{
-    const char* name;
-    benchmarks_vector benchmarks;
+private:
+    static std::string trim(const std::string& str)
+    {
+        auto b = str.find_first_not_of(" \t");
+        if (b == std::string::npos) return std::string();
+        auto e = str.find_last_not_of(" \t");
+        return str.substr(b, e - b + 1);
+    }
 };
 
-class registry
+// a small fixed-cost reference loop which is run between samples
+// when it's slower than usual, something else was using the machine and the samples
+// next to it are suspect
+class interference_probe
 {
 public:
-    benchmark& add_benchmark(const char* name, benchmark_proc proc)
+    interference_probe(benchmark_proc proc, double threshold)
+        : _proc(proc ? proc : reference_loop)
+        , _threshold(threshold)
+        , _start(high_res_clock::now())
+    {}
+
+    // the default probe
+    static void reference_loop(state& s)
     {
-        auto b = new benchmark_impl(name, proc);
-        benchmarks_for_current_suite().emplace_back(b);
-        return *b;
+        uint64_t x = 1;
+        s.start_timer();
+        for (int i = 0; i < s.iterations(); ++i)
+        {
+            x = (x ^ uint64_t(i)) * 0x9E3779B97F4A7C15ull;
+        }
+        s.stop_timer();
+        s.set_result(result_t(x));
     }
 
-    void set_suite(const char* name)
+    // the median of a few probes is the typical time
+    void calibrate()
     {
-        _current_suite_name = name;
+        std::vector<int64_t> times;
+        for (int i = 0; i < 15; ++i)
+        {
+            times.push_back(measure());
+        }
+        std::sort(times.begin(), times.end());
+        _reference = times[times.size() / 2];
     }
 
-    const char*& current_suite_name()
+    // runs the probe and returns whether it was disturbed
+    bool run()
     {
-        return _current_suite_name;
+        auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(high_res_clock::now() - _start).count();
+        auto duration = measure();
+        // a probe faster than the timer's resolution can't tell anything
+        bool disturbed = _reference > 0 && double(duration) > double(_reference) * _threshold;
+        _timeline.push_back({int64_t(time), duration, disturbed});
+        return disturbed;
     }
 
-    benchmarks_vector& benchmarks_for_current_suite()
-    {
-        for (auto& s : _suites)
-        {
-            if (s.name == _current_suite_name)
-                return s.benchmarks;
+    int64_t reference_ns() const { return _reference; }
+    std::vector<report::probe_sample>& timeline() { return _timeline; }
 
-            if (s.name && _current_suite_name && strcmp(s.name, _current_suite_name) == 0)
-                return s.benchmarks;
-        }
-        _suites.push_back({ _current_suite_name, {} });
-        return _suites.back().benchmarks;
+private:
+    int64_t measure()
+    {
+        state s(iterations);
+        _proc(s);
+        return s.duration_ns();
     }
 
-protected:
-    friend class runner;
-    const char* _current_suite_name = nullptr;
-    std::vector<rsuite> _suites;
+    static const int iterations = 1000;
+
+    benchmark_proc _proc;
+    double _threshold;
+    high_res_clock::time_point _start;
+    int64_t _reference = 0;
+    std::vector<report::probe_sample> _timeline;
 };
 
-registry& g_registry()
-{
-    static registry r;
-    return r;
-}
+// runs the machine characterization suite (defined after the runner which it uses)
+std::vector<report::machine_metric> measure_machine_profile();
 
 class runner : public registry
 {
@@ -847,8 +3748,23 @@ public:
     {
         if (should_run())
         {
-            run_benchmarks(benchmark_random_seed);
-            auto report = generate_report();
+            if (_worker) return run_worker(std::cin, *_stdout);
+
+            if (!preflight_check()) return error();
+
+            report old_report;
+            if (_compare_to)
+            {
+                std::ifstream fin(_compare_to);
+                if (!fin.is_open() || !old_report.from_json(fin))
+                {
+                    *_stderr << "Error: Could not read report `" << _compare_to << "`\n";
+                    _error = error_bad_report;
+                    return error();
+                }
+            }
+
+            // open the output before running, so that reporters can write as the benchmarks complete
             std::ostream* out = _stdout;
             std::ofstream fout;
             if (preferred_output_filename())
@@ -862,114 +3778,544 @@ public:
                 out = &fout;
             }
 
-            switch (preferred_output_format())
+            auto num_user_reporters = _reporters.size();
+            auto output_reporter = make_reporter(preferred_output_format(), *out);
+            _reporters.push_back(output_reporter.get());
+            std::unique_ptr<reporter> progress;
+            if (_show_progress)
+            {
+                progress.reset(new progress_reporter(*_stderr));
+                _reporters.push_back(progress.get());
+            }
+
+            run_benchmarks(benchmark_random_seed);
+            if (_error != no_error)
+            {
+                _reporters.resize(num_user_reporters);
+                return error();
+            }
+            auto report = generate_report();
+
+            for (auto r : _reporters)
+            {
+                r->run_done(report);
+            }
+            _reporters.resize(num_user_reporters);
+
+            if (_compare_to)
+            {
+                // on stdout only after text reports, so that csv and json stay parsable
+                auto fmt = preferred_output_format();
+                bool to_stdout = out != _stdout ||
+                    fmt == report_output_format::text || fmt == report_output_format::concise_text;
+                auto& cmp_out = to_stdout ? *_stdout : *_stderr;
+                auto cmp = report.compare(old_report);
+                cmp_out << "# Compared to " << _compare_to << ":\n\n";
+                cmp.to_text(cmp_out, _regression_threshold);
+                if (cmp.has_regression(_regression_threshold))
+                {
+                    *_stderr << "Error: Benchmarks regressed by more than "
+                             << _regression_threshold * 100 << "% compared to " << _compare_to << '\n';
+                    _error = error_regression;
+                }
+            }
+        }
+        return error();
+    }
+
+    // warns about problems which make the environment noisy
+    // in strict mode they are errors and the function returns false
+    bool preflight_check()
+    {
+        if (!_capture_environment) return true;
+
+        // the run which follows has the checked environment in its report
+        _environment = current_environment();
+        _environment_checked = true;
+        auto problems = environment_info::problems(_environment);
+        for (auto& p : problems)
+        {
+            if (_strict) *_stderr << "Error: " << p << ". Refusing to run in strict mode.\n";
+            // not to _stdwarn, so that reports written to stdout stay readable
+            else *_stderr << "Warning: " << p << ". Results may be noisy.\n";
+        }
+
+        if (_strict && !problems.empty())
+        {
+            _error = error_noisy_environment;
+            return false;
+        }
+        return true;
+    }
+
+    void run_benchmarks(int random_seed = -1)
+    {
+        I_PICOBENCH_ASSERT(_error == no_error && _should_run);
+
+        apply_filters();
+        apply_shard();
+
+        if (!_capture_environment)
+        {
+            _environment.clear();
+        }
+        else if (!_environment_checked)
+        {
+            _environment = current_environment();
+        }
+        _environment_checked = false;
+
+        if (_profile_machine && _machine_profile.empty())
+        {
+            _machine_profile = measure_machine_profile();
+        }
+
+        // benchmarks which were completed in a previous run
+        std::vector<checkpoint_benchmark> restored;
+        if (_resume_file)
+        {
+            if (!load_checkpoint(random_seed, restored)) return;
+        }
+
+        if (random_seed == -1)
+        {
+            random_seed = _seed;
+        }
+
+        if (random_seed == -1)
+        {
+            random_seed = int(std::random_device()());
+        }
+
+        _random_seed = random_seed;
+
+        std::minstd_rand rnd(random_seed);
+
+        // vector of all benchmarks
+        struct running_benchmark
+        {
+            benchmark_impl* b;
+            const char* suite;
+            size_t suite_index; // in _suites (different suites can have the same name in different groups)
+            size_t index; // order in the run
+            checkpoint_benchmark* restored; // completed in a previous run
+            size_t pair_baseline; // index of the baseline in paired runs, or -1
+        };
+        std::vector<running_benchmark> benchmarks;
+        for (size_t si = 0; si < _suites.size(); ++si)
+        {
+            auto& suite = _suites[si];
+            // also identify a baseline in this loop
+            // if there is no explicit one, set the first one as a baseline
+            bool found_baseline = false;
+            for (auto& rb : suite.benchmarks)
+            {
+                rb->_states.clear(); // clear states so we can safely call run_benchmarks multiple times
+                rb->_suspect.clear();
+                rb->_pair_baseline = nullptr;
+                benchmarks.push_back({rb.get(), suite.name, si, benchmarks.size(), nullptr, size_t(-1)});
+                if (rb->_baseline)
+                {
+                    found_baseline = true;
+                }
+            }
+
+#if !defined(PICOBENCH_STD_FUNCTION_BENCHMARKS)
+            warn_same_functions(suite.benchmarks);
+#endif
+
+            // when sharded, baselines are selected before sharding and a suite in this shard
+            // may not have one
+            if (!found_baseline && !suite.benchmarks.empty() && !_sharded)
+            {
+                suite.benchmarks.front()->_baseline = true;
+            }
+        }
+
+        for (auto& cb : restored)
+        {
+            if (cb.index >= benchmarks.size() || !cb.matches(benchmarks[cb.index].suite, benchmarks[cb.index].b->name()))
+            {
+                *_stderr << "Error: Checkpoint benchmark " << cb.name << " doesn't match the benchmarks being run\n";
+                _error = error_checkpoint;
+                return;
+            }
+            benchmarks[cb.index].restored = &cb;
+        }
+
+        // initialize benchmarks
+        // the samples of each benchmark are the units of the schedule
+        std::vector<uint32_t> num_units;
+        num_units.reserve(benchmarks.size());
+        for (auto& rb : benchmarks)
+        {
+            auto b = rb.b;
+            const std::vector<int64_t>& state_iterations =
+                b->_state_iterations.empty() ?
+                _default_state_iterations :
+                b->_state_iterations;
+
+            if (b->_samples == 0)
+                b->_samples = _default_samples;
+
+            b->_states.reserve(state_iterations.size() * size_t(b->_samples));
+
+            // fill states while random shuffling them (inside-out Fisher-Yates)
+            // this is the same distribution as inserting each one at a random position
+            for (auto iters : state_iterations)
+            {
+                for (int i = 0; i < b->_samples; ++i)
+                {
+                    auto index = rnd() % (b->_states.size() + 1);
+                    b->_states.emplace_back(iters, b->_user_data);
+                    if (index != b->_states.size() - 1)
+                    {
+                        std::swap(b->_states[index], b->_states.back());
+                    }
+                }
+            }
+
+            num_units.push_back(uint32_t(b->_states.size()));
+        }
+
+        if (_paired)
+        {
+            // add a baseline state for each state of the other benchmarks in its suite
+            // they are run next to each other as pairs
+            size_t baseline = size_t(-1);
+            for (size_t i = 0; i < benchmarks.size(); ++i)
+            {
+                auto& rb = benchmarks[i];
+                if (i == 0 || rb.suite_index != benchmarks[i - 1].suite_index)
+                {
+                    // new suite
+                    baseline = size_t(-1);
+                    for (size_t j = i; j < benchmarks.size() && benchmarks[j].suite_index == rb.suite_index; ++j)
+                    {
+                        if (benchmarks[j].b->_baseline)
+                        {
+                            baseline = j;
+                            break;
+                        }
+                    }
+                }
+
+                if (baseline == size_t(-1) || baseline == i) continue;
+
+                auto bb = benchmarks[baseline].b;
+                rb.pair_baseline = baseline;
+                rb.b->_pair_baseline = bb;
+                rb.b->_pair_base = bb->_states.size();
+                for (auto& st : rb.b->_states)
+                {
+                    bb->_states.emplace_back(st.iterations(), bb->_user_data);
+                }
+            }
+        }
+
+        size_t total_samples = 0;
+        std::vector<uint32_t> num_states;
+        num_states.reserve(benchmarks.size());
+        for (auto& rb : benchmarks)
+        {
+            auto b = rb.b;
+            if (rb.restored)
+            {
+                // the shuffling above still needs to happen, so the random sequence is the same
+                auto& rs = rb.restored->states;
+                bool match = rs.size() == b->_states.size();
+                for (size_t i = 0; match && i < rs.size(); ++i)
+                {
+                    match = rs[i].iterations() == b->_states[i].iterations();
+                }
+                if (!match)
+                {
+                    *_stderr << "Error: Checkpoint samples of " << b->name() << " don't match the benchmark\n";
+                    _error = error_checkpoint;
+                    return;
+                }
+                b->_states = rs;
+            }
+
+            total_samples += b->_states.size();
+            num_states.push_back(uint32_t(b->_states.size()));
+
+            // each sample has its own random numbers (like the times of poisson arrivals), which
+            // depend only on the seed of the run and its position in it
+            auto seed = state::derive_seed(uint32_t(random_seed), rb.index);
+            for (size_t i = 0; i < b->_states.size(); ++i)
+            {
+                b->_states[i]._seed = state::derive_seed(seed, i);
+            }
+        }
+
+        auto schedule = make_schedule(num_units, total_samples, rnd);
+
+        if (_paired)
+        {
+            // put the pair of each sample next to it, alternating which one is first
+            std::vector<scheduled_sample> paired;
+            paired.reserve(total_samples);
+            for (auto& sample : schedule)
+            {
+                auto& rb = benchmarks[sample.benchmark];
+                if (rb.pair_baseline == size_t(-1))
+                {
+                    paired.push_back(sample);
+                    continue;
+                }
+
+                scheduled_sample pair = {uint32_t(rb.pair_baseline), uint32_t(rb.b->_pair_base + sample.state)};
+                if (sample.state % 2)
+                {
+                    paired.push_back(sample);
+                    paired.push_back(pair);
+                }
+                else
+                {
+                    paired.push_back(pair);
+                    paired.push_back(sample);
+                }
+            }
+            schedule.swap(paired);
+        }
+
+        if (!restored.empty())
+        {
+            // the schedule is known up front, so a checkpoint of a different sequence is
+            // rejected before running anything
+            auto remaining = num_states;
+            for (size_t step = 0; step < schedule.size(); ++step)
+            {
+                auto& sample = schedule[step];
+                auto& rb = benchmarks[sample.benchmark];
+                if (--remaining[sample.benchmark] == 0 && rb.restored && rb.restored->completed_at != step)
+                {
+                    *_stderr << "Error: Checkpoint sequence doesn't match the run at " << rb.b->name() << "\n";
+                    _error = error_checkpoint;
+                    return;
+                }
+            }
+        }
+
+        std::ofstream checkpoint;
+        if (_checkpoint_file)
+        {
+            checkpoint.open(_checkpoint_file);
+            if (!checkpoint.is_open())
             {
-            case report_output_format::text:
-                report.to_text(*out);
-                break;
-            case report_output_format::concise_text:
-                report.to_text_concise(*out);
-                break;
-            case report_output_format::csv:
-                report.to_csv(*out);
-                break;
+                *_stderr << "Error: Could not open checkpoint file `" << _checkpoint_file << "`\n";
+                _error = error_checkpoint;
+                return;
             }
-        }
-        return error();
-    }
+            checkpoint << "{\"picobench_checkpoint\": 1, \"random_seed\": " << random_seed
+                       << ", \"benchmarks\": " << benchmarks.size() << ", \"samples\": " << total_samples << "}\n";
 
-    void run_benchmarks(int random_seed = -1)
-    {
-        I_PICOBENCH_ASSERT(_error == no_error && _should_run);
+            // the restored benchmarks are written before running anything, so that they aren't
+            // lost if this run is interrupted too (the checkpoint can be the resumed file)
+            std::vector<const running_benchmark*> done;
+            for (auto& rb : benchmarks)
+            {
+                if (rb.restored) done.push_back(&rb);
+            }
+            std::sort(done.begin(), done.end(), [](const running_benchmark* a, const running_benchmark* b) {
+                return a->restored->completed_at < b->restored->completed_at;
+            });
+            for (auto rb : done)
+            {
+                write_checkpoint(checkpoint, rb->index, rb->suite, *rb->b, rb->restored->completed_at);
+            }
+            checkpoint.flush();
+        }
 
-        if (random_seed == -1)
+        for (auto r : _reporters)
         {
-            random_seed = int(std::random_device()());
+            r->run_started({benchmarks.size(), total_samples, random_seed});
         }
 
-        std::minstd_rand rnd(random_seed);
+        // we run the samples in the order of the schedule
+        // restored benchmarks are not run, but their samples are still in the schedule, so
+        // that the sequence is the same as in the interrupted run
+        size_t samples_done = 0;
+        auto remaining = num_states;
+        std::unique_ptr<cache_evictor> evictor;
+
+        // a sample is suspect if the probe before or after it is disturbed
+        std::unique_ptr<interference_probe> probe;
+        bool probe_disturbed = false;
+        if (_probe)
+        {
+            probe.reset(new interference_probe(_probe_proc, _probe_threshold));
+            probe->calibrate();
+            probe_disturbed = probe->run();
+        }
 
-        // vector of all benchmarks
-        std::vector<benchmark_impl*> benchmarks;
-        for (auto& suite : _suites)
+        for (size_t step = 0; step < schedule.size(); ++step)
         {
-            // also identify a baseline in this loop
-            // if there is no explicit one, set the first one as a baseline
-            bool found_baseline = false;
-            for (auto irb = suite.benchmarks.begin(); irb != suite.benchmarks.end(); ++irb)
+            auto& sample = schedule[step];
+            auto& rb = benchmarks[sample.benchmark];
+            auto b = rb.b;
+            auto& st = b->_states[sample.state];
+
+            if (rb.restored)
             {
-                auto& rb = *irb;
-                rb->_states.clear(); // clear states so we can safely call run_benchmarks multiple times
-                benchmarks.push_back(rb.get());
-                if (rb->_baseline)
+                // the state has the data from the previous run
+                ++samples_done;
+            }
+            else
+            {
+                // suspect samples are run again right away, after the probe which disturbed them
+                int64_t wall_time = 0;
+                for (int attempt = 0; ; ++attempt)
                 {
-                    found_baseline = true;
+                    if (is_cold(*b))
+                    {
+                        if (!evictor) evictor.reset(new cache_evictor);
+                        if (cold_data(*b)) evictor->evict_data(b->_flush_buffers);
+                        if (cold_instructions(*b)) evictor->evict_instructions();
+                    }
+
+                    st._params = &b->_param_values;
+                    st._placement_policy = _placement;
+                    auto start = high_res_clock::now();
+                    b->_proc(st);
+                    wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(high_res_clock::now() - start).count();
+
+                    if (!probe) break;
+
+                    bool suspect = probe_disturbed;
+                    probe_disturbed = probe->run();
+                    if (!suspect && !probe_disturbed) break;
+
+                    if (attempt == _probe_max_retries)
+                    {
+                        b->_suspect.resize(b->_states.size());
+                        b->_suspect[sample.state] = true;
+                        break;
+                    }
+
+                    // the same sample again, with the same random numbers
+                    auto seed = st._seed;
+                    st = state(st.iterations(), b->_user_data);
+                    st._seed = seed;
                 }
 
-#if !defined(PICOBENCH_STD_FUNCTION_BENCHMARKS)
-                // check for same func
-                for (auto ib = irb+1; ib != suite.benchmarks.end(); ++ib)
+                if (!_reporters.empty())
                 {
-                    auto& b = *ib;
-                    if (rb->_proc == b->_proc && rb->_user_data == b->_user_data)
+                    ++samples_done;
+                    reporter::sample_info info = {rb.suite, b->name(), st.iterations(), st.duration_ns(),
+                        wall_time, samples_done, total_samples};
+                    for (auto r : _reporters)
                     {
-                        *_stdwarn << "Warning: " << rb->name() << " and " << b->name()
-                                 << " are benchmarks of the same function.\n";
+                        r->sample_done(info);
                     }
                 }
-#endif
             }
 
-            if (!found_baseline && !suite.benchmarks.empty())
+            if (--remaining[sample.benchmark] == 0)
             {
-                suite.benchmarks.front()->_baseline = true;
+                // last sample of the benchmark
+                if (checkpoint.is_open() && !rb.restored)
+                {
+                    write_checkpoint(checkpoint, rb.index, rb.suite, *b, step);
+                }
+
+                if (!_reporters.empty())
+                {
+                    report::benchmark rpt_b;
+                    auto cmp = std::equal_to<result_t>();
+                    fill_report_benchmark(rpt_b, *b, false, cmp);
+                    for (auto r : _reporters)
+                    {
+                        r->benchmark_done(rb.suite, rpt_b);
+                    }
+                }
             }
         }
 
-        // initialize benchmarks
-        for (auto b : benchmarks)
-        {
-            const std::vector<int>& state_iterations =
-                b->_state_iterations.empty() ?
-                _default_state_iterations :
-                b->_state_iterations;
-
-            if (b->_samples == 0)
-                b->_samples = _default_samples;
+        _probe_reference_ns = probe ? probe->reference_ns() : 0;
+        _probe_timeline.clear();
+        if (probe) _probe_timeline.swap(probe->timeline());
+    }
 
-            b->_states.reserve(state_iterations.size() * size_t(b->_samples));
+    // in worker mode runner::run doesn't run the benchmarks, but runs single samples on request
+    // from another process (like tools/ab.cpp) through the standard input and output
+    // this allows a driver to run the benchmarks of several executables alternately
+    void set_worker(bool b) { _worker = b; }
+    bool worker() const { return _worker; }
+
+    // the protocol is lines of tab-separated fields
+    // first the worker writes a line for each benchmark and then `ready`:
+    //   benchmark <index> <suite> <name> <iterations>
+    // (the suite is empty for the default suite and the iterations are comma-separated)
+    // then it replies to each request with a line:
+    //   run <index> <iterations> -> sample <duration_ns> <result> [<counter>=<value> ...]
+    // bad requests get `error <message>`
+    // `quit` or the end of the input stops the worker
+    // the benchmarks should not write to the output
+    int run_worker(std::istream& in, std::ostream& out)
+    {
+        apply_filters();
 
-            // fill states while random shuffling them
-            for (auto iters : state_iterations)
+        std::vector<benchmark_impl*> benchmarks;
+        for (auto& suite : _suites)
+        {
+            for (auto& b : suite.benchmarks)
             {
-                for (int i = 0; i < b->_samples; ++i)
+                auto& iterations = b->_state_iterations.empty() ? _default_state_iterations : b->_state_iterations;
+                out << "benchmark\t" << benchmarks.size() << '\t' << (suite.name ? suite.name : "") << '\t' << b->name() << '\t';
+                for (size_t i = 0; i < iterations.size(); ++i)
                 {
-                    auto index = rnd() % (b->_states.size() + 1);
-                    auto pos = b->_states.begin() + long(index);
-                    b->_states.emplace(pos, iters, b->_user_data);
+                    out << (i ? "," : "") << iterations[i];
                 }
+                out << '\n';
+                benchmarks.push_back(b.get());
             }
-
-            b->_istate = b->_states.begin();
         }
+        out << "ready" << std::endl;
+        uint64_t samples_run = 0;
 
-        // we run a random benchmark from it incrementing _istate for each
-        // when _istate reaches _states.end(), we erase the benchmark
-        // when the vector becomes empty, we're done
-        while (!benchmarks.empty())
+        std::unique_ptr<cache_evictor> evictor;
+        std::string line;
+        while (std::getline(in, line))
         {
-            auto i = benchmarks.begin() + long(rnd() % benchmarks.size());
-            auto& b = *i;
+            if (line == "quit") break;
+
+            std::istringstream sin(line);
+            std::string request;
+            size_t index = 0;
+            int64_t iterations = 0;
+            sin >> request >> index >> iterations;
+            if (request != "run" || sin.fail() || index >= benchmarks.size() || iterations <= 0)
+            {
+                out << "error\tBad request: " << line << std::endl;
+                continue;
+            }
 
-            b->_proc(*b->_istate);
+            auto b = benchmarks[index];
+            if (is_cold(*b))
+            {
+                if (!evictor) evictor.reset(new cache_evictor);
+                if (cold_data(*b)) evictor->evict_data(b->_flush_buffers);
+                if (cold_instructions(*b)) evictor->evict_instructions();
+            }
 
-            ++b->_istate;
+            state st(iterations, b->_user_data);
+            st._params = &b->_param_values;
+            st._placement_policy = _placement;
+            st._seed = state::derive_seed(uint32_t(_seed), samples_run++);
+            b->_proc(st);
 
-            if (b->_istate == b->_states.end())
+            std::ostringstream reply;
+            reply << std::setprecision(17) << "sample\t" << st.duration_ns() << '\t' << st.result();
+            for (auto& c : st.counters())
             {
-                benchmarks.erase(i);
+                reply << '\t' << c.first << '=' << c.second;
             }
+            out << reply.str() << std::endl;
         }
+
+        return error();
     }
 
     // function to compare results
@@ -977,6 +4323,12 @@ public:
     report generate_report(CompareResult cmp = std::equal_to<result_t>()) const
     {
         report rpt;
+        rpt.random_seed = _random_seed;
+        rpt.environment = _environment;
+        rpt.probe_reference_ns = _probe_reference_ns;
+        rpt.probe_threshold = _probe ? _probe_threshold : 0;
+        rpt.probe_timeline = _probe_timeline;
+        rpt.machine_profile = _machine_profile;
 
         rpt.suites.resize(_suites.size());
         auto rpt_suite = rpt.suites.begin();
@@ -984,6 +4336,7 @@ public:
         for (auto& suite : _suites)
         {
             rpt_suite->name = suite.name;
+            rpt_suite->group = suite.group;
 
             // build benchmark view
             rpt_suite->benchmarks.resize(suite.benchmarks.size());
@@ -991,54 +4344,7 @@ public:
 
             for (auto& b : suite.benchmarks)
             {
-                rpt_benchmark->name = b->_name;
-                rpt_benchmark->is_baseline = b->_baseline;
-
-                const std::vector<int>& state_iterations =
-                    b->_state_iterations.empty() ?
-                    _default_state_iterations :
-                    b->_state_iterations;
-
-                rpt_benchmark->data.reserve(state_iterations.size());
-                for (auto d : state_iterations)
-                {
-                    rpt_benchmark->data.push_back({d, 0, 0ll, result_t(0)});
-                }
-
-                for (auto& state : b->_states)
-                {
-                    for (auto& d : rpt_benchmark->data)
-                    {
-                        if (state.iterations() == d.dimension)
-                        {
-                            if (d.total_time_ns == 0 || d.total_time_ns > state.duration_ns())
-                            {
-                                d.total_time_ns = state.duration_ns();
-                                d.result = state.result();
-                            }
-
-                            if (_compare_results_across_samples)
-                            {
-                                if (d.result != state.result() && !cmp(d.result, state.result()))
-                                {
-                                    *_stderr << "Error: Two samples of " << b->name() << " @" << d.dimension << " produced different results: "
-                                             << d.result << " and " << state.result() << '\n';
-                                    _error = error_sample_compare;
-                                }
-                            }
-
-                            ++d.samples;
-                        }
-                    }
-                }
-
-#if defined(PICOBENCH_DEBUG)
-                for (auto& d : rpt_benchmark->data)
-                {
-                    I_PICOBENCH_ASSERT(d.samples == b->_samples);
-                }
-#endif
-
+                fill_report_benchmark(*rpt_benchmark, *b, _compare_results_across_samples, cmp);
                 ++rpt_benchmark;
             }
 
@@ -1083,12 +4389,19 @@ public:
         return rpt;
     }
 
-    void set_default_state_iterations(const std::vector<int>& data)
+    void set_default_state_iterations(const std::vector<int64_t>& data)
     {
         _default_state_iterations = data;
     }
 
-    const std::vector<int>& default_state_iterations() const
+    // for vectors of other integer types, like the std::vector<int> of earlier versions
+    template <typename Int>
+    void set_default_state_iterations(const std::vector<Int>& data)
+    {
+        _default_state_iterations.assign(data.begin(), data.end());
+    }
+
+    const std::vector<int64_t>& default_state_iterations() const
     {
         return _default_state_iterations;
     }
@@ -1130,15 +4443,60 @@ public:
             _opts.emplace_back("-samples=", "<n>",
                 "Sets default number of samples for benchmarks",
                 &runner::cmd_samples);
-            _opts.emplace_back("-out-fmt=", "<txt|con|csv>",
-                "Outputs text or concise or csv",
+            _opts.emplace_back("-seed=", "<n>",
+                "Sets the seed for the order of samples",
+                &runner::cmd_seed);
+            _opts.emplace_back("-paired", "",
+                "Runs each sample next to a baseline sample",
+                &runner::cmd_paired);
+            _opts.emplace_back("-cold-icache", "",
+                "Evicts data and instruction caches before each sample",
+                &runner::cmd_cold_icache);
+            _opts.emplace_back("-cold", "",
+                "Evicts data caches before each sample",
+                &runner::cmd_cold);
+            _opts.emplace_back("-probe-threshold=", "<x>",
+                "Sets the slowdown of a disturbed probe (default 1.5)",
+                &runner::cmd_probe_threshold);
+            _opts.emplace_back("-probe-retries=", "<n>",
+                "Sets the reruns of suspect samples (default 2)",
+                &runner::cmd_probe_retries);
+            _opts.emplace_back("-probe", "",
+                "Detects interference with a probe between samples",
+                &runner::cmd_probe);
+            _opts.emplace_back("-strict", "",
+                "Refuses to run in a noisy environment",
+                &runner::cmd_strict);
+            _opts.emplace_back("-placement=", "<policy|cpus>",
+                "Places the threads of roles: compact, scatter, smt, l3, node or a cpu list",
+                &runner::cmd_placement);
+            _opts.emplace_back("-machine-profile", "",
+                "Measures the machine and adds its profile to the report",
+                &runner::cmd_machine_profile);
+            _opts.emplace_back("-out-fmt=", "<txt|con|csv|json|jsonl>",
+                "Outputs text or concise or csv or json or json lines",
                 &runner::cmd_out_fmt);
             _opts.emplace_back("-output=", "<filename>",
                 "Sets output filename or `stdout`",
                 &runner::cmd_output);
+            _opts.emplace_back("-progress", "",
+                "Shows progress while running",
+                &runner::cmd_progress);
+            _opts.emplace_back("-checkpoint=", "<filename>",
+                "Saves completed benchmarks to a file",
+                &runner::cmd_checkpoint);
+            _opts.emplace_back("-resume=", "<filename>",
+                "Skips benchmarks completed in a checkpoint",
+                &runner::cmd_resume);
             _opts.emplace_back("-compare-results", "",
                 "Compare benchmark results",
                 &runner::cmd_compare_results);
+            _opts.emplace_back("-compare-to=", "<filename>",
+                "Compares times to a json report",
+                &runner::cmd_compare_to);
+            _opts.emplace_back("-regression-threshold=", "<%>",
+                "Sets slowdown which is an error (default 5)",
+                &runner::cmd_regression_threshold);
             _opts.emplace_back("-no-run", "",
                 "Doesn't run benchmarks",
                 &runner::cmd_no_run);
@@ -1148,9 +4506,24 @@ public:
             _opts.emplace_back("-run-only=", "<b1,b2,...>",
                 "Runs only selected benchmarks",
                 &runner::cmd_run_only);
+            _opts.emplace_back("-filter=", "<p1,p2,...>",
+                "Runs only benchmarks matching a pattern",
+                &runner::cmd_filter);
+            _opts.emplace_back("-exclude=", "<p1,p2,...>",
+                "Doesn't run benchmarks matching a pattern",
+                &runner::cmd_exclude);
+            _opts.emplace_back("-shard=", "<i/n>",
+                "Runs only shard i of n (0 <= i < n)",
+                &runner::cmd_shard);
+            _opts.emplace_back("-shard-costs=", "<filename>",
+                "Estimates costs for -shard from a json report",
+                &runner::cmd_shard_costs);
             _opts.emplace_back("-list", "",
-                "Lists available benchmarks",
+                "Lists selected benchmarks",
                 &runner::cmd_list);
+            _opts.emplace_back("-worker", "",
+                "Runs samples on request from another process",
+                &runner::cmd_worker);
             _opts.emplace_back("-version", "",
                 "Show version info",
                 &runner::cmd_version);
@@ -1194,41 +4567,431 @@ public:
                 }
             }
 
-            if (!found)
+            if (!found)
+            {
+                *_stderr << "Error: Unknown command-line argument: " << argv[i] << "\n";
+                _error = error_unknown_cmd_line_argument;
+                return false;
+            }
+        }
+
+        apply_filters();
+
+        if (_list)
+        {
+            // benchmarks can be added after parsing, so only shard here if listing
+            apply_shard();
+            list_benchmarks();
+        }
+
+        return true;
+    }
+
+    void set_should_run(bool set) { _should_run = set; }
+    bool should_run() const { return _error == no_error && _should_run; }
+    void set_error(error_t e) { _error = e; }
+    error_t error() const { return _error; }
+
+    void set_output_streams(std::ostream& out, std::ostream& err)
+    {
+        _stdout = &out;
+        _stderr = &err;
+        _stdwarn = &out;
+    }
+
+    void set_preferred_output_format(report_output_format fmt) { _output_format = fmt; }
+    report_output_format preferred_output_format() const { return _output_format; }
+
+    // can be nullptr (run will interpret it as stdout)
+    void set_preferred_output_filename(const char* path) { _output_file = path; }
+    const char* preferred_output_filename() const { return _output_file; }
+
+    void set_compare_results_across_samples(bool b) { _compare_results_across_samples = b; }
+    bool compare_results_across_samples() const { return _compare_results_across_samples; }
+
+    void set_compare_results_across_benchmarks(bool b) { _compare_results_across_benchmarks = b; }
+    bool compare_results_across_benchmarks() const { return _compare_results_across_benchmarks; }
+
+    // reporters are notified while the benchmarks are running
+    // the runner doesn't take ownership of them
+    void add_reporter(reporter* r) { _reporters.push_back(r); }
+    void remove_reporter(reporter* r) { _reporters.erase(std::remove(_reporters.begin(), _reporters.end(), r), _reporters.end()); }
+
+    // after each completed benchmark write its samples to a file (nullptr means no checkpoints)
+    void set_checkpoint_filename(const char* path) { _checkpoint_file = path; }
+    const char* checkpoint_filename() const { return _checkpoint_file; }
+
+    // skip the benchmarks which were completed in a checkpoint file (nullptr means don't resume)
+    // run_benchmarks will use the random seed from the checkpoint
+    void set_resume_filename(const char* path) { _resume_file = path; }
+    const char* resume_filename() const { return _resume_file; }
+
+    // seed for the random order of samples for runs which aren't given one explicitly
+    // -1 means a random seed for each run
+    // the seed of a run is stored in its report
+    void set_default_random_seed(int seed) { _seed = seed; }
+    int default_random_seed() const { return _seed; }
+
+    // in paired runs each sample of a benchmark is run right next to a sample of the
+    // baseline of its suite with the same iterations, alternating which one is first
+    // the baseline ratios in the report are computed from these pairs, so slow drifts
+    // (like thermal throttling) affect them less
+    // this doubles the number of baseline samples for each benchmark in the suite
+    void set_paired(bool b) { _paired = b; }
+    bool paired() const { return _paired; }
+
+    // evict the data caches (and optionally pollute the instruction cache) before each sample
+    // of all benchmarks (in addition to the ones set with benchmark::cold)
+    // the eviction is not timed
+    void set_cold(bool data, bool instructions = false) { _cold_data = data; _cold_instructions = instructions; }
+    bool cold_data() const { return _cold_data; }
+    bool cold_instructions() const { return _cold_instructions; }
+    // which caches are evicted before the samples of a benchmark of this runner
+    bool cold_data(const benchmark& b) const { return b._cold_data || _cold_data; }
+    bool cold_instructions(const benchmark& b) const { return b._cold_instructions || _cold_instructions; }
+
+    // run a small reference loop (the probe) between samples to detect interference
+    // samples next to a probe slower than threshold times its typical time are suspect
+    // a suspect sample is run again, up to max_retries times, and marked as suspect in the
+    // report if it's still next to a disturbed probe
+    void set_probe(bool enable, double threshold = 1.5, int max_retries = 2)
+    {
+        _probe = enable;
+        _probe_threshold = threshold;
+        _probe_max_retries = max_retries;
+    }
+    bool probe() const { return _probe; }
+    double probe_threshold() const { return _probe_threshold; }
+    int probe_max_retries() const { return _probe_max_retries; }
+
+    // replace the default probe
+    // its duration should be the same every time on a quiet machine
+    void set_probe_proc(benchmark_proc proc) { _probe_proc = proc; }
+
+    // the default placement of the threads of roles (see roles::place) or nullptr for none
+    // the string should outlive the runner
+    void set_placement(const char* spec) { _placement = spec; }
+    const char* placement() const { return _placement; }
+
+    // in strict mode runner::run refuses to run in a noisy environment
+    // otherwise it only warns about it
+    void set_strict(bool b) { _strict = b; }
+    bool strict() const { return _strict; }
+
+    // the environment is captured in reports and checked by runner::run by default
+    // turn it off to have reports which don't depend on the machine
+    void set_capture_environment(bool b) { _capture_environment = b; }
+    bool capture_environment() const { return _capture_environment; }
+
+    // the environment of the last run (included in its report)
+    const environment_info::entries& environment() const { return _environment; }
+
+    // sets the environment of the runs instead of collecting it (for example to check the
+    // environment of another machine)
+    void set_environment(environment_info::entries env) { _given_environment = std::move(env); _has_given_environment = true; }
+
+    // measure the machine characterization suite before the first run and include its
+    // results in reports as a machine profile (takes a few seconds)
+    void set_profile_machine(bool b) { _profile_machine = b; }
+    bool profile_machine() const { return _profile_machine; }
+    const std::vector<report::machine_metric>& machine_profile() const { return _machine_profile; }
+
+    // adds a filter which selects the benchmarks to run
+    // a benchmark runs if it matches any of the include filters (or there are none),
+    // and none of the exclude filters
+    // the pattern is one of:
+    //  * a glob with `*`, `?` and `[...]` matched against "suite/benchmark"
+    //    (or against the benchmark name only, if the pattern has no '/')
+    //  * `re:<regex>` - an ECMAScript regex which is searched for in "suite/benchmark"
+    //  * `tag:<glob>` - a glob matched against the tags of the benchmark
+    // benchmarks from the default suite have no "suite/" in their path
+    // returns false if the pattern is not valid
+    bool add_filter(const char* pattern, bool exclude = false)
+    {
+        filter f;
+        f.exclude = exclude;
+        if (strncmp(pattern, "re:", 3) == 0)
+        {
+            f.type = filter::regex;
+            pattern += 3;
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+            try
+            {
+                f.re.assign(pattern, std::regex::ECMAScript | std::regex::optimize);
+            }
+            catch (const std::regex_error&)
+            {
+                return false;
+            }
+#else
+            f.re.assign(pattern, std::regex::ECMAScript | std::regex::optimize);
+#endif
+        }
+        else if (strncmp(pattern, "tag:", 4) == 0)
+        {
+            f.type = filter::tag;
+            pattern += 4;
+        }
+        else
+        {
+            f.type = strchr(pattern, '/') ? filter::path : filter::name;
+        }
+
+        if (!*pattern) return false;
+        f.pattern = pattern;
+        _filters.push_back(std::move(f));
+        return true;
+    }
+
+    void clear_filters() { _filters.clear(); }
+
+    // removes the benchmarks which don't pass the filters
+    // suites which are left empty are removed
+    // called by run_benchmarks and by the command line parser
+    void apply_filters()
+    {
+        expand_params();
+        if (_filters.empty()) return;
+
+        std::string path;
+        for (auto& suite : _suites)
+        {
+            auto new_end = std::remove_if(suite.benchmarks.begin(), suite.benchmarks.end(),
+                [&](const std::unique_ptr<benchmark_impl>& b) {
+                    return !is_selected(suite.name, *b, path);
+                });
+            suite.benchmarks.erase(new_end, suite.benchmarks.end());
+        }
+
+        auto new_end = std::remove_if(_suites.begin(), _suites.end(), [](const rsuite& s) {
+            return s.benchmarks.empty();
+        });
+        _suites.erase(new_end, _suites.end());
+    }
+
+    // replaces the benchmarks with params by a benchmark for each combination of their values
+    // (before the filters, so that they can select combinations by name)
+    void expand_params()
+    {
+        for (auto& suite : _suites)
+        {
+            benchmarks_vector expanded;
+            for (auto& b : suite.benchmarks)
+            {
+                if (b->_params.empty())
+                {
+                    expanded.push_back(std::move(b));
+                    continue;
+                }
+
+                // odometer over the values of the params
+                std::vector<size_t> pos(b->_params.size(), 0);
+                bool done = false;
+                for (auto& p : b->_params)
+                {
+                    done = done || p.second.empty();
+                }
+                while (!done)
+                {
+                    auto e = new benchmark_impl(*b);
+                    expanded.emplace_back(e);
+                    e->_params.clear();
+                    e->_expanded_name = b->_name;
+                    for (size_t i = 0; i < pos.size(); ++i)
+                    {
+                        auto& p = b->_params[i];
+                        e->_param_values.emplace_back(p.first, p.second[pos[i]]);
+                        e->_expanded_name += std::string(" [") + p.first + '=' + std::to_string(p.second[pos[i]]) + ']';
+                    }
+                    e->_name = e->_expanded_name.c_str();
+
+                    done = true;
+                    for (size_t i = pos.size(); i-- > 0; )
+                    {
+                        if (++pos[i] < b->_params[i].second.size())
+                        {
+                            done = false;
+                            break;
+                        }
+                        pos[i] = 0;
+                    }
+                }
+            }
+            suite.benchmarks.swap(expanded);
+        }
+    }
+
+    // runs only a part of the benchmarks: shard `index` of `count` (0 <= index < count)
+    // all processes with the same benchmarks and shard count get disjoint sets
+    // the benchmarks are distributed by estimated cost (see set_shard_cost_estimates)
+    // reports from the shards can be combined with report::merge
+    void set_shard(int index, int count)
+    {
+        I_PICOBENCH_ASSERT(index >= 0 && index < count);
+        _shard_index = index;
+        _shard_count = count;
+    }
+    int shard_index() const { return _shard_index; }
+    int shard_count() const { return _shard_count; }
+
+    // uses the times from a report (for example a previous run) to estimate the cost of
+    // benchmarks when sharding
+    // benchmarks which are not in the report are estimated by their iterations and samples
+    void set_shard_cost_estimates(const report& rpt)
+    {
+        _shard_ns_per_iteration.clear();
+        std::string path;
+        for (auto& suite : rpt.suites)
+        {
+            for (auto& bm : suite.benchmarks)
+            {
+                double ns = 0, iters = 0;
+                for (auto& d : bm.data)
+                {
+                    ns += std::isnan(d.mean_time_ns) ? double(d.total_time_ns) : d.mean_time_ns;
+                    iters += d.dimension;
+                }
+                if (iters == 0 || ns == 0) continue;
+                benchmark_path(path, suite.name, bm.name);
+                _shard_ns_per_iteration[path] = ns / iters;
+            }
+        }
+    }
+
+    // selects the benchmarks of the shard set with set_shard
+    // baselines are selected before that, so that each suite has the same baseline in all shards
+    // called by run_benchmarks and by the command line parser when listing benchmarks
+    void apply_shard()
+    {
+        if (_shard_count <= 1 || _sharded) return;
+        _sharded = true;
+
+        struct shard_item
+        {
+            benchmark_impl* b;
+            double iterations; // total for all samples
+            double cost;
+        };
+        std::vector<shard_item> items;
+
+        // known ns per iteration to estimate the unknown ones in the same units
+        double known_ns = 0, known_iterations = 0;
+        std::string path;
+        for (auto& suite : _suites)
+        {
+            bool found_baseline = false;
+            for (auto& b : suite.benchmarks)
+            {
+                found_baseline = found_baseline || b->_baseline;
+
+                const std::vector<int64_t>& state_iterations =
+                    b->_state_iterations.empty() ?
+                    _default_state_iterations :
+                    b->_state_iterations;
+                double iters = 0;
+                for (auto i : state_iterations) iters += i;
+                iters *= b->_samples ? b->_samples : _default_samples;
+
+                benchmark_path(path, suite.name, b->name());
+                auto f = _shard_ns_per_iteration.find(path);
+                double cost = -1;
+                if (f != _shard_ns_per_iteration.end())
+                {
+                    cost = f->second * iters;
+                    known_ns += cost;
+                    known_iterations += iters;
+                }
+                items.push_back({b.get(), iters, cost});
+            }
+
+            if (!found_baseline && !suite.benchmarks.empty())
+            {
+                suite.benchmarks.front()->_baseline = true;
+            }
+        }
+
+        double ns_per_iteration = known_iterations > 0 ? known_ns / known_iterations : 1;
+        for (auto& item : items)
+        {
+            if (item.cost < 0) item.cost = item.iterations * ns_per_iteration;
+        }
+
+        // greedily give the most expensive benchmark to the shard with the least total cost
+        // the sort is stable and ties go to the lower shard, so all processes get the same result
+        std::stable_sort(items.begin(), items.end(), [](const shard_item& a, const shard_item& b) {
+            return a.cost > b.cost;
+        });
+        std::vector<double> shard_costs(size_t(_shard_count), 0.0);
+        std::unordered_set<const benchmark_impl*> selected;
+        for (auto& item : items)
+        {
+            auto shard = std::min_element(shard_costs.begin(), shard_costs.end());
+            *shard += item.cost;
+            if (shard - shard_costs.begin() == _shard_index) selected.insert(item.b);
+        }
+
+        for (auto& suite : _suites)
+        {
+            auto new_end = std::remove_if(suite.benchmarks.begin(), suite.benchmarks.end(),
+                [&selected](const std::unique_ptr<benchmark_impl>& b) {
+                    return selected.find(b.get()) == selected.end();
+                });
+            suite.benchmarks.erase(new_end, suite.benchmarks.end());
+        }
+
+        auto new_end = std::remove_if(_suites.begin(), _suites.end(), [](const rsuite& s) {
+            return s.benchmarks.empty();
+        });
+        _suites.erase(new_end, _suites.end());
+    }
+
+    // matches a string to a glob pattern with `*`, `?` and `[...]` (or `[!...]`)
+    static bool glob_match(const char* pattern, const char* str)
+    {
+        const char* star = nullptr; // position after the last star in the pattern
+        const char* star_str = nullptr; // position in the string matched by it
+        while (*str)
+        {
+            if (*pattern == '*')
+            {
+                star = ++pattern;
+                star_str = str;
+                continue;
+            }
+
+            const char* next = match_glob_char(pattern, *str);
+            if (next)
+            {
+                pattern = next;
+                ++str;
+            }
+            else if (star)
+            {
+                // backtrack, letting the last star match one more char
+                pattern = star;
+                str = ++star_str;
+            }
+            else
             {
-                *_stderr << "Error: Unknown command-line argument: " << argv[i] << "\n";
-                _error = error_unknown_cmd_line_argument;
                 return false;
             }
         }
 
-        return true;
-    }
-
-    void set_should_run(bool set) { _should_run = set; }
-    bool should_run() const { return _error == no_error && _should_run; }
-    void set_error(error_t e) { _error = e; }
-    error_t error() const { return _error; }
-
-    void set_output_streams(std::ostream& out, std::ostream& err)
-    {
-        _stdout = &out;
-        _stderr = &err;
-        _stdwarn = &out;
+        while (*pattern == '*') ++pattern;
+        return !*pattern;
     }
 
-    void set_preferred_output_format(report_output_format fmt) { _output_format = fmt; }
-    report_output_format preferred_output_format() const { return _output_format; }
-
-    // can be nullptr (run will interpret it as stdout)
-    void set_preferred_output_filename(const char* path) { _output_file = path; }
-    const char* preferred_output_filename() const { return _output_file; }
+    // show a progress line in the error stream while running
+    void set_show_progress(bool b) { _show_progress = b; }
+    bool show_progress() const { return _show_progress; }
 
-    void set_compare_results_across_samples(bool b) { _compare_results_across_samples = b; }
-    bool compare_results_across_samples() const { return _compare_results_across_samples; }
+    // json report to compare the results of run to (nullptr means no comparison)
+    void set_compare_to_filename(const char* path) { _compare_to = path; }
+    const char* compare_to_filename() const { return _compare_to; }
 
-    void set_compare_results_across_benchmarks(bool b) { _compare_results_across_benchmarks = b; }
-    bool compare_results_across_benchmarks() const { return _compare_results_across_benchmarks; }
+    // relative slowdown which is considered a regression: 0.05 means 5%
+    void set_regression_threshold(double t) { _regression_threshold = t; }
+    double regression_threshold() const { return _regression_threshold; }
 
 private:
     // runner's suites and benchmarks come from its parent: registry
@@ -1236,6 +4999,26 @@ private:
     // state and configuration
     mutable error_t _error = no_error;
     bool _should_run = true;
+    int _random_seed = 0; // seed of the last run
+    int _seed = -1; // seed for runs which aren't given one (-1 means random)
+    bool _cold_data = false;
+    bool _cold_instructions = false;
+    bool _profile_machine = false;
+    bool _strict = false;
+    const char* _placement = nullptr;
+    bool _capture_environment = true;
+    bool _probe = false;
+    double _probe_threshold = 1.5;
+    int _probe_max_retries = 2;
+    benchmark_proc _probe_proc = nullptr;
+    int64_t _probe_reference_ns = 0;
+    std::vector<report::probe_sample> _probe_timeline;
+    environment_info::entries _environment;
+    environment_info::entries _given_environment;
+    bool _has_given_environment = false;
+    bool _environment_checked = false; // by preflight_check for the next run
+    std::vector<report::machine_metric> _machine_profile;
+    bool _paired = false;
 
     bool _compare_results_across_samples = false;
     bool _compare_results_across_benchmarks = false;
@@ -1243,6 +5026,16 @@ private:
     report_output_format _output_format = report_output_format::text;
     const char* _output_file = nullptr; // nullptr means stdout
 
+    const char* _compare_to = nullptr;
+    double _regression_threshold = 0.05;
+
+    std::vector<reporter*> _reporters;
+    bool _show_progress = false;
+
+    const char* _checkpoint_file = nullptr;
+    const char* _resume_file = nullptr;
+    std::unordered_set<std::string> _checkpoint_strings; // names of counters and placements of restored states
+
     std::ostream* _stdout = &std::cout;
     std::ostream* _stderr = &std::cerr;
     std::ostream* _stdwarn = &std::cout;
@@ -1250,7 +5043,7 @@ private:
     // default data
 
     // default iterations per state per benchmark
-    std::vector<int> _default_state_iterations;
+    std::vector<int64_t> _default_state_iterations;
 
     // default samples per benchmark
     int _default_samples;
@@ -1277,16 +5070,474 @@ private:
         uintptr_t user_data; // passed as an argument to user handlers
         ext_handler user_handler;
     };
+    struct filter
+    {
+        bool exclude;
+        enum { path, name, regex, tag } type;
+        std::string pattern;
+        std::regex re;
+    };
+    std::vector<filter> _filters;
+
+    bool _list = false; // list benchmarks after parsing the command line
+    bool _worker = false; // run samples on request (see run_worker)
+
+    // returns the position after the single char in the pattern if it matches c, or nullptr
+    static const char* match_glob_char(const char* pattern, char c)
+    {
+        if (!*pattern) return nullptr;
+        if (*pattern == '?') return pattern + 1;
+        if (*pattern != '[') return *pattern == c ? pattern + 1 : nullptr;
+
+        auto p = pattern + 1;
+        bool negate = *p == '!';
+        if (negate) ++p;
+
+        bool match = false;
+        // a ']' right after the opening is part of the set
+        auto first = p;
+        while (*p && (*p != ']' || p == first))
+        {
+            if (p[1] == '-' && p[2] && p[2] != ']')
+            {
+                if (c >= p[0] && c <= p[2]) match = true;
+                p += 3;
+            }
+            else
+            {
+                if (c == *p) match = true;
+                ++p;
+            }
+        }
+
+        if (!*p)
+        {
+            // no closing bracket, so treat '[' as a regular char
+            return c == '[' ? pattern + 1 : nullptr;
+        }
+
+        return match != negate ? p + 1 : nullptr;
+    }
+
+    bool matches(const filter& f, const char* suite, const benchmark_impl& b, std::string& path) const
+    {
+        switch (f.type)
+        {
+        case filter::name:
+            return glob_match(f.pattern.c_str(), b.name());
+        case filter::tag:
+            for (auto t : b._tags)
+            {
+                if (glob_match(f.pattern.c_str(), t)) return true;
+            }
+            return false;
+        default:
+            break;
+        }
+
+        benchmark_path(path, suite, b.name());
+
+        if (f.type == filter::regex) return std::regex_search(path, f.re);
+        return glob_match(f.pattern.c_str(), path.c_str());
+    }
+
+    // path is a buffer for the "suite/benchmark" path
+    // "suite/benchmark" or just "benchmark" for the default suite
+    static void benchmark_path(std::string& path, const char* suite, const char* name)
+    {
+        path.clear();
+        if (suite)
+        {
+            path += suite;
+            path += '/';
+        }
+        path += name;
+    }
+
+    int _shard_index = 0;
+    int _shard_count = 1;
+    bool _sharded = false; // apply_shard was called
+    std::unordered_map<std::string, double> _shard_ns_per_iteration; // cost estimates by path
+
+    bool is_selected(const char* suite, const benchmark_impl& b, std::string& path) const
+    {
+        bool has_include = false, included = false;
+        for (auto& f : _filters)
+        {
+            if (f.exclude)
+            {
+                if (matches(f, suite, b, path)) return false;
+            }
+            else
+            {
+                has_include = true;
+                included = included || matches(f, suite, b, path);
+            }
+        }
+        return included || !has_include;
+    }
+
     bool _has_opts = false; // have opts been added to list
     std::vector<cmd_line_option> _opts;
 
+    // a sample in the run schedule
+    struct scheduled_sample
+    {
+        uint32_t benchmark; // index in the benchmarks of the run
+        uint32_t state; // index in the states of the benchmark
+    };
+
+    // generates the order in which samples are run
+    // at each step a random benchmark of the ones which have samples left is picked,
+    // and its next state is scheduled
+    // num_states has the number of states of each benchmark to schedule
+    // this is done up front, so no harness data other than the schedule (read sequentially)
+    // is touched between samples
+    template <typename Rnd>
+    static std::vector<scheduled_sample> make_schedule(const std::vector<uint32_t>& num_states, size_t total_samples, Rnd& rnd)
+    {
+        std::vector<scheduled_sample> schedule;
+        schedule.reserve(total_samples);
+
+        // benchmarks which have samples left
+        // finished ones are swapped with the last one and popped
+        std::vector<uint32_t> active;
+        active.reserve(num_states.size());
+        for (size_t i = 0; i < num_states.size(); ++i)
+        {
+            if (num_states[i]) active.push_back(uint32_t(i));
+        }
+
+        std::vector<uint32_t> next_state(num_states.size(), 0);
+        while (!active.empty())
+        {
+            auto i = rnd() % active.size();
+            auto bi = active[i];
+            schedule.push_back({bi, next_state[bi]++});
+            if (next_state[bi] == num_states[bi])
+            {
+                active[i] = active.back();
+                active.pop_back();
+            }
+        }
+
+        return schedule;
+    }
+
+    // benchmark completed in a previous run, loaded from a checkpoint
+    struct checkpoint_benchmark
+    {
+        size_t index; // order in the run
+        bool has_suite;
+        std::string suite;
+        std::string name;
+        size_t completed_at; // step of the schedule at which the benchmark was completed
+        std::vector<state> states;
+
+        bool matches(const char* s, const char* n) const
+        {
+            if (has_suite != !!s) return false;
+            if (s && suite != s) return false;
+            return name == n;
+        }
+    };
+
+    // checkpoint files are json lines
+    // the first one has the random seed
+    // the others have the states of a completed benchmark as
+    // [iterations, duration, result, {counters}, placement]
+    void write_checkpoint(std::ostream& out, size_t index, const char* suite, const benchmark_impl& b, size_t completed_at)
+    {
+        out << "{\"index\": " << index << ", \"suite\": ";
+        report::json_str(out, suite);
+        out << ", \"name\": ";
+        report::json_str(out, b.name());
+        out << ", \"completed_at\": " << completed_at << ", \"states\": [";
+        for (auto& st : b._states)
+        {
+            if (&st != &b._states.front()) out << ", ";
+            out << '[' << st.iterations() << ", " << st.duration_ns() << ", " << st.result() << ", {";
+            for (auto& c : st.counters())
+            {
+                if (&c != &st.counters().front()) out << ", ";
+                report::json_str(out, c.first);
+                out << ": ";
+                report::json_num(out, c.second);
+            }
+            out << "}, ";
+            report::json_str(out, st._placement);
+            out << ']';
+        }
+        out << "]}\n";
+        out.flush();
+    }
+
+    bool load_checkpoint(int& random_seed, std::vector<checkpoint_benchmark>& restored)
+    {
+        std::ifstream fin(_resume_file);
+        if (!fin.is_open())
+        {
+            *_stderr << "Error: Could not open checkpoint file `" << _resume_file << "`\n";
+            _error = error_checkpoint;
+            return false;
+        }
+
+        bool has_header = false;
+        std::string line, key;
+        while (std::getline(fin, line))
+        {
+            json_reader r(line.data(), line.data() + line.size());
+            if (!has_header)
+            {
+                r.begin_object();
+                while (r.next_key(key))
+                {
+                    if (key == "random_seed")
+                    {
+                        has_header = r.read_int(random_seed);
+                    }
+                    else r.skip_value();
+                }
+                if (!has_header) break;
+                continue;
+            }
+
+            checkpoint_benchmark cb;
+            cb.index = size_t(-1);
+            cb.completed_at = size_t(-1);
+            cb.has_suite = false;
+            r.begin_object();
+            while (r.next_key(key))
+            {
+                if (key == "index")
+                {
+                    int64_t i;
+                    if (r.read_int(i)) cb.index = size_t(i);
+                }
+                else if (key == "suite")
+                {
+                    cb.has_suite = !r.is_null();
+                    if (cb.has_suite) r.read_string(cb.suite);
+                    else r.read_null();
+                }
+                else if (key == "name") r.read_string(cb.name);
+                else if (key == "completed_at")
+                {
+                    int64_t i;
+                    if (r.read_int(i)) cb.completed_at = size_t(i);
+                }
+                else if (key == "states")
+                {
+                    r.begin_array();
+                    while (r.next_element())
+                    {
+                        int64_t iters = 0, duration = 0, result = 0;
+                        r.begin_array();
+                        r.next_element();
+                        r.read_int(iters);
+                        r.next_element();
+                        r.read_int(duration);
+                        r.next_element();
+                        r.read_int(result);
+
+                        if (iters <= 0) break;
+                        cb.states.emplace_back(iters);
+                        auto& st = cb.states.back();
+                        st.add_custom_duration(duration);
+                        st.set_result(uintptr_t(result));
+
+                        // counters and placement (not in checkpoints of older versions)
+                        if (r.next_element())
+                        {
+                            std::string str;
+                            r.begin_object();
+                            while (r.next_key(str))
+                            {
+                                double value = 0;
+                                r.read_double(value);
+                                st.set_counter(_checkpoint_strings.insert(str).first->c_str(), value);
+                            }
+
+                            if (r.next_element())
+                            {
+                                if (r.is_null()) r.read_null();
+                                else if (r.read_string(str)) st._placement = _checkpoint_strings.insert(str).first->c_str();
+                                while (r.next_element()) r.skip_value();
+                            }
+                        }
+                    }
+                }
+                else r.skip_value();
+            }
+
+            // an interrupted write may have left an incomplete last line
+            if (!r.ok() || cb.index == size_t(-1) || cb.states.empty()) break;
+
+            restored.push_back(std::move(cb));
+        }
+
+        if (!has_header)
+        {
+            *_stderr << "Error: Bad checkpoint file `" << _resume_file << "`\n";
+            _error = error_checkpoint;
+            return false;
+        }
+
+        return true;
+    }
+
+#if !defined(PICOBENCH_STD_FUNCTION_BENCHMARKS)
+    struct same_function_less
+    {
+        bool operator()(const benchmark_impl* a, const benchmark_impl* b) const
+        {
+            if (a->_proc != b->_proc) return std::less<benchmark_proc>()(a->_proc, b->_proc);
+            if (a->_user_data != b->_user_data) return a->_user_data < b->_user_data;
+            // the ones expanded from the same benchmark have the same param names
+            return a->_param_values < b->_param_values;
+        }
+    };
+
+    // warns for each pair of benchmarks in a suite which have the same function, user data and
+    // params
+    // in the order of registration
+    void warn_same_functions(const benchmarks_vector& bms) const
+    {
+        // benchmarks grouped by function
+        std::map<const benchmark_impl*, std::vector<const benchmark_impl*>, same_function_less> groups;
+        for (auto& b : bms)
+        {
+            groups[b.get()].push_back(b.get());
+        }
+
+        if (groups.size() == bms.size()) return; // nothing in common
+
+        // number of benchmarks of each group which were already visited
+        std::map<const benchmark_impl*, size_t, same_function_less> visited;
+        for (auto& b : bms)
+        {
+            auto& group = groups[b.get()];
+            auto i = ++visited[b.get()];
+            for (; i < group.size(); ++i)
+            {
+                *_stdwarn << "Warning: " << b->name() << " and " << group[i]->name()
+                         << " are benchmarks of the same function.\n";
+            }
+        }
+    }
+#endif
+
+    // the environment set with set_environment or the current one
+    environment_info::entries current_environment() const
+    {
+        return _has_given_environment ? _given_environment : environment_info::collect();
+    }
+
+    bool is_cold(const benchmark_impl& b) const
+    {
+        return cold_data(b) || cold_instructions(b);
+    }
+
+    template <typename CompareResult>
+    void fill_report_benchmark(report::benchmark& rb, const benchmark_impl& b, bool compare_samples, CompareResult& cmp) const
+    {
+        rb.name = b._name;
+        rb.is_baseline = b._baseline;
+        rb.is_cold = is_cold(b);
+        rb.has_param_dimensions = b._param_dimensions;
+
+        const std::vector<int64_t>& state_iterations =
+            b._state_iterations.empty() ?
+            _default_state_iterations :
+            b._state_iterations;
+
+        // dimension to index in rb.data
+        std::unordered_map<int64_t, size_t> slots;
+        rb.data.reserve(state_iterations.size());
+        for (auto d : state_iterations)
+        {
+            slots.emplace(d, rb.data.size());
+            rb.data.emplace_back();
+            rb.data.back().dimension = d;
+        }
+
+        std::vector<std::vector<int64_t>> sample_times(rb.data.size());
+        std::vector<std::vector<double>> pair_ratios(b._pair_baseline ? rb.data.size() : 0);
+
+        for (size_t istate = 0; istate < b._states.size(); ++istate)
+        {
+            auto& state = b._states[istate];
+            auto slot = slots.find(state.iterations());
+            if (slot == slots.end()) continue;
+
+            if (b._pair_baseline)
+            {
+                auto& pair = b._pair_baseline->_states[b._pair_base + istate];
+                // the pair may not have been run yet while reporting progress
+                if (pair.duration_ns() > 0)
+                {
+                    pair_ratios[slot->second].push_back(double(state.duration_ns()) / double(pair.duration_ns()));
+                }
+            }
+
+            auto i = slot->second;
+            auto& d = rb.data[i];
+            sample_times[i].push_back(state.duration_ns());
+
+            if (d.total_time_ns == 0 || d.total_time_ns > state.duration_ns())
+            {
+                d.total_time_ns = state.duration_ns();
+                d.result = state.result();
+                d.counters = state.counters();
+                d.placement = state.placement();
+            }
+
+            if (compare_samples)
+            {
+                if (d.result != state.result() && !cmp(d.result, state.result()))
+                {
+                    *_stderr << "Error: Two samples of " << b.name() << " @" << d.dimension << " produced different results: "
+                             << d.result << " and " << state.result() << '\n';
+                    _error = error_sample_compare;
+                }
+            }
+
+            ++d.samples;
+            if (istate < b._suspect.size() && b._suspect[istate]) ++d.suspect_samples;
+        }
+
+        for (size_t i = 0; i < rb.data.size(); ++i)
+        {
+            auto& d = rb.data[i];
+            auto first = slots[d.dimension];
+            if (first != i)
+            {
+                // the same dimension is listed more than once
+                d = rb.data[first];
+            }
+            else
+            {
+                report::calc_stats(d, sample_times[i]);
+                if (b._pair_baseline) report::calc_pair_stats(d, pair_ratios[i]);
+            }
+        }
+
+#if defined(PICOBENCH_DEBUG)
+        for (auto& d : rb.data)
+        {
+            // in paired runs the baseline also has the pairs of the other benchmarks
+            I_PICOBENCH_ASSERT(d.samples == b._samples || (_paired && b._baseline && d.samples > b._samples));
+        }
+#endif
+    }
+
     bool cmd_iters(const char* line)
     {
-        std::vector<int> iters;
+        std::vector<int64_t> iters;
         auto p = line;
         while (true)
         {
-            auto i = int(strtoul(p, nullptr, 10));
+            auto i = int64_t(strtoull(p, nullptr, 10));
             if (i <= 0) return false;
             iters.push_back(i);
             p = strchr(p + 1, ',');
@@ -1298,11 +5549,89 @@ private:
         return true;
     }
 
-    bool cmd_samples(const char* line)
+    bool cmd_samples(const char* line)
+    {
+        int samples = int(strtol(line, nullptr, 10));
+        if (samples <= 0) return false;
+        _default_samples = samples;
+        return true;
+    }
+
+    bool cmd_seed(const char* line)
+    {
+        char* end;
+        auto seed = strtol(line, &end, 10);
+        if (end == line || *end || seed < 0 || seed > INT_MAX) return false;
+        _seed = int(seed);
+        return true;
+    }
+
+    bool cmd_cold(const char* line)
+    {
+        if (*line) return false;
+        _cold_data = true;
+        return true;
+    }
+
+    bool cmd_cold_icache(const char* line)
+    {
+        if (*line) return false;
+        _cold_data = _cold_instructions = true;
+        return true;
+    }
+
+    bool cmd_probe(const char* line)
+    {
+        if (*line) return false;
+        _probe = true;
+        return true;
+    }
+
+    bool cmd_probe_threshold(const char* line)
+    {
+        char* end;
+        auto t = strtod(line, &end);
+        if (end == line || *end || !(t > 1)) return false;
+        _probe = true;
+        _probe_threshold = t;
+        return true;
+    }
+
+    bool cmd_probe_retries(const char* line)
+    {
+        char* end;
+        auto n = strtol(line, &end, 10);
+        if (end == line || *end || n < 0) return false;
+        _probe = true;
+        _probe_max_retries = int(n);
+        return true;
+    }
+
+    bool cmd_placement(const char* line)
+    {
+        if (!cpu_topology::valid_placement(line)) return false;
+        _placement = line;
+        return true;
+    }
+
+    bool cmd_strict(const char* line)
     {
-        int samples = int(strtol(line, nullptr, 10));
-        if (samples <= 0) return false;
-        _default_samples = samples;
+        if (*line) return false;
+        _strict = true;
+        return true;
+    }
+
+    bool cmd_machine_profile(const char* line)
+    {
+        if (*line) return false;
+        _profile_machine = true;
+        return true;
+    }
+
+    bool cmd_paired(const char* line)
+    {
+        if (*line) return false;
+        _paired = true;
         return true;
     }
 
@@ -1324,14 +5653,14 @@ private:
 
     bool cmd_run_only(const char* line)
     {
-        std::vector<picostring> names;
+        std::unordered_set<std::string> names;
 
         auto p = line;
         while (true)
         {
             const char* q = strchr(p, ',');
             if (!q) q = p + strlen(p);
-            names.emplace_back(p, int(q - p));
+            names.emplace(p, q - p);
             if (!*q) break;
             p = q + 1;
         }
@@ -1339,21 +5668,87 @@ private:
         for (auto& s : _suites)
         {
             auto new_end = std::remove_if(s.benchmarks.begin(), s.benchmarks.end(), [&names](const std::unique_ptr<benchmark_impl>& b) {
-                auto f = std::find(names.begin(), names.end(), b->name());
-                return f == names.end();
+                return names.find(b->name()) == names.end();
             });
             s.benchmarks.erase(new_end, s.benchmarks.end());
         }
         return true;
     }
 
+    bool cmd_filter(const char* line)
+    {
+        return add_filters(line, false);
+    }
+
+    bool cmd_exclude(const char* line)
+    {
+        return add_filters(line, true);
+    }
+
+    // comma separated list of patterns
+    // a regex pattern extends to the end of the list, so that it can have commas (like x{1,3})
+    bool add_filters(const char* line, bool exclude)
+    {
+        std::string pattern;
+        auto p = line;
+        while (true)
+        {
+            const char* q = strncmp(p, "re:", 3) == 0 ? nullptr : strchr(p, ',');
+            if (!q) q = p + strlen(p);
+            pattern.assign(p, q);
+            if (!add_filter(pattern.c_str(), exclude)) return false;
+            if (!*q) break;
+            p = q + 1;
+        }
+        return true;
+    }
+
+    bool cmd_shard(const char* line)
+    {
+        char* end;
+        auto index = strtol(line, &end, 10);
+        if (end == line || *end != '/') return false;
+        auto p = end + 1;
+        auto count = strtol(p, &end, 10);
+        if (end == p || *end || count <= 0 || index < 0 || index >= count) return false;
+        set_shard(int(index), int(count));
+        return true;
+    }
+
+    bool cmd_shard_costs(const char* line)
+    {
+        std::ifstream fin(line);
+        report rpt;
+        if (!fin.is_open() || !rpt.from_json(fin)) return false;
+        set_shard_cost_estimates(rpt);
+        return true;
+    }
+
     bool cmd_list(const char* line)
     {
         if (*line) return false;
+        // listed after all arguments are parsed, so that filters are applied
+        _list = true;
         _should_run = false;
+        return true;
+    }
+
+    bool cmd_worker(const char* line)
+    {
+        if (*line) return false;
+        _worker = true;
+        return true;
+    }
+
+    void list_benchmarks() const
+    {
         for (auto& suite : _suites)
         {
-            if (suite.name)
+            if (suite.group)
+            {
+                *_stdout << "  " << suite.group << '/' << (suite.name ? suite.name : "<Default suite>") << ":\n";
+            }
+            else if (suite.name)
             {
                 *_stdout << "  " << suite.name << ":\n";
             }
@@ -1363,11 +5758,16 @@ private:
             }
             for (auto& bench : suite.benchmarks)
             {
-                *_stdout << "    " << bench->name() << "\n";
+                *_stdout << "    " << bench->name();
+                auto& tags = bench->_tags;
+                for (size_t i = 0; i < tags.size(); ++i)
+                {
+                    *_stdout << (i == 0 ? " [" : ", ") << tags[i];
+                }
+                if (!tags.empty()) *_stdout << ']';
+                *_stdout << "\n";
             }
         }
-        _should_run = false;
-        return true;
     }
 
     bool cmd_version(const char* line)
@@ -1383,10 +5783,18 @@ private:
         if (*line) return false;
         cmd_version(line);
         auto& cout = *_stdout;
+
+        // align descriptions to the longest option
+        int col = 27;
+        for (auto& opt : _opts)
+        {
+            col = std::max(col, _cmd_prefix.len + opt.cmd.len + opt.arg_desc.len + 1);
+        }
+
         for (auto& opt : _opts)
         {
             cout << ' ' << _cmd_prefix.str << opt.cmd.str << opt.arg_desc.str;
-            int w = 27 - (_cmd_prefix.len + opt.cmd.len + opt.arg_desc.len);
+            int w = col - (_cmd_prefix.len + opt.cmd.len + opt.arg_desc.len);
             for (int i = 0; i < w; ++i)
             {
                 cout.put(' ');
@@ -1411,6 +5819,14 @@ private:
         {
             _output_format = report_output_format::csv;
         }
+        else if (strcmp(line, "json") == 0)
+        {
+            _output_format = report_output_format::json;
+        }
+        else if (strcmp(line, "jsonl") == 0)
+        {
+            _output_format = report_output_format::jsonl;
+        }
         else
         {
             return false;
@@ -1438,6 +5854,43 @@ private:
         _compare_results_across_benchmarks = true;
         return true;
     }
+
+    bool cmd_progress(const char* line)
+    {
+        if (*line) return false;
+        _show_progress = true;
+        return true;
+    }
+
+    bool cmd_checkpoint(const char* line)
+    {
+        if (!*line) return false;
+        _checkpoint_file = line;
+        return true;
+    }
+
+    bool cmd_resume(const char* line)
+    {
+        if (!*line) return false;
+        _resume_file = line;
+        return true;
+    }
+
+    bool cmd_compare_to(const char* line)
+    {
+        if (!*line) return false;
+        _compare_to = line;
+        return true;
+    }
+
+    bool cmd_regression_threshold(const char* line)
+    {
+        char* end;
+        double t = strtod(line, &end);
+        if (end == line || *end || t < 0) return false;
+        _regression_threshold = t / 100;
+        return true;
+    }
 };
 
 class local_runner : public runner
@@ -1447,6 +5900,230 @@ public:
     {}
 };
 
+// a small suite which characterizes the machine
+// memory latencies and bandwidths are measured as benchmarks of a local runner
+class machine_profiler
+{
+public:
+    machine_profiler()
+    {
+        auto caches = cache_evictor::cache_sizes();
+        if (caches.empty())
+        {
+            // typical sizes when they're unknown
+            caches = { 32 * 1024, 1024 * 1024, 32 * 1024 * 1024 };
+        }
+
+        // chase in half of each cache, so that it fits with whatever else is there
+        for (auto size : caches)
+        {
+            _chases.emplace_back(new chase_buffer(size / 2));
+        }
+
+        // memory is at least four times bigger than the last level cache
+        // (capped to keep the allocations reasonable on machines with huge caches)
+        auto mem_size = std::max(caches.back() * 4, size_t(64 * 1024 * 1024));
+        mem_size = std::min(mem_size, size_t(256 * 1024 * 1024));
+        _chases.emplace_back(new chase_buffer(mem_size));
+        _stream.resize(mem_size / sizeof(uint64_t), 1);
+    }
+
+    std::vector<report::machine_metric> run()
+    {
+        std::vector<report::machine_metric> ret;
+        measure_timer(ret);
+
+        local_runner r;
+        r.set_default_samples(3);
+        r.set_default_state_iterations({ chase_steps });
+        r.set_default_random_seed(1);
+
+        for (auto& c : _chases)
+        {
+            r.add_benchmark("chase", chase).user_data(uintptr_t(c.get()));
+        }
+
+        auto lines = int(_stream.size() / 8);
+        r.add_benchmark("read", stream_read).user_data(uintptr_t(this)).iterations({ lines });
+        r.add_benchmark("write", stream_write).user_data(uintptr_t(this)).iterations({ lines });
+        r.add_benchmark("int", int_ops).iterations({ int_iterations });
+
+        r.run_benchmarks();
+        auto rpt = r.generate_report();
+        auto& bms = rpt.suites.front().benchmarks;
+
+        static const char* const latency_names[] = {
+            "latency_l1_ns", "latency_l2_ns", "latency_l3_ns", "latency_l4_ns"
+        };
+        for (size_t i = 0; i < _chases.size(); ++i)
+        {
+            const char* name = i == _chases.size() - 1 ? "latency_dram_ns"
+                : i < 4 ? latency_names[i] : nullptr;
+            if (name) add_metric(ret, name, bms[i], 1);
+        }
+
+        auto& read = bms[_chases.size()];
+        auto& write = bms[_chases.size() + 1];
+        auto& ints = bms[_chases.size() + 2];
+        // bytes per nanosecond are gigabytes per second
+        add_metric(ret, "read_bandwidth_gbs", read, 64, true);
+        add_metric(ret, "write_bandwidth_gbs", write, 64, true);
+        add_metric(ret, "int_ops_per_ns", ints, int_ops_per_iteration, true);
+
+        return ret;
+    }
+
+private:
+    static const int chase_steps = 1 << 20;
+    static const int int_iterations = 1 << 22;
+    static const int int_ops_per_iteration = 16;
+
+    // a random cycle through the cache lines of a buffer
+    // the random order defeats prefetching, so each step is a full memory latency
+    struct chase_buffer
+    {
+        explicit chase_buffer(size_t size)
+        {
+            auto num_lines = std::max(size / 64, size_t(2));
+            data.resize(num_lines * 8); // a line is 8 pointer-sized elements
+
+            std::vector<size_t> order(num_lines);
+            for (size_t i = 0; i < num_lines; ++i) order[i] = i;
+
+            std::minstd_rand rnd(1);
+            for (size_t i = num_lines - 1; i > 0; --i)
+            {
+                std::uniform_int_distribution<size_t> dist(0, i);
+                std::swap(order[i], order[dist(rnd)]);
+            }
+
+            for (size_t i = 0; i < num_lines; ++i)
+            {
+                data[order[i] * 8] = order[(i + 1) % num_lines] * 8;
+            }
+        }
+
+        std::vector<size_t> data;
+        size_t pos = 0;
+    };
+
+    static void chase(state& s)
+    {
+        auto& c = *reinterpret_cast<chase_buffer*>(s.user_data());
+        auto data = c.data.data();
+        auto pos = c.pos;
+        s.start_timer();
+        for (int i = 0; i < s.iterations(); ++i)
+        {
+            pos = data[pos];
+        }
+        s.stop_timer();
+        c.pos = pos;
+        s.set_result(result_t(pos));
+    }
+
+    // a cache line (8 elements) per iteration
+    static void stream_read(state& s)
+    {
+        auto& p = *reinterpret_cast<machine_profiler*>(s.user_data());
+        auto data = p._stream.data();
+        uint64_t sum = 0;
+        s.start_timer();
+        for (size_t i = 0; i < size_t(s.iterations()) * 8; ++i)
+        {
+            sum += data[i];
+        }
+        s.stop_timer();
+        s.set_result(result_t(sum));
+    }
+
+    static void stream_write(state& s)
+    {
+        auto& p = *reinterpret_cast<machine_profiler*>(s.user_data());
+        auto data = p._stream.data();
+        s.start_timer();
+        for (size_t i = 0; i < size_t(s.iterations()) * 8; ++i)
+        {
+            data[i] = i;
+        }
+        s.stop_timer();
+        s.set_result(result_t(data[s.iterations() / 2]));
+    }
+
+    // eight independent chains of two dependent operations which can't be vectorized
+    static void int_ops(state& s)
+    {
+        uint64_t x[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+        s.start_timer();
+        for (int i = 0; i < s.iterations(); ++i)
+        {
+            auto u = uint64_t(i);
+            x[0] = (x[0] ^ u) + 1;
+            x[1] = (x[1] + u) ^ 3;
+            x[2] = (x[2] ^ u) + 5;
+            x[3] = (x[3] + u) ^ 7;
+            x[4] = (x[4] ^ u) + 11;
+            x[5] = (x[5] + u) ^ 13;
+            x[6] = (x[6] ^ u) + 17;
+            x[7] = (x[7] + u) ^ 19;
+        }
+        s.stop_timer();
+        s.set_result(result_t(x[0] + x[1] + x[2] + x[3] + x[4] + x[5] + x[6] + x[7]));
+    }
+
+    // the time per operation (or operations per time if per_ns) of the fastest sample
+    static void add_metric(std::vector<report::machine_metric>& metrics, const char* name,
+        const report::benchmark& bm, int ops_per_iteration, bool per_ns = false)
+    {
+        auto& d = bm.data.front();
+        if (d.total_time_ns <= 0) return; // too fast for the timer
+        auto ops = double(d.dimension) * ops_per_iteration;
+        auto ns = double(d.total_time_ns);
+        metrics.push_back({ name, per_ns ? ops / ns : ns / ops });
+    }
+
+    static void measure_timer(std::vector<report::machine_metric>& metrics)
+    {
+        // the smallest non-zero difference between two readings
+        int64_t resolution = 0;
+        for (int i = 0; i < 100; ++i)
+        {
+            auto start = high_res_clock::now();
+            for (int j = 0; j < 100000; ++j)
+            {
+                auto d = high_res_clock::now() - start;
+                if (d.count() == 0) continue;
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+                if (!resolution || ns < resolution) resolution = ns;
+                break;
+            }
+        }
+
+        const int reads = 100000;
+        int64_t sink = 0;
+        auto start = high_res_clock::now();
+        for (int i = 0; i < reads; ++i)
+        {
+            sink += high_res_clock::now().time_since_epoch().count();
+        }
+        auto cost = std::chrono::duration_cast<std::chrono::nanoseconds>(high_res_clock::now() - start).count();
+        volatile int64_t vsink = sink;
+        (void)vsink;
+
+        metrics.push_back({ "timer_resolution_ns", double(resolution) });
+        metrics.push_back({ "timer_cost_ns", double(cost) / reads });
+    }
+
+    std::vector<std::unique_ptr<chase_buffer>> _chases;
+    std::vector<uint64_t> _stream;
+};
+
+std::vector<report::machine_metric> measure_machine_profile()
+{
+    machine_profiler profiler;
+    return profiler.run();
+}
+
 // } // anonymous namespace
 
 benchmark::benchmark(const char* name, benchmark_proc proc)
@@ -1454,6 +6131,224 @@ benchmark::benchmark(const char* name, benchmark_proc proc)
     , _proc(proc)
 {}
 
+int64_t latency_histogram::percentile(double p) const
+{
+    if (_count == 0) return 0;
+    auto rank = int64_t(std::ceil(double(_count) * p / 100));
+    if (rank < 1) rank = 1;
+
+    int64_t seen = 0;
+    for (size_t i = 0; i < _buckets.size(); ++i)
+    {
+        seen += _buckets[i];
+        if (seen < rank) continue;
+
+        if (i < (size_t(1) << sub_bits)) return int64_t(i);
+        auto block = i >> sub_bits;
+        auto sub = i & ((size_t(1) << sub_bits) - 1);
+        auto upper = (int64_t((size_t(1) << sub_bits) + sub + 1) << (block - 1)) - 1;
+        return std::min(upper, _max);
+    }
+    return _max;
+}
+
+void make_open_loop_schedule(std::vector<int64_t>& schedule, int64_t operations, arrivals arr, uint32_t seed)
+{
+    const double second_ns = 1e9;
+    schedule.resize(size_t(operations));
+    if (arr == arrivals::constant)
+    {
+        for (int64_t i = 0; i < operations; ++i)
+        {
+            schedule[size_t(i)] = int64_t(second_ns * double(i) / double(operations));
+        }
+        return;
+    }
+
+    // a Poisson process with a given number of arrivals in an interval has them at uniformly
+    // distributed times, so the achieved rate can be compared to the target one exactly
+    // each sample has different times, but they're the same in every run with the same seed
+    std::minstd_rand rnd(seed);
+    std::uniform_real_distribution<double> dist(0, second_ns);
+    for (auto& t : schedule)
+    {
+        t = int64_t(dist(rnd));
+    }
+    std::sort(schedule.begin(), schedule.end());
+    schedule.front() = 0; // the sample starts with the first operation
+}
+
+void open_loop_wait(high_res_clock::time_point t)
+{
+#if defined(PICOBENCH_TEST)
+    auto now = high_res_clock::now();
+    if (now < t) test::this_thread_sleep_for_ns(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(t - now).count()));
+#else
+    // sleep until shortly before the time and spin for the rest, so that the operation starts
+    // on time
+    const auto spin = std::chrono::microseconds(200);
+    auto now = high_res_clock::now();
+    if (t - now > spin * 2) std::this_thread::sleep_for(t - now - spin);
+    while (high_res_clock::now() < t) {}
+#endif
+}
+
+void state::set_open_loop_counters()
+{
+    set_counter("achieved_rate", _duration_ns > 0 ? _iterations * 1e9 / double(_duration_ns) : 0);
+    set_counter("lat_p50_ns", double(_latencies.percentile(50)));
+    set_counter("lat_p90_ns", double(_latencies.percentile(90)));
+    set_counter("lat_p99_ns", double(_latencies.percentile(99)));
+    set_counter("lat_p999_ns", double(_latencies.percentile(99.9)));
+    set_counter("lat_max_ns", double(_latencies.max()));
+}
+
+void roles::run()
+{
+    // the names of the counters of the roles and the placements outlive the runner
+    static std::unordered_set<std::string> strings;
+    auto counter_name = [](const char* role, const char* name) {
+        return strings.insert(std::string(role) + '_' + name).first->c_str();
+    };
+
+    struct worker
+    {
+        role* r;
+        state st;
+        int64_t ns; // from the start until its function returns
+    };
+
+    std::atomic<bool> stop(false);
+    std::atomic<bool> go(false);
+    std::atomic<int> waiting(0);
+    std::atomic<int> working(0); // threads of roles which don't run until stopped
+
+    std::vector<worker> workers;
+    for (auto r : _roles)
+    {
+        for (int i = 0; i < r->threads; ++i)
+        {
+            workers.push_back({ r, state(_state.iterations(), _state.user_data()), 0 });
+            workers.back().st._params = _state._params;
+            workers.back().st._seed = state::derive_seed(_state._seed, workers.size());
+            workers.back().st._stop = &stop;
+            if (!r->until_stopped) ++working;
+        }
+    }
+
+    // the cpus of the threads
+    std::vector<int> cpus;
+    std::string placement;
+    std::atomic<bool> placed(true);
+    if (_placement)
+    {
+        placement = _placement;
+        if (!cpu_topology::get().place(_placement, workers.size(), cpus)) placed = false;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers.size());
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        threads.emplace_back([&, i]() {
+            auto& w = workers[i];
+            if (!cpus.empty() && !cpu_topology::set_thread_cpu(cpus[i])) placed = false;
+
+            // the start barrier
+            ++waiting;
+            while (!go.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+
+            auto start = high_res_clock::now();
+            w.r->call(w.st);
+            w.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(high_res_clock::now() - start).count();
+
+            if (!w.r->until_stopped && --working == 0) stop = true;
+        });
+    }
+
+    while (waiting.load() != int(workers.size()))
+    {
+        std::this_thread::yield();
+    }
+    auto start = high_res_clock::now();
+    if (working.load() == 0) stop = true;
+    go.store(true, std::memory_order_release);
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    auto makespan = std::chrono::duration_cast<std::chrono::nanoseconds>(high_res_clock::now() - start).count();
+    _state.add_custom_duration(makespan);
+
+    result_t result = 0;
+    for (auto r : _roles)
+    {
+        int64_t ops = 0;
+        double ns_per_op = 0;
+        int measured = 0;
+        std::vector<std::pair<const char*, double>> sums;
+        for (auto& w : workers)
+        {
+            if (w.r != r) continue;
+            result += w.st.result();
+
+            auto n = w.st.operations();
+            ops += n;
+            if (n > 0)
+            {
+                // the time of the loop of the state if it has one
+                auto ns = w.st.duration_ns() > 0 ? w.st.duration_ns() : w.ns;
+                ns_per_op += double(ns) / double(n);
+                ++measured;
+            }
+
+            for (auto& c : w.st.counters())
+            {
+                auto f = std::find_if(sums.begin(), sums.end(), [&c](const std::pair<const char*, double>& sum) {
+                    return strcmp(sum.first, c.first) == 0;
+                });
+                if (f == sums.end()) sums.push_back(c);
+                else f->second += c.second;
+            }
+        }
+
+        _state.set_counter(counter_name(r->name, "ops_per_sec"), makespan > 0 ? double(ops) * 1e9 / double(makespan) : 0);
+        _state.set_counter(counter_name(r->name, "ns_per_op"), measured ? ns_per_op / measured : 0);
+        for (auto& sum : sums)
+        {
+            _state.set_counter(counter_name(r->name, sum.first), sum.second);
+        }
+    }
+    _state.set_result(result);
+
+    if (_placement)
+    {
+        if (placed)
+        {
+            placement += ':';
+            for (auto r : _roles)
+            {
+                std::vector<int> role_cpus;
+                for (size_t i = 0; i < workers.size(); ++i)
+                {
+                    if (workers[i].r == r) role_cpus.push_back(cpus[i]);
+                }
+                if (role_cpus.empty()) continue;
+                placement += std::string(" ") + r->name + ' ' + cpu_topology::cpu_list_to_string(role_cpus) + ';';
+            }
+            placement.pop_back();
+        }
+        else
+        {
+            placement += " (not applied)";
+        }
+        _state._placement = strings.insert(placement).first->c_str();
+    }
+}
+
 benchmark& global_registry::new_benchmark(const char* name, benchmark_proc proc)
 {
     return g_registry().add_benchmark(name, proc);
@@ -1469,6 +6364,18 @@ int global_registry::set_bench_suite(const char* name)
 
 #endif
 
+#if defined(PICOBENCH_IMPLEMENT_PLUGIN)
+extern "C" I_PICOBENCH_EXPORT uint64_t picobench_plugin_abi()
+{
+    return PICOBENCH_NAMESPACE::plugin_abi();
+}
+
+extern "C" I_PICOBENCH_EXPORT PICOBENCH_NAMESPACE::registry* picobench_plugin_registry()
+{
+    return &PICOBENCH_NAMESPACE::g_registry();
+}
+#endif
+
 #if defined(PICOBENCH_IMPLEMENT_MAIN)
 int main(int argc, char* argv[])
 {
@@ -1496,9 +6403,10 @@ void this_thread_sleep_for(const std::chrono::duration<Rep, Period>& duration)
 }
 
 #if defined(PICOBENCH_IMPLEMENT)
+// atomic for the threads of roles
 static struct fake_time
 {
-    uint64_t now;
+    std::atomic<uint64_t> now;
 } the_time;
 
 void this_thread_sleep_for_ns(uint64_t ns)
@@ -1510,7 +6418,7 @@ void this_thread_sleep_for_ns(uint64_t ns)
 
 high_res_clock::time_point high_res_clock::now()
 {
-    auto ret = time_point(duration(test::the_time.now));
+    auto ret = time_point(duration(rep(test::the_time.now.load())));
     return ret;
 #endif
 } // dual purpose closing brace
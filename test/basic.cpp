@@ -7,6 +7,10 @@
 
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
 
 using namespace picobench;
 using namespace std;
@@ -157,9 +161,32 @@ TEST_CASE("[picobench] state")
         test::this_thread_sleep_for_ns(2);
     }
     CHECK(s.duration_ns() == 4);
+
+    // batched
+    CHECK(state::unroll_calls(1) == 1);
+    CHECK(state::unroll_calls(31) == 1);
+    CHECK(state::unroll_calls(32) == 4);
+    CHECK(state::unroll_calls(200) == 16);
+    CHECK(state::unroll_calls(511) == 16);
+    CHECK(state::unroll_calls(512) == 64);
+    for (int n : { 1, 15, 16, 100, 1000 })
+    {
+        state sb(n);
+        i = 0;
+        sb.run([&]() {
+            ++i;
+            test::this_thread_sleep_for_ns(3);
+        });
+        CHECK(i == n);
+        CHECK(sb.duration_ns() == n * 3);
+
+        i = 0;
+        sb.run<3>([&]() { ++i; });
+        CHECK(i == n);
+    }
 }
 
-const vector<int> default_iters = { 8, 64, 512, 4096, 8192 };
+const vector<int64_t> default_iters = { 8, 64, 512, 4096, 8192 };
 const int default_samples = 2;
 
 TEST_CASE("[picobench] cmd line")
@@ -199,13 +226,38 @@ TEST_CASE("[picobench] cmd line")
         CHECK(!r.should_run());
         CHECK(r.error() == 0);
         CHECK(r.default_samples() == 54);
-        CHECK(r.default_state_iterations() == vector<int>({ 1, 2, 3 }));
+        CHECK(r.default_state_iterations() == vector<int64_t>({ 1, 2, 3 }));
         CHECK(!r.preferred_output_filename());
         CHECK(r.preferred_output_format() == report_output_format::concise_text);
         CHECK(!r.compare_results_across_benchmarks());
         CHECK(!r.compare_results_across_samples());
     }
 
+    {
+        // more than 32 bits
+        local_runner r;
+        const char* cmd_line[] = { "", "--no-run", "--iters=5000000000" };
+        CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(r.default_state_iterations() == vector<int64_t>({ 5000000000ll }));
+
+    }
+
+    {
+        // vectors of int still work
+        local_runner r;
+        const vector<int> int_iters = { 3, 4 };
+        r.set_default_state_iterations(int_iters);
+        CHECK(r.default_state_iterations() == vector<int64_t>({ 3, 4 }));
+        r.add_benchmark("int iters", [](state& s) { s.add_custom_duration(s.iterations()); })
+            .iterations(vector<int>({ 5, 6 }));
+        r.run_benchmarks(1);
+        auto rpt = r.generate_report();
+        auto& data = rpt.suites[0].benchmarks[0].data;
+        REQUIRE(data.size() == 2);
+        CHECK(data[0].dimension == 5);
+        CHECK(data[1].dimension == 6);
+    }
+
     {
         local_runner r;
         const char* cmd_line[] = { "", "--pb-no-run", "--pb-iters=1000,2000,3000", "-other-cmd1", "--pb-samples=54",
@@ -215,7 +267,7 @@ TEST_CASE("[picobench] cmd line")
         CHECK(!r.should_run());
         CHECK(r.error() == 0);
         CHECK(r.default_samples() == 54);
-        CHECK(r.default_state_iterations() == vector<int>({ 1000, 2000, 3000 }));
+        CHECK(r.default_state_iterations() == vector<int64_t>({ 1000, 2000, 3000 }));
         CHECK(strcmp(r.preferred_output_filename(), "foo.csv") == 0);
         CHECK(r.preferred_output_format() == report_output_format::csv);
         CHECK(r.compare_results_across_benchmarks());
@@ -283,17 +335,37 @@ TEST_CASE("[picobench] cmd line")
     }
 
 #define PB_HELP \
-        " --pb-iters=<n1,n2,n3,...>  Sets default iterations for benchmarks\n" \
-        " --pb-samples=<n>           Sets default number of samples for benchmarks\n" \
-        " --pb-out-fmt=<txt|con|csv> Outputs text or concise or csv\n" \
-        " --pb-output=<filename>     Sets output filename or `stdout`\n" \
-        " --pb-compare-results       Compare benchmark results\n" \
-        " --pb-no-run                Doesn't run benchmarks\n" \
-        " --pb-run-suite=<suite>     Runs only benchmarks from suite\n" \
-        " --pb-run-only=<b1,b2,...>  Runs only selected benchmarks\n" \
-        " --pb-list                  Lists available benchmarks\n" \
-        " --pb-version               Show version info\n" \
-        " --pb-help                  Prints help\n"
+        " --pb-iters=<n1,n2,n3,...>             Sets default iterations for benchmarks\n" \
+        " --pb-samples=<n>                      Sets default number of samples for benchmarks\n" \
+        " --pb-seed=<n>                         Sets the seed for the order of samples\n" \
+        " --pb-paired                           Runs each sample next to a baseline sample\n" \
+        " --pb-cold-icache                      Evicts data and instruction caches before each sample\n" \
+        " --pb-cold                             Evicts data caches before each sample\n" \
+        " --pb-probe-threshold=<x>              Sets the slowdown of a disturbed probe (default 1.5)\n" \
+        " --pb-probe-retries=<n>                Sets the reruns of suspect samples (default 2)\n" \
+        " --pb-probe                            Detects interference with a probe between samples\n" \
+        " --pb-strict                           Refuses to run in a noisy environment\n" \
+        " --pb-placement=<policy|cpus>          Places the threads of roles: compact, scatter, smt, l3, node or a cpu list\n" \
+        " --pb-machine-profile                  Measures the machine and adds its profile to the report\n" \
+        " --pb-out-fmt=<txt|con|csv|json|jsonl> Outputs text or concise or csv or json or json lines\n" \
+        " --pb-output=<filename>                Sets output filename or `stdout`\n" \
+        " --pb-progress                         Shows progress while running\n" \
+        " --pb-checkpoint=<filename>            Saves completed benchmarks to a file\n" \
+        " --pb-resume=<filename>                Skips benchmarks completed in a checkpoint\n" \
+        " --pb-compare-results                  Compare benchmark results\n" \
+        " --pb-compare-to=<filename>            Compares times to a json report\n" \
+        " --pb-regression-threshold=<%>         Sets slowdown which is an error (default 5)\n" \
+        " --pb-no-run                           Doesn't run benchmarks\n" \
+        " --pb-run-suite=<suite>                Runs only benchmarks from suite\n" \
+        " --pb-run-only=<b1,b2,...>             Runs only selected benchmarks\n" \
+        " --pb-filter=<p1,p2,...>               Runs only benchmarks matching a pattern\n" \
+        " --pb-exclude=<p1,p2,...>              Doesn't run benchmarks matching a pattern\n" \
+        " --pb-shard=<i/n>                      Runs only shard i of n (0 <= i < n)\n" \
+        " --pb-shard-costs=<filename>           Estimates costs for -shard from a json report\n" \
+        " --pb-list                             Lists selected benchmarks\n" \
+        " --pb-worker                           Runs samples on request from another process\n" \
+        " --pb-version                          Show version info\n" \
+        " --pb-help                             Prints help\n"
 
     {
         const char* help =
@@ -315,8 +387,8 @@ TEST_CASE("[picobench] cmd line")
     {
         const char* help =
             PB_VERSION_INFO
-            " --pb-cmd-hi                Custom help\n"
-            " --pb-cmd-bi=123            More custom help\n"
+            " --pb-cmd-hi                           Custom help\n"
+            " --pb-cmd-bi=123                       More custom help\n"
             PB_HELP;
 
         local_runner r;
@@ -491,16 +563,16 @@ TEST_CASE("[picobench] test")
         "\n"
         " Name (* = baseline)      |  ns/op  | Baseline |  Ops/second\n"
         "--------------------------|--------:|---------:|-----------:\n"
-        " a_a *                    |      10 |        - | 100000000.0\n"
-        " a_b                      |      11 |    1.100 |  90909090.9\n"
-        " a_c                      |      20 |    2.000 |  50000000.0\n"
+        " a_a *                    |  10.000 |        - | 100000000.0\n"
+        " a_b                      |  11.000 |    1.100 |  90909090.9\n"
+        " a_c                      |  20.000 |    2.000 |  50000000.0\n"
         "\n"
         "## test b:\n"
         "\n"
         " Name (* = baseline)      |  ns/op  | Baseline |  Ops/second\n"
         "--------------------------|--------:|---------:|-----------:\n"
-        " b_a                      |      75 |    0.750 |  13333333.3\n"
-        " something else *         |     100 |        - |  10000000.0\n"
+        " b_a                      |  75.000 |    0.750 |  13333333.3\n"
+        " something else *         | 100.000 |        - |  10000000.0\n"
         "\n";
 
     CHECK(sout.str() == concise);
@@ -510,32 +582,32 @@ TEST_CASE("[picobench] test")
         "\n"
         " Name (* = baseline)      |   Dim   |  Total ms |  ns/op  |Baseline| Ops/second\n"
         "--------------------------|--------:|----------:|--------:|-------:|----------:\n"
-        " a_a *                    |       8 |     0.000 |      10 |      - |100000000.0\n"
-        " a_b                      |       8 |     0.000 |      11 |  1.100 | 90909090.9\n"
-        " a_c                      |       8 |     0.000 |      20 |  2.000 | 50000000.0\n"
-        " a_a *                    |      64 |     0.001 |      10 |      - |100000000.0\n"
-        " a_b                      |      64 |     0.001 |      11 |  1.100 | 90909090.9\n"
-        " a_c                      |      64 |     0.001 |      20 |  2.000 | 50000000.0\n"
-        " a_a *                    |     512 |     0.005 |      10 |      - |100000000.0\n"
-        " a_b                      |     512 |     0.006 |      11 |  1.100 | 90909090.9\n"
-        " a_c                      |     512 |     0.010 |      20 |  2.000 | 50000000.0\n"
-        " a_a *                    |    4096 |     0.041 |      10 |      - |100000000.0\n"
-        " a_b                      |    4096 |     0.045 |      11 |  1.100 | 90909090.9\n"
-        " a_c                      |    4096 |     0.082 |      20 |  2.000 | 50000000.0\n"
-        " a_a *                    |    8192 |     0.082 |      10 |      - |100000000.0\n"
-        " a_b                      |    8192 |     0.090 |      11 |  1.100 | 90909090.9\n"
-        " a_c                      |    8192 |     0.164 |      20 |  2.000 | 50000000.0\n"
+        " a_a *                    |       8 |     0.000 |  10.000 |      - |100000000.0\n"
+        " a_b                      |       8 |     0.000 |  11.000 |  1.100 | 90909090.9\n"
+        " a_c                      |       8 |     0.000 |  20.000 |  2.000 | 50000000.0\n"
+        " a_a *                    |      64 |     0.001 |  10.000 |      - |100000000.0\n"
+        " a_b                      |      64 |     0.001 |  11.000 |  1.100 | 90909090.9\n"
+        " a_c                      |      64 |     0.001 |  20.000 |  2.000 | 50000000.0\n"
+        " a_a *                    |     512 |     0.005 |  10.000 |      - |100000000.0\n"
+        " a_b                      |     512 |     0.006 |  11.000 |  1.100 | 90909090.9\n"
+        " a_c                      |     512 |     0.010 |  20.000 |  2.000 | 50000000.0\n"
+        " a_a *                    |    4096 |     0.041 |  10.000 |      - |100000000.0\n"
+        " a_b                      |    4096 |     0.045 |  11.000 |  1.100 | 90909090.9\n"
+        " a_c                      |    4096 |     0.082 |  20.000 |  2.000 | 50000000.0\n"
+        " a_a *                    |    8192 |     0.082 |  10.000 |      - |100000000.0\n"
+        " a_b                      |    8192 |     0.090 |  11.000 |  1.100 | 90909090.9\n"
+        " a_c                      |    8192 |     0.164 |  20.000 |  2.000 | 50000000.0\n"
         "\n"
         "## test b:\n"
         "\n"
         " Name (* = baseline)      |   Dim   |  Total ms |  ns/op  |Baseline| Ops/second\n"
         "--------------------------|--------:|----------:|--------:|-------:|----------:\n"
-        " something else *         |      10 |     0.001 |     100 |      - | 10000000.0\n"
-        " b_a                      |      20 |     0.002 |      75 |  0.750 | 13333333.3\n"
-        " something else *         |      20 |     0.002 |     100 |      - | 10000000.0\n"
-        " b_a                      |      30 |     0.002 |      75 |  0.750 | 13333333.3\n"
-        " something else *         |      30 |     0.003 |     100 |      - | 10000000.0\n"
-        " b_a                      |      50 |     0.004 |      75 |    ??? | 13333333.3\n"
+        " something else *         |      10 |     0.001 | 100.000 |      - | 10000000.0\n"
+        " b_a                      |      20 |     0.002 |  75.000 |  0.750 | 13333333.3\n"
+        " something else *         |      20 |     0.002 | 100.000 |      - | 10000000.0\n"
+        " b_a                      |      30 |     0.002 |  75.000 |  0.750 | 13333333.3\n"
+        " something else *         |      30 |     0.003 | 100.000 |      - | 10000000.0\n"
+        " b_a                      |      50 |     0.004 |  75.000 |    ??? | 13333333.3\n"
         "\n";
 
     sout.str(string());
@@ -544,27 +616,27 @@ TEST_CASE("[picobench] test")
 
     const char* csv =
         "Suite,Benchmark,b,D,S,\"Total ns\",Result,\"ns/op\",Baseline\n"
-        "\"test a\",\"a_a\",*,8,2,80,16,10,1.000\n"
-        "\"test a\",\"a_a\",*,64,2,640,128,10,1.000\n"
-        "\"test a\",\"a_a\",*,512,2,5120,1024,10,1.000\n"
-        "\"test a\",\"a_a\",*,4096,2,40960,8192,10,1.000\n"
-        "\"test a\",\"a_a\",*,8192,2,81920,16384,10,1.000\n"
-        "\"test a\",\"a_b\",,8,2,88,16,11,1.100\n"
-        "\"test a\",\"a_b\",,64,2,704,128,11,1.100\n"
-        "\"test a\",\"a_b\",,512,2,5632,1024,11,1.100\n"
-        "\"test a\",\"a_b\",,4096,2,45056,8192,11,1.100\n"
-        "\"test a\",\"a_b\",,8192,2,90112,16384,11,1.100\n"
-        "\"test a\",\"a_c\",,8,2,160,16,20,2.000\n"
-        "\"test a\",\"a_c\",,64,2,1280,128,20,2.000\n"
-        "\"test a\",\"a_c\",,512,2,10240,1024,20,2.000\n"
-        "\"test a\",\"a_c\",,4096,2,81920,8192,20,2.000\n"
-        "\"test a\",\"a_c\",,8192,2,163840,16384,20,2.000\n"
-        "\"test b\",\"b_a\",,20,2,1500,0,75,0.750\n"
-        "\"test b\",\"b_a\",,30,2,2250,0,75,0.750\n"
-        "\"test b\",\"b_a\",,50,2,3750,0,75,\n"
-        "\"test b\",\"something else\",*,10,15,1000,0,100,1.000\n"
-        "\"test b\",\"something else\",*,20,15,2000,0,100,1.000\n"
-        "\"test b\",\"something else\",*,30,15,3000,0,100,1.000\n";
+        "\"test a\",\"a_a\",*,8,2,80,16,10.000,1.000\n"
+        "\"test a\",\"a_a\",*,64,2,640,128,10.000,1.000\n"
+        "\"test a\",\"a_a\",*,512,2,5120,1024,10.000,1.000\n"
+        "\"test a\",\"a_a\",*,4096,2,40960,8192,10.000,1.000\n"
+        "\"test a\",\"a_a\",*,8192,2,81920,16384,10.000,1.000\n"
+        "\"test a\",\"a_b\",,8,2,88,16,11.000,1.100\n"
+        "\"test a\",\"a_b\",,64,2,704,128,11.000,1.100\n"
+        "\"test a\",\"a_b\",,512,2,5632,1024,11.000,1.100\n"
+        "\"test a\",\"a_b\",,4096,2,45056,8192,11.000,1.100\n"
+        "\"test a\",\"a_b\",,8192,2,90112,16384,11.000,1.100\n"
+        "\"test a\",\"a_c\",,8,2,160,16,20.000,2.000\n"
+        "\"test a\",\"a_c\",,64,2,1280,128,20.000,2.000\n"
+        "\"test a\",\"a_c\",,512,2,10240,1024,20.000,2.000\n"
+        "\"test a\",\"a_c\",,4096,2,81920,8192,20.000,2.000\n"
+        "\"test a\",\"a_c\",,8192,2,163840,16384,20.000,2.000\n"
+        "\"test b\",\"b_a\",,20,2,1500,0,75.000,0.750\n"
+        "\"test b\",\"b_a\",,30,2,2250,0,75.000,0.750\n"
+        "\"test b\",\"b_a\",,50,2,3750,0,75.000,\n"
+        "\"test b\",\"something else\",*,10,15,1000,0,100.000,1.000\n"
+        "\"test b\",\"something else\",*,20,15,2000,0,100.000,1.000\n"
+        "\"test b\",\"something else\",*,30,15,3000,0,100.000,1.000\n";
 
     sout.str(string());
     report.to_csv(sout);
@@ -638,16 +710,16 @@ TEST_CASE("[picobench] compare")
 
         CHECK(r.error() == error_sample_compare);
         CHECK(serr.str() ==
-              "Error: Two samples of b1 @4096 produced different results: 4121 and 4122\n"
-              "Error: Two samples of b1 @8 produced different results: 36 and 37\n"
-              "Error: Two samples of b1 @64 produced different results: 88 and 100\n"
-              "Error: Two samples of b1 @512 produced different results: 545 and 549\n"
-              "Error: Two samples of b1 @8192 produced different results: 8213 and 8230\n"
-              "Error: Two samples of b2 @8 produced different results: 31 and 35\n"
-              "Error: Two samples of b2 @512 produced different results: 532 and 542\n"
-              "Error: Two samples of b2 @4096 produced different results: 4127 and 4130\n"
-              "Error: Two samples of b2 @64 produced different results: 96 and 99\n"
-              "Error: Two samples of b2 @8192 produced different results: 8214 and 8231\n"
+              "Error: Two samples of b1 @4096 produced different results: 4120 and 4121\n"
+              "Error: Two samples of b1 @512 produced different results: 538 and 540\n"
+              "Error: Two samples of b1 @8 produced different results: 37 and 41\n"
+              "Error: Two samples of b1 @8192 produced different results: 8213 and 8229\n"
+              "Error: Two samples of b1 @64 produced different results: 100 and 102\n"
+              "Error: Two samples of b2 @512 produced different results: 532 and 539\n"
+              "Error: Two samples of b2 @64 produced different results: 87 and 95\n"
+              "Error: Two samples of b2 @4096 produced different results: 4126 and 4128\n"
+              "Error: Two samples of b2 @8192 produced different results: 8214 and 8227\n"
+              "Error: Two samples of b2 @8 produced different results: 42 and 47\n"
               );
         CHECK(sout.str().empty());
 
@@ -663,12 +735,1747 @@ TEST_CASE("[picobench] compare")
 
         CHECK(r.error() == error_benchmark_compare);
         CHECK(serr.str() ==
-              "Error: Benchmarks b1 and b2 @8 produce different results: 56 and 51\n"
-              "Error: Benchmarks b1 and b2 @64 produce different results: 108 and 116\n"
-              "Error: Benchmarks b1 and b2 @512 produce different results: 565 and 552\n"
-              "Error: Benchmarks b1 and b2 @4096 produce different results: 4141 and 4147\n"
+              "Error: Benchmarks b1 and b2 @8 produce different results: 57 and 62\n"
+              "Error: Benchmarks b1 and b2 @64 produce different results: 120 and 107\n"
+              "Error: Benchmarks b1 and b2 @512 produce different results: 558 and 552\n"
+              "Error: Benchmarks b1 and b2 @4096 produce different results: 4140 and 4146\n"
               "Error: Benchmarks b1 and b2 @8192 produce different results: 8233 and 8234\n"
               );
         CHECK(sout.str().empty());
     }
 }
+
+map<int, int> json_samples;
+
+TEST_CASE("[picobench] json")
+{
+    local_runner r;
+    ostringstream sout, serr;
+    r.set_output_streams(sout, serr);
+
+    r.set_default_state_iterations({ 10, 20 });
+    r.set_default_samples(3);
+    r.set_capture_environment(false); // keep the output independent of the machine
+
+    r.add_benchmark("j\"a", [](state& s)
+    {
+        s.add_custom_duration(s.iterations() * 2);
+        s.set_result(s.iterations());
+    });
+
+    r.add_benchmark("jb", [](state& s)
+    {
+        // samples take 3, 4, 5 ns per iteration
+        s.add_custom_duration(s.iterations() * (3 + json_samples[s.iterations()]++ % 3));
+    });
+
+    r.run_benchmarks(42);
+    auto report = r.generate_report();
+    CHECK(report.random_seed == 42);
+
+    auto& jb = report.suites.front().benchmarks[1];
+    CHECK(jb.data[0].total_time_ns == 30);
+    CHECK(jb.data[0].median_time_ns == 40);
+    CHECK(jb.data[0].max_time_ns == 50);
+    CHECK(jb.data[0].mean_time_ns == 40);
+    CHECK(jb.data[0].stddev_ns == 10);
+
+    report.to_json(sout);
+
+    const char* json =
+        "{\n"
+        "  \"picobench_version\": \"" PICOBENCH_VERSION_STR "\",\n"
+        "  \"random_seed\": 42,\n"
+        "  \"error\": 0,\n"
+        "  \"suites\": [\n"
+        "    {\n"
+        "      \"name\": null,\n"
+        "      \"benchmarks\": [\n"
+        "        {\n"
+        "          \"name\": \"j\\\"a\",\n"
+        "          \"baseline\": true,\n"
+        "          \"data\": [\n"
+        "            {\"dimension\": 10, \"samples\": 3, \"total_ns\": 20, \"result\": 10, \"median_ns\": 20, \"max_ns\": 20, \"mean_ns\": 20, \"stddev_ns\": 0, \"ns_per_op\": 2, \"ops_per_sec\": 500000000, \"baseline_ratio\": 1},\n"
+        "            {\"dimension\": 20, \"samples\": 3, \"total_ns\": 40, \"result\": 20, \"median_ns\": 40, \"max_ns\": 40, \"mean_ns\": 40, \"stddev_ns\": 0, \"ns_per_op\": 2, \"ops_per_sec\": 500000000, \"baseline_ratio\": 1}\n"
+        "          ]\n"
+        "        },\n"
+        "        {\n"
+        "          \"name\": \"jb\",\n"
+        "          \"baseline\": false,\n"
+        "          \"data\": [\n"
+        "            {\"dimension\": 10, \"samples\": 3, \"total_ns\": 30, \"result\": 0, \"median_ns\": 40, \"max_ns\": 50, \"mean_ns\": 40, \"stddev_ns\": 10, \"ns_per_op\": 3, \"ops_per_sec\": 333333333.33333331, \"baseline_ratio\": 1.5},\n"
+        "            {\"dimension\": 20, \"samples\": 3, \"total_ns\": 60, \"result\": 0, \"median_ns\": 80, \"max_ns\": 100, \"mean_ns\": 80, \"stddev_ns\": 20, \"ns_per_op\": 3, \"ops_per_sec\": 333333333.33333331, \"baseline_ratio\": 1.5}\n"
+        "          ]\n"
+        "        }\n"
+        "      ]\n"
+        "    }\n"
+        "  ]\n"
+        "}\n";
+    CHECK(sout.str() == json);
+    CHECK(serr.str().empty());
+
+    // times per operation below a nanosecond
+    picobench::report::benchmark_problem_space d;
+    d.dimension = 10;
+    d.samples = 1;
+    d.total_time_ns = 3;
+    picobench::report sub;
+    sub.suites.resize(1);
+    sub.suites[0].benchmarks.resize(1);
+    sub.suites[0].benchmarks[0].name = "sub";
+    sub.suites[0].benchmarks[0].is_baseline = true;
+    sub.suites[0].benchmarks[0].data.push_back(d);
+
+    ostringstream txt, csv, js;
+    sub.to_text(txt);
+    CHECK(txt.str().find("|   0.300 |") != string::npos);
+    sub.to_csv(csv, false);
+    CHECK(csv.str() == ",\"sub\",*,10,1,3,0,0.300,1.000\n");
+    sub.to_json(js);
+    CHECK(js.str().find("\"ns_per_op\": 0.29999999999999999,") != string::npos);
+
+    stringstream in(js.str());
+    picobench::report loaded;
+    REQUIRE(loaded.from_json(in));
+    CHECK(loaded.suites[0].benchmarks[0].data[0].dimension == 10);
+    CHECK(loaded.suites[0].benchmarks[0].data[0].total_time_ns == 3);
+}
+
+TEST_CASE("[picobench] param dimensions")
+{
+    local_runner r;
+    r.set_default_state_iterations({ 10, 1000 });
+    r.set_default_samples(1);
+
+    // the same time for any dimension, like a command which is run once with a size
+    r.add_benchmark("iterations", [](state& s)
+    {
+        s.add_custom_duration(500);
+    });
+    r.add_benchmark("params", [](state& s)
+    {
+        s.add_custom_duration(500);
+    }).param_dimensions();
+
+    r.run_benchmarks();
+    auto rpt = r.generate_report();
+    REQUIRE(rpt.suites[0].benchmarks.size() == 2);
+    CHECK(!rpt.suites[0].benchmarks[0].has_param_dimensions);
+    CHECK(rpt.suites[0].benchmarks[1].has_param_dimensions);
+
+    ostringstream csv;
+    rpt.to_csv(csv, false);
+    CHECK(csv.str() ==
+        ",\"iterations\",*,10,1,500,0,50.000,1.000\n"
+        ",\"iterations\",*,1000,1,500,0,0.500,1.000\n"
+        ",\"params\",p,10,1,500,0,500.000,1.000\n"
+        ",\"params\",p,1000,1,500,0,500.000,1.000\n"
+    );
+
+    ostringstream txt;
+    rpt.to_text(txt);
+    CHECK(txt.str().find(
+        " params                   |    1000 |     0.001 | 500.000 |  1.000 |  2000000.0\n") != string::npos);
+
+    ostringstream concise;
+    rpt.to_text_concise(concise);
+    CHECK(concise.str().find(" params                   | 500.000 |") != string::npos);
+
+    ostringstream js;
+    rpt.to_json(js);
+    CHECK(js.str().find("\"param_dimensions\": true") != string::npos);
+    CHECK(js.str().find("\"ns_per_op\": 500, \"ops_per_sec\": 2000000,") != string::npos);
+
+    stringstream json_in(js.str()), csv_in(csv.str());
+    picobench::report from_json, from_csv;
+    REQUIRE(from_json.from_json(json_in));
+    REQUIRE(from_csv.from_csv(csv_in));
+    CHECK(!from_json.suites[0].benchmarks[0].has_param_dimensions);
+    CHECK(from_json.suites[0].benchmarks[1].has_param_dimensions);
+    CHECK(!from_csv.suites[0].benchmarks[0].has_param_dimensions);
+    CHECK(from_csv.suites[0].benchmarks[1].has_param_dimensions);
+
+    // a sample of the param dimensions is compared to the same sample
+    auto cmp = rpt.compare(from_json);
+    REQUIRE(cmp.entries.size() == 4);
+    CHECK(cmp.entries[3].operations == 1);
+    ostringstream cmp_text;
+    cmp.to_text(cmp_text, 0.05);
+    CHECK(cmp_text.str().find(" params                   |    1000 |") != string::npos);
+}
+
+TEST_CASE("[picobench] compare to saved report")
+{
+    local_runner r;
+    r.set_default_state_iterations({ 10, 20 });
+    r.set_default_samples(3);
+
+    r.add_benchmark("fast", [](state& s)
+    {
+        s.add_custom_duration(s.iterations() * 10);
+    });
+    r.add_benchmark("slow", [](state& s)
+    {
+        s.add_custom_duration(s.iterations() * 20);
+    });
+
+    r.run_benchmarks(5);
+    auto old_report = r.generate_report();
+
+    stringstream json;
+    old_report.to_json(json);
+
+    report loaded;
+    CHECK(loaded.from_json(json));
+    CHECK(loaded.random_seed == 5);
+    REQUIRE(loaded.suites.size() == 1);
+    CHECK(!loaded.suites[0].name);
+    REQUIRE(loaded.suites[0].benchmarks.size() == 2);
+    auto& lslow = loaded.suites[0].benchmarks[1];
+    CHECK(strcmp(lslow.name, "slow") == 0);
+    CHECK(!lslow.is_baseline);
+    REQUIRE(lslow.data.size() == 2);
+    CHECK(lslow.data[1].dimension == 20);
+    CHECK(lslow.data[1].samples == 3);
+    CHECK(lslow.data[1].total_time_ns == 400);
+    CHECK(lslow.data[1].median_time_ns == 400);
+
+    stringstream bad("{\"suites\": [{\"name\": 5}]}");
+    report bad_report;
+    CHECK(!bad_report.from_json(bad));
+
+    auto new_report = old_report;
+    for (auto& d : new_report.suites[0].benchmarks[1].data)
+    {
+        d.total_time_ns = d.total_time_ns * 3 / 4;
+        d.median_time_ns = d.total_time_ns;
+    }
+    auto& fast_data = new_report.suites[0].benchmarks[0].data;
+    fast_data[0].total_time_ns = 110;
+    fast_data[0].median_time_ns = 110;
+    fast_data[1].total_time_ns = 204;
+    fast_data[1].median_time_ns = 210;
+
+    auto cmp = new_report.compare(loaded);
+    REQUIRE(cmp.entries.size() == 4);
+    CHECK(cmp.entries[0].benchmark == new_report.suites[0].benchmarks[0].name);
+    CHECK(cmp.entries[0].dimension == 10);
+    CHECK(cmp.entries[0].old_time_ns == 100);
+    CHECK(cmp.entries[0].new_time_ns == 110);
+    CHECK(cmp.entries[0].significant);
+    CHECK(!cmp.entries[1].significant);
+    CHECK(cmp.entries[2].change == -0.25);
+    CHECK(cmp.has_regression(0.05));
+    CHECK(!cmp.has_regression(0.15));
+
+    ostringstream sout;
+    cmp.to_text(sout, 0.05);
+    const char* txt =
+        " Name                     |   Dim   | Old ns/op | New ns/op |  Change  | Note\n"
+        "--------------------------|--------:|----------:|----------:|---------:|:-----------\n"
+        " fast                     |      10 |    10.000 |    11.000 |   +10.0% | REGRESSION\n"
+        " fast                     |      20 |    10.000 |    10.200 |    +2.0% | noise\n"
+        " slow                     |      10 |    20.000 |    15.000 |   -25.0% | improvement\n"
+        " slow                     |      20 |    20.000 |    15.000 |   -25.0% | improvement\n"
+        "\n";
+    CHECK(sout.str() == txt);
+
+    const char* fname = "picobench_test_compare.json";
+    {
+        ofstream fout(fname);
+        loaded.to_json(fout);
+    }
+
+    // the comparison doesn't follow a json report on stdout
+    {
+        local_runner cr;
+        ostringstream cout_json, cerr_json;
+        cr.set_output_streams(cout_json, cerr_json);
+        cr.set_default_state_iterations({ 10, 20 });
+        cr.set_default_samples(3);
+        cr.set_capture_environment(false);
+        cr.add_benchmark("fast", [](state& s) { s.add_custom_duration(s.iterations() * 10); });
+        cr.add_benchmark("slow", [](state& s) { s.add_custom_duration(s.iterations() * 20); });
+        const char* cmd_line[] = { "", "--out-fmt=json", "--compare-to=picobench_test_compare.json" };
+        CHECK(cr.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(cr.run(5) == no_error);
+
+        stringstream in(cout_json.str());
+        report from_stdout;
+        CHECK(from_stdout.from_json(in));
+        CHECK(cout_json.str().find("# Compared to") == string::npos);
+        CHECK(cerr_json.str().find("# Compared to picobench_test_compare.json:") != string::npos);
+    }
+    remove(fname);
+
+    {
+        local_runner cr;
+        ostringstream cout_bad, cerr_bad;
+        cr.set_output_streams(cout_bad, cerr_bad);
+        cr.set_capture_environment(false);
+        const char* cmd_line[] = { "", "--compare-to=picobench_test_compare.json" };
+        CHECK(cr.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(cr.run(5) == error_bad_report);
+        CHECK(cerr_bad.str() == "Error: Could not read report `picobench_test_compare.json`\n");
+    }
+}
+
+struct counting_reporter : public reporter
+{
+    size_t started = 0, samples = 0, benchmarks = 0, done = 0;
+    size_t total_samples = 0;
+    vector<string> completed;
+
+    void run_started(const run_info& info) override
+    {
+        ++started;
+        total_samples = info.samples;
+        CHECK(info.benchmarks == 2);
+        CHECK(info.random_seed == 3);
+    }
+    void sample_done(const sample_info& info) override
+    {
+        ++samples;
+        CHECK(info.samples_done == samples);
+        CHECK(info.samples_total == total_samples);
+        CHECK(info.duration_ns == info.dimension);
+    }
+    void benchmark_done(const char* suite, const report::benchmark& bm) override
+    {
+        ++benchmarks;
+        CHECK(!suite);
+        completed.push_back(bm.name);
+        for (auto& d : bm.data)
+        {
+            CHECK(d.samples == 2);
+            CHECK(d.total_time_ns == d.dimension);
+        }
+    }
+    void run_done(const report& r) override
+    {
+        ++done;
+        CHECK(r.suites.size() == 1);
+    }
+};
+
+TEST_CASE("[picobench] reporters")
+{
+    local_runner r;
+    ostringstream sout, serr;
+    r.set_output_streams(sout, serr);
+    r.set_default_state_iterations({ 5, 7 });
+    r.set_preferred_output_format(report_output_format::jsonl);
+    r.set_capture_environment(false); // keep the output independent of the machine
+
+    auto func = [](state& s) { s.add_custom_duration(s.iterations()); };
+    r.add_benchmark("r1", func);
+    r.add_benchmark("r2", func).user_data(1);
+
+    counting_reporter cr;
+    r.add_reporter(&cr);
+
+    CHECK(r.run(3) == 0);
+    CHECK(cr.started == 1);
+    CHECK(cr.total_samples == 8);
+    CHECK(cr.samples == 8);
+    CHECK(cr.benchmarks == 2);
+    CHECK(cr.done == 1);
+    CHECK(cr.completed.size() == 2);
+
+    // one header line, one line per benchmark and a final one
+    auto out = sout.str();
+    CHECK(std::count(out.begin(), out.end(), '\n') == 4);
+    CHECK(out.find("{\"picobench_version\": \"" PICOBENCH_VERSION_STR "\", \"random_seed\": 3, \"benchmarks\": 2, \"samples\": 8}\n") == 0);
+    CHECK(out.find("{\"suite\": null, \"name\": \"r1\", \"baseline\": true, \"data\": [{\"dimension\": 5, \"samples\": 2, \"total_ns\": 5, ") != string::npos);
+    CHECK(out.find("\"baseline_ratio\": null}]}\n") != string::npos);
+    CHECK(out.rfind("{\"done\": true, \"error\": 0}\n") == out.size() - 27);
+    CHECK(serr.str().empty());
+
+    // reporters are not owned and can be removed
+    r.remove_reporter(&cr);
+    sout.str(string());
+    r.set_preferred_output_format(report_output_format::concise_text);
+    r.set_show_progress(true);
+    CHECK(r.run(3) == 0);
+    CHECK(cr.started == 1);
+    CHECK(sout.str().find(" r2                       |   1.000 |    1.000 |") != string::npos);
+    CHECK(serr.str().find("[100.0%] 8/8 samples, elapsed 0:00:00, ETA 0:00:00") != string::npos);
+}
+
+int checkpoint_runs[3];
+int checkpoint_samples_left = -1; // until the run is interrupted (-1 means never)
+
+template <int I>
+void checkpoint_bench(state& s)
+{
+    if (checkpoint_samples_left == 0) throw std::runtime_error("interrupted");
+    if (checkpoint_samples_left > 0) --checkpoint_samples_left;
+    ++checkpoint_runs[I];
+    s.add_custom_duration(s.iterations() * (I + 1) + checkpoint_runs[I]);
+    s.set_result(checkpoint_runs[I]);
+    s.set_counter("runs", checkpoint_runs[I]);
+}
+
+void add_checkpoint_benchmarks(runner& r)
+{
+    r.set_default_state_iterations({ 3, 6 });
+    r.set_default_samples(4);
+    r.add_benchmark("c0", checkpoint_bench<0>);
+    r.add_benchmark("c1", checkpoint_bench<1>);
+    r.set_suite("checkpoint suite");
+    r.add_benchmark("c2", checkpoint_bench<2>);
+}
+
+TEST_CASE("[picobench] checkpoint")
+{
+    const char* fname = "picobench_test_checkpoint.jsonl";
+    const char* fname2 = "picobench_test_checkpoint2.jsonl";
+
+    local_runner full;
+    add_checkpoint_benchmarks(full);
+    full.set_checkpoint_filename(fname);
+    full.run_benchmarks(77);
+    auto full_report = full.generate_report();
+    CHECK(full.error() == no_error);
+    CHECK(checkpoint_runs[0] == 8);
+
+    vector<string> lines;
+    {
+        ifstream fin(fname);
+        string line;
+        while (getline(fin, line)) lines.push_back(line);
+    }
+    REQUIRE(lines.size() == 4);
+    CHECK(lines[0] == "{\"picobench_checkpoint\": 1, \"random_seed\": 77, \"benchmarks\": 3, \"samples\": 24}");
+
+    // simulate an interrupted run: keep the first completed benchmark and part of the second
+    {
+        ofstream fout(fname);
+        fout << lines[0] << '\n' << lines[1] << '\n' << lines[2].substr(0, 30);
+    }
+
+    std::fill(checkpoint_runs, checkpoint_runs + 3, 0);
+    local_runner resumed;
+    add_checkpoint_benchmarks(resumed);
+    const char* cmd_line[] = { "", "--resume=picobench_test_checkpoint.jsonl", "--checkpoint=picobench_test_checkpoint2.jsonl" };
+    CHECK(resumed.parse_cmd_line(3, cmd_line));
+    CHECK(strcmp(resumed.resume_filename(), fname) == 0);
+    CHECK(strcmp(resumed.checkpoint_filename(), fname2) == 0);
+    resumed.run_benchmarks(); // seed comes from the checkpoint
+    CHECK(resumed.error() == no_error);
+    auto resumed_report = resumed.generate_report();
+    CHECK(resumed_report.random_seed == 77);
+
+    // only one benchmark was skipped
+    CHECK(std::count(checkpoint_runs, checkpoint_runs + 3, 0) == 1);
+    CHECK(std::count(checkpoint_runs, checkpoint_runs + 3, 8) == 2);
+
+    // the load average may have changed between the runs
+    full_report.environment.clear();
+    resumed_report.environment.clear();
+
+    stringstream full_json, resumed_json;
+    full_report.to_json(full_json);
+    resumed_report.to_json(resumed_json);
+    CHECK(full_json.str() == resumed_json.str());
+
+    // with the counters of the restored benchmarks
+    for (auto& rs : resumed_report.suites)
+    {
+        for (auto& b : rs.benchmarks)
+        {
+            for (auto& d : b.data)
+            {
+                REQUIRE(d.counters.size() == 1);
+                CHECK(strcmp(d.counters[0].first, "runs") == 0);
+            }
+        }
+    }
+
+    // the new checkpoint has all benchmarks
+    {
+        ifstream fin(fname2);
+        string line;
+        size_t i = 0;
+        while (getline(fin, line))
+        {
+            REQUIRE(i < lines.size());
+            CHECK(line == lines[i]);
+            ++i;
+        }
+        CHECK(i == lines.size());
+    }
+
+    // a run which writes to the checkpoint it resumed from is interrupted again before it
+    // gets to the step at which the restored benchmark was completed
+    {
+        ofstream fout(fname);
+        fout << lines[0] << '\n' << lines[2] << '\n';
+    }
+    for (int resume = 0; resume < 2; ++resume)
+    {
+        std::fill(checkpoint_runs, checkpoint_runs + 3, 0);
+        checkpoint_samples_left = resume == 0 ? 2 : -1;
+        local_runner again;
+        add_checkpoint_benchmarks(again);
+        again.set_resume_filename(fname);
+        again.set_checkpoint_filename(fname);
+        bool interrupted = false;
+        try
+        {
+            again.run_benchmarks();
+        }
+        catch (std::runtime_error&)
+        {
+            interrupted = true;
+        }
+        CHECK(interrupted == (resume == 0));
+        if (interrupted)
+        {
+            // the restored benchmark is still in the file
+            ifstream fin(fname);
+            string line;
+            vector<string> kept;
+            while (getline(fin, line)) kept.push_back(line);
+            CHECK(kept == vector<string>({ lines[0], lines[2] }));
+            continue;
+        }
+
+        CHECK(again.error() == no_error);
+        auto again_report = again.generate_report();
+        again_report.environment.clear();
+        stringstream again_json;
+        again_report.to_json(again_json);
+        CHECK(again_json.str() == full_json.str());
+    }
+    checkpoint_samples_left = -1;
+
+    // checkpoint of different benchmarks
+    local_runner other;
+    ostringstream sout, serr;
+    other.set_output_streams(sout, serr);
+    other.add_benchmark("c0", checkpoint_bench<0>);
+    other.set_resume_filename(fname2);
+    other.run_benchmarks();
+    CHECK(other.error() == error_checkpoint);
+    CHECK(serr.str() == "Error: Checkpoint benchmark c2 doesn't match the benchmarks being run\n");
+
+    remove(fname);
+    remove(fname2);
+}
+
+TEST_CASE("[picobench] many benchmarks")
+{
+    const int num_suites = 5;
+    const int per_suite = 10000;
+
+    vector<string> names;
+    names.reserve(num_suites * (per_suite + 1));
+    for (int i = 0; i < num_suites; ++i)
+    {
+        names.push_back("suite " + to_string(i));
+        for (int j = 0; j < per_suite; ++j)
+        {
+            names.push_back("bench " + to_string(i) + "/" + to_string(j));
+        }
+    }
+
+    auto func = [](state& s)
+    {
+        s.add_custom_duration(s.iterations() * (1 + s.user_data() % 7));
+        s.set_result(s.iterations());
+    };
+
+    local_runner r;
+    ostringstream sout, serr;
+    r.set_output_streams(sout, serr);
+    r.set_default_state_iterations({1, 2});
+    r.set_default_samples(1);
+
+    // interleave the suites, so that lookups are needed while registering
+    for (int j = 0; j < per_suite; ++j)
+    {
+        for (int i = 0; i < num_suites; ++i)
+        {
+            auto si = size_t(i * (per_suite + 1));
+            r.set_suite(names[si].c_str());
+            r.add_benchmark(names[si + 1 + size_t(j)].c_str(), func).user_data(uintptr_t(i * per_suite + j));
+        }
+    }
+
+    r.run_benchmarks(3);
+    auto report = r.generate_report();
+    CHECK(r.error() == no_error);
+    CHECK(sout.str().empty());
+    CHECK(serr.str().empty());
+
+    REQUIRE(report.suites.size() == num_suites);
+    for (int i = 0; i < num_suites; ++i)
+    {
+        auto s = report.find_suite(names[size_t(i * (per_suite + 1))].c_str());
+        REQUIRE(s);
+        CHECK(s->benchmarks.size() == per_suite);
+
+        for (int j = 0; j < per_suite; j += 997)
+        {
+            auto b = s->find_benchmark(("bench " + to_string(i) + "/" + to_string(j)).c_str());
+            REQUIRE(b);
+            REQUIRE(b->data.size() == 2);
+            CHECK(b->data[1].dimension == 2);
+            CHECK(b->data[1].total_time_ns == 2 * (1 + (i * per_suite + j) % 7));
+        }
+        CHECK(!s->find_benchmark("bench 9/9"));
+    }
+    CHECK(!report.find_suite("suite 9"));
+    CHECK(!report.find_suite(nullptr));
+
+    ostringstream csv;
+    report.to_csv(csv);
+    auto csv_str = csv.str();
+    CHECK(std::count(csv_str.begin(), csv_str.end(), '\n') == 1 + num_suites * per_suite * 2);
+
+    const char* cmd_line[] = { "", "--run-suite=suite 3", "--run-only=bench 3/5,bench 3/9999,bench 1/5" };
+    CHECK(r.parse_cmd_line(3, cmd_line));
+    r.run_benchmarks(3);
+    report = r.generate_report();
+    REQUIRE(report.suites.size() == 1);
+    REQUIRE(report.suites[0].benchmarks.size() == 2);
+    CHECK(report.suites[0].find_benchmark("bench 3/9999"));
+    CHECK(report.suites[0].find_baseline() == report.find_suite("suite 3")->find_benchmark("bench 3/5"));
+}
+
+TEST_CASE("[picobench] many benchmarks in reports")
+{
+    const int num = 50000;
+
+    vector<string> names;
+    names.reserve(num);
+    picobench::report big;
+    big.suites.resize(1);
+    big.suites[0].name = "s";
+    for (int i = 0; i < num; ++i)
+    {
+        names.push_back("bench " + to_string(i));
+        picobench::report::benchmark_problem_space d;
+        d.dimension = 1;
+        d.samples = 1;
+        d.total_time_ns = i + 1;
+        big.suites[0].benchmarks.push_back({ names.back().c_str(), i == 0, { d }, false, false });
+    }
+
+    // each new name is looked up before it's added
+    picobench::report merged;
+    merged.merge(big);
+    REQUIRE(merged.suites.size() == 1);
+    CHECK(merged.suites[0].benchmarks.size() == num);
+    REQUIRE(merged.find_suite("s"));
+    REQUIRE(merged.find_suite("s")->find_benchmark("bench 49999"));
+    CHECK(merged.find_suite("s")->find_benchmark("bench 49999")->data[0].total_time_ns == num);
+
+    stringstream csv;
+    big.to_csv(csv);
+    picobench::report loaded;
+    REQUIRE(loaded.from_csv(csv));
+    REQUIRE(loaded.suites.size() == 1);
+    CHECK(loaded.suites[0].benchmarks.size() == num);
+
+    // renamed in place
+    loaded.suites[0].benchmarks[5].name = "renamed";
+    loaded.invalidate_indices();
+    CHECK(!loaded.find_suite("s")->find_benchmark("bench 5"));
+    CHECK(loaded.find_suite("s")->find_benchmark("renamed") == &loaded.suites[0].benchmarks[5]);
+}
+
+TEST_CASE("[picobench] filters")
+{
+    CHECK(runner::glob_match("*", ""));
+    CHECK(runner::glob_match("a*c", "abbbc"));
+    CHECK(runner::glob_match("a*c", "ac"));
+    CHECK(!runner::glob_match("a*c", "acb"));
+    CHECK(runner::glob_match("*_1GB", "sort/std_1GB"));
+    CHECK(runner::glob_match("a?c", "abc"));
+    CHECK(!runner::glob_match("a?c", "ac"));
+    CHECK(runner::glob_match("x[0-9]", "x5"));
+    CHECK(!runner::glob_match("x[!0-9]", "x5"));
+    CHECK(runner::glob_match("x[]a]", "x]"));
+    CHECK(runner::glob_match("x[", "x["));
+    CHECK(runner::glob_match("*a*b*", "xxaxxbxx"));
+    CHECK(!runner::glob_match("*a*b*", "xxbxxaxx"));
+
+    auto func = [](state& s)
+    {
+        s.add_custom_duration(s.iterations());
+    };
+
+    auto add_benchmarks = [&func](runner& r)
+    {
+        r.add_benchmark("plain", func);
+        r.set_suite("hash");
+        r.add_benchmark("crc_sse", func);
+        r.add_benchmark("crc_avx2", func).tag("simd");
+        r.add_benchmark("crc_avx2_1GB", func).tag("simd").tag("slow");
+        r.set_suite("sort");
+        r.add_benchmark("std_avx", func);
+        r.add_benchmark("std_1GB", func).tag("slow");
+    };
+
+    {
+        local_runner r;
+        ostringstream sout, serr;
+        r.set_output_streams(sout, serr);
+        add_benchmarks(r);
+        const char* cmd_line[] = { "", "--list", "--filter=hash*/*avx*", "--exclude=*_1GB" };
+        CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(!r.should_run());
+        CHECK(sout.str() ==
+            "  hash:\n"
+            "    crc_avx2 [simd]\n"
+        );
+        CHECK(serr.str().empty());
+    }
+
+    {
+        local_runner r;
+        ostringstream sout, serr;
+        r.set_output_streams(sout, serr);
+        add_benchmarks(r);
+        const char* cmd_line[] = { "", "--filter=plain,tag:slow", "--exclude=re:^hash/", "--list" };
+        CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(sout.str() ==
+            "  <Default suite>:\n"
+            "    plain\n"
+            "  sort:\n"
+            "    std_1GB [slow]\n"
+        );
+    }
+
+    {
+        // the commas of a regex are not separators
+        local_runner r;
+        ostringstream sout, serr;
+        r.set_output_streams(sout, serr);
+        add_benchmarks(r);
+        const char* cmd_line[] = { "", "--filter=plain,re:_s{1,2}[a-z]{2,3}$", "--list" };
+        CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(serr.str().empty());
+        CHECK(sout.str() ==
+            "  <Default suite>:\n"
+            "    plain\n"
+            "  hash:\n"
+            "    crc_sse\n"
+        );
+    }
+
+    {
+        local_runner r;
+        ostringstream sout, serr;
+        r.set_output_streams(sout, serr);
+        add_benchmarks(r);
+        const char* cmd_line[] = { "", "--filter=re:[" };
+        CHECK(!r.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(serr.str() == "Error: Bad command-line argument: --filter=re:[\n");
+        CHECK(r.error() == error_bad_cmd_line_argument);
+    }
+
+    {
+        local_runner r;
+        ostringstream sout, serr;
+        r.set_output_streams(sout, serr);
+        r.set_default_state_iterations({ 1 });
+        r.set_default_samples(1);
+        add_benchmarks(r);
+        CHECK(r.add_filter("*avx*"));
+        CHECK(r.add_filter("tag:slow", true));
+        r.run_benchmarks();
+        auto report = r.generate_report();
+        REQUIRE(report.suites.size() == 2);
+        CHECK(report.suites[0].benchmarks.size() == 1);
+        CHECK(report.suites[0].find_benchmark("crc_avx2"));
+        CHECK(report.suites[1].benchmarks.size() == 1);
+        CHECK(report.suites[1].find_benchmark("std_avx"));
+        CHECK(report.suites[1].find_baseline());
+    }
+}
+
+const char* shard_names[] = { "a", "b", "c", "d", "e", "f" };
+
+TEST_CASE("[picobench] shards")
+{
+    auto func = [](state& s)
+    {
+        s.add_custom_duration(s.iterations() * (1 + int64_t(s.user_data())));
+        s.set_result(s.iterations());
+    };
+
+    auto add_benchmarks = [&func](runner& r)
+    {
+        r.set_default_state_iterations({ 2, 4 });
+        r.set_default_samples(2);
+        r.set_suite("s1");
+        for (int i = 0; i < 6; ++i)
+        {
+            r.add_benchmark(shard_names[i], func).user_data(uintptr_t(i));
+        }
+        r.set_suite("s2");
+        r.add_benchmark("x", func).user_data(1);
+        r.add_benchmark("y", func).user_data(2).baseline();
+        r.add_benchmark("big", func).iterations({ 100 }).user_data(3);
+    };
+
+    local_runner full;
+    add_benchmarks(full);
+    full.run_benchmarks(5);
+    auto full_report = full.generate_report();
+
+    report merged;
+    size_t total = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        local_runner r;
+        ostringstream sout, serr;
+        r.set_output_streams(sout, serr);
+        add_benchmarks(r);
+        const char* cmd_line[] = { "", i == 0 ? "--shard=0/3" : i == 1 ? "--shard=1/3" : "--shard=2/3" };
+        CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(r.shard_index() == i);
+        CHECK(r.shard_count() == 3);
+        r.run_benchmarks(5);
+        auto rpt = r.generate_report();
+        CHECK(r.error() == no_error);
+
+        for (auto& s : rpt.suites) total += s.benchmarks.size();
+
+        // go through the serialized formats as the merge tool does
+        stringstream buf;
+        report loaded;
+        if (i == 1)
+        {
+            rpt.to_csv(buf);
+            CHECK(loaded.from_csv(buf));
+        }
+        else
+        {
+            rpt.to_json(buf);
+            CHECK(loaded.from_json(buf));
+        }
+        merged.merge(loaded);
+    }
+
+    // the big one gets a shard of its own
+    CHECK(total == 9);
+    REQUIRE(merged.suites.size() == 2);
+
+    for (auto& fs : full_report.suites)
+    {
+        auto ms = merged.find_suite(fs.name);
+        REQUIRE(ms);
+        CHECK(ms->benchmarks.size() == fs.benchmarks.size());
+        REQUIRE(ms->find_baseline());
+        CHECK(strcmp(ms->find_baseline()->name, fs.find_baseline()->name) == 0);
+        for (auto& fb : fs.benchmarks)
+        {
+            auto mb = ms->find_benchmark(fb.name);
+            REQUIRE(mb);
+            REQUIRE(mb->data.size() == fb.data.size());
+            for (size_t i = 0; i < fb.data.size(); ++i)
+            {
+                CHECK(mb->data[i].dimension == fb.data[i].dimension);
+                CHECK(mb->data[i].total_time_ns == fb.data[i].total_time_ns);
+                CHECK(mb->data[i].result == fb.data[i].result);
+            }
+        }
+    }
+
+    // reports without baselines
+    ostringstream csv, concise;
+    for (auto& s : merged.suites) for (auto& b : s.benchmarks) b.is_baseline = false;
+    merged.to_csv(csv);
+    CHECK(csv.str().find("\"s2\",\"x\",,2,2,4,2,2.000,\n") != string::npos);
+    merged.to_text_concise(concise);
+    CHECK(concise.str().find("      ??? |") != string::npos);
+
+    // cost estimates from a report
+    report costs;
+    costs.suites.resize(2);
+    picobench::report::benchmark_problem_space cost;
+    cost.dimension = 1;
+    cost.mean_time_ns = 1000000;
+    costs.suites[0].name = "s1";
+    costs.suites[0].benchmarks.push_back({ "a", false, { cost }, false, false });
+    cost.dimension = 100;
+    cost.mean_time_ns = 100;
+    costs.suites[1].name = "s2";
+    costs.suites[1].benchmarks.push_back({ "big", false, { cost }, false, false });
+
+    local_runner r;
+    add_benchmarks(r);
+    r.set_shard(0, 2);
+    r.set_shard_cost_estimates(costs);
+    const char* cmd_line[] = { "", "--list" };
+    ostringstream sout, serr;
+    r.set_output_streams(sout, serr);
+    CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+    CHECK(sout.str() ==
+        "  s1:\n"
+        "    a\n"
+    );
+}
+
+vector<pair<uintptr_t, int>> paired_trace;
+
+TEST_CASE("[picobench] paired")
+{
+    auto func = [](state& s)
+    {
+        paired_trace.emplace_back(s.user_data(), s.iterations());
+        s.add_custom_duration(s.iterations() * int64_t(10 + 10 * s.user_data()));
+        s.set_result(s.iterations());
+    };
+
+    auto add_benchmarks = [&func](runner& r)
+    {
+        r.set_default_state_iterations({ 1, 2, 3 });
+        r.set_default_samples(4);
+        r.add_benchmark("p0", func).user_data(0);
+        r.add_benchmark("p1", func).user_data(1);
+        r.add_benchmark("p2", func).user_data(2).samples(2);
+    };
+
+    local_runner r;
+    add_benchmarks(r);
+    const char* cmd_line[] = { "", "--seed=7", "--paired" };
+    CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+    CHECK(r.paired());
+    CHECK(r.default_random_seed() == 7);
+
+    paired_trace.clear();
+    r.run_benchmarks();
+    auto report = r.generate_report();
+    CHECK(r.error() == no_error);
+    CHECK(report.random_seed == 7);
+
+    // baseline samples: 12 of its own + 12 pairs for p1 + 6 pairs for p2
+    REQUIRE(paired_trace.size() == 12 + 2 * 12 + 2 * 6);
+
+    // every sample of p1 and p2 is next to a baseline sample with the same iterations
+    // with alternating order for each benchmark
+    int pairs[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < paired_trace.size(); ++i)
+    {
+        auto& t = paired_trace[i];
+        if (t.first == 0) continue;
+
+        auto n = pairs[t.first]++;
+        auto pi = n % 2 ? i + 1 : i - 1;
+        REQUIRE(pi < paired_trace.size());
+        CHECK(paired_trace[pi].first == 0);
+        CHECK(paired_trace[pi].second == t.second);
+    }
+    CHECK(pairs[1] == 12);
+    CHECK(pairs[2] == 6);
+
+    auto& s = report.suites.front();
+    REQUIRE(s.benchmarks.size() == 3);
+    for (auto& d : s.benchmarks[0].data)
+    {
+        CHECK(d.samples == 4 + 4 + 2);
+        CHECK(d.pairs == 0);
+    }
+    for (auto& d : s.benchmarks[1].data)
+    {
+        CHECK(d.samples == 4);
+        CHECK(d.pairs == 4);
+        CHECK(d.pair_ratio_median == 2);
+        CHECK(d.pair_ratio_mean == 2);
+        CHECK(d.pair_ratio_stddev == 0);
+    }
+    for (auto& d : s.benchmarks[2].data)
+    {
+        CHECK(d.pairs == 2);
+        CHECK(d.pair_ratio_median == 3);
+    }
+
+    ostringstream json;
+    report.to_json(json);
+    CHECK(json.str().find("\"baseline_ratio\": 3, \"pairs\": 2, \"pair_ratio_median\": 3, \"pair_ratio_mean\": 3, \"pair_ratio_stddev\": 0}") != string::npos);
+
+    // the same seed gives the same schedule
+    auto trace = paired_trace;
+    paired_trace.clear();
+    r.run_benchmarks();
+    CHECK(trace == paired_trace);
+}
+
+TEST_CASE("[picobench] cold")
+{
+    static int cold_buf[1024];
+    auto func = [](state& s)
+    {
+        for (auto _ : s)
+        {
+            cold_buf[s.iterations() % 1024] += 1;
+        }
+        s.set_result(cold_buf[0]);
+    };
+
+    CHECK(cache_evictor::parse_size("32K") == 32 * 1024);
+    CHECK(cache_evictor::parse_size("16M") == 16 * 1024 * 1024);
+    CHECK(cache_evictor::parse_size("512") == 512);
+
+    local_runner r;
+    r.set_default_state_iterations({ 1, 2 });
+    r.set_default_samples(2);
+    r.add_benchmark("warm", func);
+    r.add_benchmark("cold", func).user_data(1).cold(true, true).flush(cold_buf, sizeof(cold_buf));
+
+    const char* cmd_line[] = { "", "--seed=3" };
+    CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+    CHECK_FALSE(r.cold_data());
+    r.run_benchmarks();
+    auto report = r.generate_report();
+    CHECK(r.error() == no_error);
+
+    auto& s = report.suites.front();
+    REQUIRE(s.benchmarks.size() == 2);
+    CHECK_FALSE(s.benchmarks[0].is_cold);
+    CHECK(s.benchmarks[1].is_cold);
+
+    ostringstream text;
+    report.to_text(text);
+    CHECK(text.str().find("cold (cold)") != string::npos);
+    CHECK(text.str().find("warm (cold)") == string::npos);
+
+    ostringstream json;
+    report.to_json(json);
+    CHECK(json.str().find("\"cold\": true") != string::npos);
+    picobench::report from_json;
+    istringstream json_in(json.str());
+    REQUIRE(from_json.from_json(json_in));
+    CHECK_FALSE(from_json.suites.front().benchmarks[0].is_cold);
+    CHECK(from_json.suites.front().benchmarks[1].is_cold);
+
+    ostringstream csv;
+    report.to_csv(csv);
+    picobench::report from_csv;
+    istringstream csv_in(csv.str());
+    REQUIRE(from_csv.from_csv(csv_in));
+    CHECK(from_csv.suites.front().benchmarks[0].is_baseline);
+    CHECK_FALSE(from_csv.suites.front().benchmarks[0].is_cold);
+    CHECK(from_csv.suites.front().benchmarks[1].is_cold);
+
+    // cold from the command line applies to all benchmarks
+    local_runner r2;
+    r2.set_default_state_iterations({ 1 });
+    r2.set_default_samples(1);
+    r2.add_benchmark("a", func);
+    const char* cmd_line2[] = { "", "--cold" };
+    CHECK(r2.parse_cmd_line(cntof(cmd_line2), cmd_line2));
+    CHECK(r2.cold_data());
+    CHECK_FALSE(r2.cold_instructions());
+    r2.run_benchmarks();
+    CHECK(r2.generate_report().suites.front().benchmarks.front().is_cold);
+
+    // only the instruction cache is evicted for a benchmark which asks for that alone
+    local_runner r3;
+    r3.set_default_state_iterations({ 1 });
+    r3.set_default_samples(1);
+    auto& icache = r3.add_benchmark("icache", func).cold(false, true);
+    auto& both = r3.add_benchmark("both", func).cold(true, true);
+    CHECK_FALSE(r3.cold_data(icache));
+    CHECK(r3.cold_instructions(icache));
+    CHECK(r3.cold_data(both));
+    CHECK(r3.cold_instructions(both));
+    r3.run_benchmarks();
+    CHECK(r3.generate_report().suites.front().benchmarks.front().is_cold);
+    r3.set_cold(true);
+    CHECK(r3.cold_data(icache));
+}
+
+TEST_CASE("[picobench] machine profile")
+{
+    local_runner r;
+    const char* cmd_line[] = { "", "--machine-profile" };
+    CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+    CHECK(r.profile_machine());
+    CHECK(r.machine_profile().empty());
+
+    picobench::report report;
+    report.suites.resize(1);
+    report.suites[0].name = nullptr;
+    picobench::report::benchmark_problem_space d;
+    d.dimension = 1;
+    d.samples = 1;
+    d.total_time_ns = 10;
+    report.suites[0].benchmarks.push_back({ "a", true, { d }, false, false });
+    report.machine_profile.push_back({ "timer_cost_ns", 20.5 });
+    report.machine_profile.push_back({ "latency_l1_ns", 1.25 });
+
+    REQUIRE(report.find_machine_metric("latency_l1_ns"));
+    CHECK(report.find_machine_metric("latency_l1_ns")->value == 1.25);
+    CHECK(!report.find_machine_metric("latency_l2_ns"));
+
+    ostringstream text;
+    report.to_text(text);
+    CHECK(text.str().find(
+        "## Machine profile:\n\n"
+        " Metric                   |         Value\n"
+        "--------------------------|-------------:\n"
+        " timer_cost_ns            |        20.500\n"
+        " latency_l1_ns            |         1.250\n") != string::npos);
+
+    ostringstream json;
+    report.to_json(json);
+    CHECK(json.str().find("\"machine_profile\": {\"timer_cost_ns\": 20.5, \"latency_l1_ns\": 1.25},") != string::npos);
+
+    picobench::report loaded;
+    istringstream json_in(json.str());
+    REQUIRE(loaded.from_json(json_in));
+    REQUIRE(loaded.machine_profile.size() == 2);
+    CHECK(string(loaded.machine_profile[0].name) == "timer_cost_ns");
+    CHECK(loaded.machine_profile[0].value == 20.5);
+    CHECK(loaded.machine_profile[1].value == 1.25);
+
+    // merging keeps the metrics of the first report
+    picobench::report merged;
+    merged.machine_profile.push_back({ "timer_cost_ns", 30 });
+    merged.merge(loaded);
+    REQUIRE(merged.machine_profile.size() == 2);
+    CHECK(merged.machine_profile[0].value == 30);
+    CHECK(merged.machine_profile[1].value == 1.25);
+}
+
+TEST_CASE("[picobench] environment")
+{
+    local_runner r;
+    r.set_default_state_iterations({ 1 });
+    r.set_default_samples(1);
+    r.add_benchmark("a", [](state& s) { s.add_custom_duration(1); });
+
+    const char* cmd_line[] = { "", "--strict" };
+    CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+    CHECK(r.strict());
+    CHECK(r.capture_environment());
+
+    r.run_benchmarks();
+    auto report = r.generate_report();
+    REQUIRE(report.find_environment("picobench_version"));
+    CHECK(*report.find_environment("picobench_version") == PICOBENCH_VERSION_STR);
+    REQUIRE(report.find_environment("compiler"));
+    CHECK(*report.find_environment("compiler") == environment_info::compiler());
+    REQUIRE(report.find_environment("optimized"));
+    CHECK(report.find_environment("cores"));
+    CHECK(!report.find_environment("asdf"));
+    CHECK(report.environment == r.environment());
+
+    ostringstream json;
+    report.to_json(json);
+    picobench::report loaded;
+    istringstream json_in(json.str());
+    REQUIRE(loaded.from_json(json_in));
+    CHECK(loaded.environment == report.environment);
+
+    environment_info::entries quiet = {
+        { "governor", "performance" },
+        { "turbo", "off" },
+        { "loadavg", "0.05 0.10 0.20" },
+        { "optimized", "yes" },
+    };
+    CHECK(environment_info::problems(quiet).empty());
+
+    environment_info::entries noisy = {
+        { "governor", "powersave" },
+        { "turbo", "on" },
+        { "loadavg", "2.50 1.00 0.50" },
+        { "optimized", "no" },
+    };
+    auto problems = environment_info::problems(noisy);
+    REQUIRE(problems.size() == 4);
+    CHECK(problems[0] == "The CPU frequency scaling governor is `powersave` instead of `performance`");
+    CHECK(problems[1] == "Turbo boost is on");
+    CHECK(problems[2] == "The load average is 2.50 1.00 0.50");
+    CHECK(problems[3] == "The benchmarks are built without optimizations");
+
+    // in strict mode run refuses to run in a noisy environment
+    ostringstream sout, serr;
+    r.set_output_streams(sout, serr);
+    r.set_environment(noisy);
+    CHECK(r.run() == error_noisy_environment);
+    CHECK(serr.str() ==
+        "Error: The CPU frequency scaling governor is `powersave` instead of `performance`. Refusing to run in strict mode.\n"
+        "Error: Turbo boost is on. Refusing to run in strict mode.\n"
+        "Error: The load average is 2.50 1.00 0.50. Refusing to run in strict mode.\n"
+        "Error: The benchmarks are built without optimizations. Refusing to run in strict mode.\n");
+
+    // not in strict mode it only warns
+    r.set_strict(false);
+    ostringstream sout2, serr2;
+    r.set_output_streams(sout2, serr2);
+    r.set_error(no_error);
+    CHECK(r.run() == 0);
+    CHECK(serr2.str().find("Warning: Turbo boost is on. Results may be noisy.\n") != string::npos);
+    CHECK(r.environment() == noisy);
+
+    // a quiet environment passes in strict mode and is the one in the report
+    r.set_strict(true);
+    ostringstream sout3, serr3;
+    r.set_output_streams(sout3, serr3);
+    r.set_environment(quiet);
+    CHECK(r.run() == 0);
+    CHECK(serr3.str().empty());
+    CHECK(r.generate_report().environment == quiet);
+
+    // no capture and no checks
+    r.set_capture_environment(false);
+    r.set_strict(true);
+    CHECK(r.run() == 0);
+    CHECK(r.generate_report().environment.empty());
+}
+
+vector<int64_t> probe_durations;
+size_t probe_index;
+int probe_runs;
+
+TEST_CASE("[picobench] probe")
+{
+    auto probe = [](state& s)
+    {
+        auto i = probe_index++;
+        s.add_custom_duration(i < probe_durations.size() ? probe_durations[i] : 100);
+    };
+
+    auto func = [](state& s)
+    {
+        ++probe_runs;
+        s.add_custom_duration(s.iterations());
+    };
+
+    // 15 probes for calibration and one before the first sample
+    probe_durations.assign(16, 100);
+    probe_durations.push_back(500); // after the first sample
+
+    {
+        local_runner r;
+        r.set_default_state_iterations({ 10 });
+        r.set_default_samples(4);
+        r.set_probe_proc(probe);
+        r.add_benchmark("a", func);
+
+        const char* cmd_line[] = { "", "--probe-threshold=2" };
+        CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(r.probe());
+        CHECK(r.probe_threshold() == 2);
+        CHECK(r.probe_max_retries() == 2);
+
+        probe_index = 0;
+        probe_runs = 0;
+        r.run_benchmarks();
+        auto report = r.generate_report();
+
+        // the first sample is run again twice: after the disturbed probe and after the
+        // one which follows it
+        CHECK(probe_runs == 6);
+        CHECK(report.probe_reference_ns == 100);
+        CHECK(report.probe_threshold == 2);
+        REQUIRE(report.probe_timeline.size() == 7);
+        CHECK(report.probe_timeline[1].duration_ns == 500);
+        CHECK(report.probe_timeline[1].disturbed);
+        CHECK(std::count_if(report.probe_timeline.begin(), report.probe_timeline.end(),
+            [](const picobench::report::probe_sample& ps) { return ps.disturbed; }) == 1);
+
+        auto& d = report.suites.front().benchmarks.front().data.front();
+        CHECK(d.samples == 4);
+        CHECK(d.suspect_samples == 0);
+    }
+
+    {
+        local_runner r;
+        r.set_default_state_iterations({ 10 });
+        r.set_default_samples(4);
+        r.set_probe_proc(probe);
+        r.add_benchmark("a", func);
+
+        const char* cmd_line[] = { "", "--probe-retries=0" };
+        CHECK(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+        CHECK(r.probe());
+        CHECK(r.probe_threshold() == 1.5);
+        CHECK(r.probe_max_retries() == 0);
+
+        probe_index = 0;
+        probe_runs = 0;
+        r.run_benchmarks();
+        auto report = r.generate_report();
+
+        // without retries the samples on both sides of the disturbed probe are suspect
+        CHECK(probe_runs == 4);
+        CHECK(report.probe_timeline.size() == 5);
+        auto& d = report.suites.front().benchmarks.front().data.front();
+        CHECK(d.suspect_samples == 2);
+
+        ostringstream text;
+        report.to_text(text);
+        CHECK(text.str().find(
+            "## Interference probe:\n\n"
+            "5 probes with a typical time of 100 ns, 1 disturbed (slower than 1.50x)\n"
+            " * disturbed from 0.000s to 0.000s (1 probes)\n"
+            " * suspect samples of a @10: 2 of 4\n") != string::npos);
+
+        ostringstream json;
+        report.to_json(json);
+        CHECK(json.str().find("\"suspect_samples\": 2}") != string::npos);
+        CHECK(json.str().find("\"probe\": {\"reference_ns\": 100, \"threshold\": 1.5, \"timeline\": [[0, 100, 0], [0, 500, 1], [0, 100, 0], ") != string::npos);
+
+        picobench::report loaded;
+        istringstream json_in(json.str());
+        REQUIRE(loaded.from_json(json_in));
+        CHECK(loaded.probe_reference_ns == 100);
+        CHECK(loaded.probe_threshold == 1.5);
+        REQUIRE(loaded.probe_timeline.size() == 5);
+        CHECK(loaded.probe_timeline[1].duration_ns == 500);
+        CHECK(loaded.probe_timeline[1].disturbed);
+        CHECK(!loaded.probe_timeline[2].disturbed);
+        CHECK(loaded.suites.front().benchmarks.front().data.front().suspect_samples == 2);
+    }
+
+    local_runner r;
+    ostringstream sout, serr;
+    r.set_output_streams(sout, serr);
+    const char* bad_cmd_line[] = { "", "--probe-threshold=0.5" };
+    CHECK(!r.parse_cmd_line(cntof(bad_cmd_line), bad_cmd_line));
+    CHECK(serr.str() == "Error: Bad command-line argument: --probe-threshold=0.5\n");
+}
+
+TEST_CASE("[picobench] counters")
+{
+    local_runner r;
+    r.set_default_state_iterations({ 10, 20 });
+    r.set_default_samples(2);
+    r.add_benchmark("c", [](state& s)
+    {
+        // the second sample of each dimension is faster
+        static map<int, int> samples;
+        auto i = samples[s.iterations()]++ % 2;
+        s.add_custom_duration(s.iterations() * (2 - i));
+        s.set_counter("bytes", s.iterations() * 10.0 + i);
+        s.set_counter("bytes", s.iterations() * 100.0 + i); // overwrites
+        s.set_counter("rss_kb", 1.5);
+    });
+    r.add_benchmark("no_counters", [](state& s) { s.add_custom_duration(s.iterations()); });
+
+    r.run_benchmarks();
+    auto report = r.generate_report();
+
+    auto& c = report.suites.front().benchmarks[0];
+    REQUIRE(c.data.size() == 2);
+    REQUIRE(c.data[0].counters.size() == 2);
+    CHECK(string(c.data[0].counters[0].first) == "bytes");
+    CHECK(c.data[0].counters[0].second == 1001);
+    CHECK(c.data[1].counters[0].second == 2001);
+    CHECK(c.data[1].counters[1].second == 1.5);
+    CHECK(report.suites.front().benchmarks[1].data[0].counters.empty());
+
+    ostringstream text;
+    report.to_text(text);
+    CHECK(text.str().find(
+        " Name (counters)          |   Dim   |       bytes |      rss_kb |\n"
+        "--------------------------|--------:|------------:|------------:|\n"
+        " c                        |      10 |    1001.000 |       1.500 |\n"
+        " c                        |      20 |    2001.000 |       1.500 |\n") != string::npos);
+
+    ostringstream json;
+    report.to_json(json);
+    CHECK(json.str().find("\"counters\": {\"bytes\": 1001, \"rss_kb\": 1.5}}") != string::npos);
+
+    picobench::report loaded;
+    istringstream json_in(json.str());
+    REQUIRE(loaded.from_json(json_in));
+    auto& lc = loaded.suites.front().benchmarks[0];
+    REQUIRE(lc.data[1].counters.size() == 2);
+    CHECK(string(lc.data[1].counters[1].first) == "rss_kb");
+    CHECK(lc.data[1].counters[0].second == 2001);
+
+    // merged reports own the counter names
+    picobench::report merged;
+    {
+        picobench::report tmp;
+        istringstream tmp_in(json.str());
+        REQUIRE(tmp.from_json(tmp_in));
+        merged.merge(tmp);
+    }
+    CHECK(string(merged.suites.front().benchmarks[0].data[0].counters[0].first) == "bytes");
+}
+
+TEST_CASE("[picobench] worker")
+{
+    local_runner r;
+    r.set_default_state_iterations({ 10, 20 });
+    r.add_benchmark("w", [](state& s)
+    {
+        s.add_custom_duration(s.iterations() * 3);
+        s.set_result(s.iterations() + 1);
+        s.set_counter("bytes", 2.5);
+    });
+    r.set_suite("other");
+    r.add_benchmark("v", [](state& s) { s.add_custom_duration(7); }).iterations({ 5 });
+
+    ostringstream sout, serr;
+    r.set_output_streams(sout, serr);
+    const char* cmd_line[] = { "", "--worker" };
+    REQUIRE(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+    CHECK(r.worker());
+
+    istringstream in("run 0 20\nrun 1 4\nrun 2 1\nbad\nquit\nrun 0 10\n");
+    CHECK(r.run_worker(in, sout) == 0);
+    CHECK(sout.str() ==
+        "benchmark\t0\t\tw\t10,20\n"
+        "benchmark\t1\tother\tv\t5\n"
+        "ready\n"
+        "sample\t60\t21\tbytes=2.5\n"
+        "sample\t7\t0\n"
+        "error\tBad request: run 2 1\n"
+        "error\tBad request: bad\n");
+    CHECK(serr.str().empty());
+}
+
+TEST_CASE("[picobench] groups")
+{
+    local_runner r;
+    r.set_default_state_iterations({ 10 });
+    r.set_default_samples(1);
+    r.set_capture_environment(false);
+    r.set_suite("s");
+    r.add_benchmark("x", [](state& s) { s.add_custom_duration(s.iterations() * 2); });
+    r.run_benchmarks();
+    auto rpt = r.generate_report();
+    CHECK(!rpt.suites.front().group);
+
+    // the same suite in two executables
+    picobench::report merged;
+    for (auto group : { "exe1", "exe2" })
+    {
+        auto g = rpt;
+        g.suites.front().group = g.store_string(group);
+        merged.merge(g);
+    }
+    REQUIRE(merged.suites.size() == 2);
+    CHECK(string(merged.suites[1].group) == "exe2");
+    CHECK(merged.find_suite("s", "exe2") == &merged.suites[1]);
+    CHECK(!merged.find_suite("s", nullptr));
+
+    ostringstream text;
+    merged.to_text_concise(text);
+    CHECK(text.str().find("# exe1:\n\n## s:\n") == 0);
+    CHECK(text.str().find("# exe2:\n\n## s:\n") != string::npos);
+
+    ostringstream csv;
+    merged.to_csv(csv, false);
+    CHECK(csv.str() == "\"exe1/s\",\"x\",*,10,1,20,0,2.000,1.000\n\"exe2/s\",\"x\",*,10,1,20,0,2.000,1.000\n");
+
+    ostringstream json;
+    merged.to_json(json);
+    CHECK(json.str().find("\"group\": \"exe2\",\n      \"name\": \"s\"") != string::npos);
+    picobench::report loaded;
+    istringstream json_in(json.str());
+    REQUIRE(loaded.from_json(json_in));
+    REQUIRE(loaded.suites.size() == 2);
+    CHECK(string(loaded.suites[0].group) == "exe1");
+    CHECK(loaded.find_suite("s", "exe2") == &loaded.suites[1]);
+}
+
+TEST_CASE("[picobench] modules")
+{
+    // the registry of a plugin
+    registry plugin;
+    plugin.set_suite("s");
+    plugin.add_benchmark("a", [](state& s) { s.add_custom_duration(s.iterations() * 4); });
+    plugin.add_benchmark("b", [](state& s) { s.add_custom_duration(s.iterations() * 2); });
+
+    local_runner r;
+    r.set_default_state_iterations({ 10 });
+    r.set_default_samples(2);
+    r.set_paired(true);
+    r.set_suite("s");
+    r.add_benchmark("a", [](state& s) { s.add_custom_duration(s.iterations()); });
+    r.add_module(plugin, "plugin");
+
+    ostringstream sout, serr;
+    r.set_output_streams(sout, serr);
+    const char* cmd_line[] = { "", "--list" };
+    REQUIRE(r.parse_cmd_line(cntof(cmd_line), cmd_line));
+    CHECK(sout.str() ==
+        "  s:\n"
+        "    a\n"
+        "  plugin/s:\n"
+        "    a\n"
+        "    b\n");
+
+    r.set_should_run(true);
+    r.run_benchmarks();
+    auto report = r.generate_report();
+    REQUIRE(report.suites.size() == 2);
+    CHECK(!report.suites[0].group);
+    auto ps = report.find_suite("s", "plugin");
+    REQUIRE(ps);
+    CHECK(ps->benchmarks.size() == 2);
+
+    // the suites with the same name are paired separately
+    auto& b = ps->benchmarks[1];
+    CHECK(b.data.front().pairs == 2);
+    CHECK(b.data.front().pair_ratio_median == 0.5);
+    CHECK(report.suites[0].benchmarks.front().data.front().samples == 2);
+}
+
+vector<int64_t> open_loop_attempts;
+
+TEST_CASE("[picobench] open loop")
+{
+    latency_histogram h;
+    for (int64_t i = 1; i <= 100; ++i) h.record(i * 1000);
+    CHECK(h.count() == 100);
+    CHECK(h.max() == 100000);
+    CHECK(h.percentile(100) == 100000);
+    // within the precision of the buckets
+    CHECK(h.percentile(50) >= 50000);
+    CHECK(h.percentile(50) < 50000 * 33 / 32);
+    h.clear();
+    h.record(7);
+    CHECK(h.percentile(50) == 7);
+
+    vector<int64_t> schedule;
+    make_open_loop_schedule(schedule, 4, arrivals::constant, 0);
+    CHECK(schedule == vector<int64_t>({ 0, 250000000, 500000000, 750000000 }));
+    make_open_loop_schedule(schedule, 100, arrivals::poisson, 3);
+    CHECK(schedule.front() == 0);
+    CHECK(is_sorted(schedule.begin(), schedule.end()));
+    CHECK(schedule.back() < 1000000000);
+    vector<int64_t> same, other;
+    make_open_loop_schedule(other, 100, arrivals::poisson, 4);
+    make_open_loop_schedule(same, 100, arrivals::poisson, 3);
+    CHECK(same == schedule);
+    CHECK(other != schedule);
+
+    // the poisson schedules depend only on the seed of the run
+    auto poisson_times = [](int seed)
+    {
+        local_runner pr;
+        pr.set_default_state_iterations({ 10, 20 });
+        pr.set_default_samples(2);
+        pr.add_benchmark("p", [](state& s) { s.open_loop([]() { test::this_thread_sleep_for_ns(1000); }, arrivals::poisson); });
+        pr.run_benchmarks(seed);
+        auto rpt = pr.generate_report();
+        vector<int64_t> times;
+        for (auto& d : rpt.suites[0].benchmarks[0].data) times.push_back(d.total_time_ns);
+        return times;
+    };
+    auto times = poisson_times(5);
+    CHECK(poisson_times(5) == times);
+    CHECK(poisson_times(6) != times);
+
+    // a sample which is run again after a disturbed probe has the same schedule
+    {
+        local_runner pr;
+        pr.set_default_state_iterations({ 10 });
+        pr.set_default_samples(1);
+        pr.set_probe(true);
+        pr.set_probe_proc([](state& s)
+        {
+            auto i = probe_index++;
+            s.add_custom_duration(i < probe_durations.size() ? probe_durations[i] : 100);
+        });
+        pr.add_benchmark("p", [](state& s)
+        {
+            s.open_loop([]() { test::this_thread_sleep_for_ns(1000); }, arrivals::poisson);
+            open_loop_attempts.push_back(s.duration_ns());
+        });
+
+        // 15 probes for calibration, one before the sample and a disturbed one after it
+        probe_durations.assign(16, 100);
+        probe_durations.push_back(500);
+        probe_index = 0;
+        open_loop_attempts.clear();
+        pr.run_benchmarks(5);
+        REQUIRE(open_loop_attempts.size() == 3);
+        CHECK(open_loop_attempts[1] == open_loop_attempts[0]);
+        CHECK(open_loop_attempts[2] == open_loop_attempts[0]);
+    }
+
+    local_runner r;
+    r.set_default_state_iterations({ 10, 10000 });
+    r.set_default_samples(1);
+    r.add_benchmark("ol", [](state& s)
+    {
+        // 1 ms per operation: up to 1000 per second
+        s.open_loop([]() { test::this_thread_sleep_for_ns(1000000); });
+    });
+    r.run_benchmarks();
+    auto report = r.generate_report();
+
+    auto& bm = report.suites.front().benchmarks.front();
+    REQUIRE(bm.data.size() == 2);
+    // the last operation ends 1 ms after its start at 900 ms
+    CHECK(bm.data[0].total_time_ns == 901000000);
+    CHECK(bm.data[0].counters[1].second == 1000000); // lat_p50_ns
+    // operation i is done at (i + 1) ms and intended at i * 0.1 ms
+    CHECK(bm.data[1].total_time_ns == 10000000000ll);
+    CHECK(string(bm.data[1].counters[5].first) == "lat_max_ns");
+    CHECK(bm.data[1].counters[5].second == 9000100000.0);
+
+    picobench::report::saturation_point sp;
+    REQUIRE(picobench::report::find_saturation(bm, sp));
+    CHECK(sp.target_rate == 10000);
+    CHECK(sp.achieved_rate == 1000);
+
+    ostringstream text;
+    report.to_text(text);
+    CHECK(text.str().find(" ol saturates at 1000.0 ops/second (target 10000 was not reached)\n") != string::npos);
+
+    ostringstream json;
+    report.to_json(json);
+    CHECK(json.str().find("\"saturation\": {\"target_rate\": 10000, \"achieved_rate\": 1000},") != string::npos);
+}
+
+TEST_CASE("[picobench] roles")
+{
+    local_runner r;
+    r.set_default_state_iterations({ 100 });
+    r.set_default_samples(1);
+    r.add_benchmark("queue", [](state& s)
+    {
+        CHECK(s.param("consumer") == 2);
+        CHECK(s.param("other", 5) == 5);
+
+        atomic<int> items(0);
+        roles rl(s);
+        rl.add("producer", [&](state& ps) {
+            CHECK(ps.param("consumer") == 2);
+            for (auto _ : ps)
+            {
+                test::this_thread_sleep_for_ns(10);
+                ++items;
+            }
+        });
+        rl.add_until_stopped("consumer", [&](state& cs) {
+            int64_t n = 0;
+            // the items which are left after the stop are taken too
+            while (!cs.stop_requested() || items.load() > 0)
+            {
+                auto i = items.load();
+                if (i > 0 && items.compare_exchange_weak(i, i - 1)) ++n;
+            }
+            cs.set_operations(n);
+            cs.set_counter("popped", double(n));
+            cs.set_result(result_t(n));
+        });
+        rl.run();
+    })
+    .param("producer", { 1, 2 })
+    .param("consumer", { 2 });
+
+    r.run_benchmarks();
+    auto report = r.generate_report();
+
+    auto& bms = report.suites.front().benchmarks;
+    REQUIRE(bms.size() == 2);
+    CHECK(string(bms[0].name) == "queue [producer=1] [consumer=2]");
+    CHECK(string(bms[1].name) == "queue [producer=2] [consumer=2]");
+
+    for (int p = 1; p <= 2; ++p)
+    {
+        auto& d = bms[p - 1].data.front();
+        // the time passes only in the producers
+        CHECK(d.total_time_ns == p * 1000);
+        CHECK(d.result == p * 100);
+        REQUIRE(d.counters.size() == 5);
+        CHECK(string(d.counters[0].first) == "producer_ops_per_sec");
+        CHECK(d.counters[0].second == 1e8);
+        CHECK(string(d.counters[1].first) == "producer_ns_per_op");
+        CHECK(d.counters[1].second > 0);
+        CHECK(string(d.counters[2].first) == "consumer_ops_per_sec");
+        CHECK(d.counters[2].second == 1e8);
+        CHECK(string(d.counters[4].first) == "consumer_popped");
+        CHECK(d.counters[4].second == p * 100);
+    }
+}
+
+TEST_CASE("[picobench] placement")
+{
+    vector<int> list;
+    CHECK(cpu_topology::parse_cpu_list("0-3,8,10-11", list));
+    CHECK(list == vector<int>({ 0, 1, 2, 3, 8, 10, 11 }));
+    CHECK(cpu_topology::cpu_list_to_string(list) == "0-3,8,10-11");
+    CHECK(cpu_topology::cpu_list_to_string({ 3, 1, 2 }) == "3,1-2");
+    CHECK_FALSE(cpu_topology::parse_cpu_list("1-", list));
+    CHECK_FALSE(cpu_topology::parse_cpu_list("3-1", list));
+
+    CHECK(cpu_topology::valid_placement("scatter"));
+    CHECK(cpu_topology::valid_placement("compact:atom"));
+    CHECK(cpu_topology::valid_placement("0,2,4-7"));
+    CHECK_FALSE(cpu_topology::valid_placement("bogus"));
+    CHECK_FALSE(cpu_topology::valid_placement("compact:"));
+
+    // 2 numa nodes with a last level cache, 2 cores and 2 SMT siblings per core
+    // the sibling of cpu i is i + 4 and the cores of the second node are atoms
+    cpu_topology t;
+    for (int id = 0; id < 8; ++id)
+    {
+        int node = id % 4 < 2 ? 0 : 1;
+        t.cpus.push_back({ id, id % 4, node * 2, node, node });
+    }
+    t.types = { "core", "atom" };
+
+    vector<int> cpus;
+    CHECK(t.place("compact", 5, cpus));
+    CHECK(cpus == vector<int>({ 0, 1, 4, 5, 2 }));
+    CHECK(t.place("smt", 3, cpus));
+    CHECK(cpus == vector<int>({ 0, 4, 1 }));
+    CHECK(t.place("scatter", 4, cpus));
+    CHECK(cpus == vector<int>({ 0, 2, 1, 3 }));
+    CHECK(t.place("l3", 6, cpus));
+    CHECK(cpus == vector<int>({ 0, 1, 4, 5, 0, 1 }));
+    CHECK(t.place("node", 3, cpus));
+    CHECK(cpus == vector<int>({ 0, 2, 1 }));
+    CHECK(t.place("compact:atom", 2, cpus));
+    CHECK(cpus == vector<int>({ 2, 3 }));
+    CHECK(t.place("3,5-6", 4, cpus));
+    CHECK(cpus == vector<int>({ 3, 5, 6, 3 }));
+    CHECK_FALSE(t.place("compact:big", 2, cpus));
+
+    // the placement is in the report
+    auto& topology = cpu_topology::get();
+    auto spec = topology.cpus.empty() ? string("0") : to_string(topology.cpus.front().id);
+
+    local_runner r;
+    r.set_default_state_iterations({ 10 });
+    r.set_default_samples(1);
+    r.set_placement(spec.c_str());
+    r.add_benchmark("placed", [](state& s)
+    {
+        roles rl(s);
+        rl.add("a", 2, [](state& as) { for (auto _ : as) test::this_thread_sleep_for_ns(1); });
+        rl.add("b", [](state& bs) { for (auto _ : bs) test::this_thread_sleep_for_ns(1); });
+        rl.run();
+    });
+    r.add_benchmark("unplaced", [](state& s) { s.add_custom_duration(s.iterations()); });
+    r.run_benchmarks();
+    auto report = r.generate_report();
+
+    auto& bms = report.suites.front().benchmarks;
+    auto expected = topology.cpus.empty() ?
+        spec + " (not applied)" :
+        spec + ": a " + spec + ',' + spec + "; b " + spec;
+    REQUIRE(bms[0].data.front().placement);
+    CHECK(bms[0].data.front().placement == expected);
+    CHECK_FALSE(bms[1].data.front().placement);
+
+    ostringstream text;
+    report.to_text(text);
+    CHECK(text.str().find(" placed                   |      10 | " + expected + '\n') != string::npos);
+
+    ostringstream json;
+    report.to_json(json);
+    picobench::report loaded;
+    istringstream json_in(json.str());
+    REQUIRE(loaded.from_json(json_in));
+    REQUIRE(loaded.suites.front().benchmarks[0].data.front().placement);
+    CHECK(loaded.suites.front().benchmarks[0].data.front().placement == expected);
+    CHECK_FALSE(loaded.suites.front().benchmarks[1].data.front().placement);
+}
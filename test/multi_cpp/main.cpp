@@ -22,7 +22,7 @@ TEST_CASE("[picobench] multi cpp test")
     using namespace pb;
     runner r;
 
-    const vector<int> iters = { 100, 2000, 5000 };
+    const vector<int64_t> iters = { 100, 2000, 5000 };
     r.set_default_state_iterations(iters);
 
     const int samples = 13;
@@ -0,0 +1,335 @@
+// picobench-ab
+// compares several builds of the same benchmark executable (for example with different
+// compiler flags or library versions) by running their samples alternately
+// the executables are started in worker mode (-worker) and the samples are requested from
+// them one at a time, so that drifts of the machine affect all of them in the same way
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+
+#if defined(_WIN32)
+#error "picobench-ab is not supported on Windows"
+#endif
+
+#include <spawn.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define PICOBENCH_IMPLEMENT
+#include "picobench/picobench.hpp"
+
+using namespace picobench;
+using namespace std;
+
+extern char** environ;
+
+struct worker
+{
+    string path;
+    const char* label;
+    pid_t pid;
+    FILE* in; // requests
+    FILE* out; // replies
+};
+
+vector<worker> workers;
+
+// a benchmark of a worker
+struct remote_benchmark
+{
+    size_t worker;
+    size_t index; // in the worker
+};
+
+vector<remote_benchmark> remote;
+
+// stable storage for the names given to the runner and the report
+deque<string> names;
+set<string> counter_names;
+
+static void split(const string& line, char sep, vector<string>& fields)
+{
+    fields.clear();
+    size_t begin = 0;
+    while (true)
+    {
+        auto end = line.find(sep, begin);
+        fields.push_back(line.substr(begin, end == string::npos ? string::npos : end - begin));
+        if (end == string::npos) break;
+        begin = end + 1;
+    }
+}
+
+static bool read_line(worker& w, string& line)
+{
+    line.clear();
+    int c;
+    while ((c = getc(w.out)) != EOF)
+    {
+        if (c == '\n') return true;
+        line += char(c);
+    }
+    return false;
+}
+
+bool start_worker(worker& w, const vector<string>& args)
+{
+    // both ends are close-on-exec, dup2 clears the flag of the worker's standard handles
+    int to_worker[2], from_worker[2];
+    if (pipe(to_worker) != 0) return false;
+    if (pipe(from_worker) != 0)
+    {
+        close(to_worker[0]);
+        close(to_worker[1]);
+        return false;
+    }
+    for (auto fd : { to_worker[0], to_worker[1], from_worker[0], from_worker[1] })
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    vector<char*> argv;
+    argv.push_back(const_cast<char*>(w.path.c_str()));
+    for (auto& a : args)
+    {
+        argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, to_worker[0], 0);
+    posix_spawn_file_actions_adddup2(&actions, from_worker[1], 1);
+
+    auto err = posix_spawnp(&w.pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    close(to_worker[0]);
+    close(from_worker[1]);
+    if (err != 0)
+    {
+        close(to_worker[1]);
+        close(from_worker[0]);
+        return false;
+    }
+
+    w.in = fdopen(to_worker[1], "w");
+    w.out = fdopen(from_worker[0], "r");
+    return true;
+}
+
+void stop_worker(worker& w)
+{
+    fputs("quit\n", w.in);
+    fclose(w.in);
+    fclose(w.out);
+    int status;
+    while (waitpid(w.pid, &status, 0) == -1 && errno == EINTR);
+}
+
+// runs a sample of a benchmark in its worker
+// the time and result of the sample are the ones measured by the worker
+void sample_proc(state& s)
+{
+    auto& rb = remote[s.user_data()];
+    auto& w = workers[rb.worker];
+
+    fprintf(w.in, "run %d %lld\n", int(rb.index), static_cast<long long>(s.iterations()));
+    fflush(w.in);
+
+    string line;
+    vector<string> fields;
+    if (!read_line(w, line))
+    {
+        cerr << "Error: " << w.path << " stopped\n";
+        exit(1);
+    }
+    split(line, '\t', fields);
+    if (fields.size() < 3 || fields[0] != "sample")
+    {
+        cerr << "Error: " << w.path << ": " << line << "\n";
+        exit(1);
+    }
+
+    s.add_custom_duration(strtoll(fields[1].c_str(), nullptr, 10));
+    s.set_result(result_t(strtoll(fields[2].c_str(), nullptr, 10)));
+    for (size_t i = 3; i < fields.size(); ++i)
+    {
+        auto eq = fields[i].find('=');
+        if (eq == string::npos) continue;
+        auto name = counter_names.insert(fields[i].substr(0, eq)).first->c_str();
+        s.set_counter(name, strtod(fields[i].c_str() + eq + 1, nullptr));
+    }
+}
+
+// the benchmarks of a worker as listed in its handshake
+struct listed_benchmark
+{
+    string suite;
+    string name;
+    vector<int64_t> iterations;
+    size_t index;
+};
+
+bool read_benchmarks(worker& w, vector<listed_benchmark>& list)
+{
+    string line;
+    vector<string> fields;
+    while (read_line(w, line))
+    {
+        if (line == "ready") return true;
+
+        split(line, '\t', fields);
+        if (fields.size() != 5 || fields[0] != "benchmark") break;
+
+        listed_benchmark lb;
+        lb.index = size_t(strtoul(fields[1].c_str(), nullptr, 10));
+        lb.suite = fields[2];
+        lb.name = fields[3];
+        vector<string> iters;
+        split(fields[4], ',', iters);
+        for (auto& i : iters)
+        {
+            lb.iterations.push_back(strtoll(i.c_str(), nullptr, 10));
+        }
+        list.push_back(lb);
+    }
+
+    cerr << "Error: " << w.path << " is not a picobench executable which supports -worker\n";
+    return false;
+}
+
+static const char* base_name(const string& path)
+{
+    auto slash = path.find_last_of('/');
+    return path.c_str() + (slash == string::npos ? 0 : slash + 1);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 1)
+    {
+        cout << "picobench-ab " PICOBENCH_VERSION_STR "\n";
+        cout << "Usage: picobench-ab [args] <executable 1> <executable 2> ... [-- <args for the executables>]\n";
+        cout << "Type 'picobench-ab --help' for help.\n";
+        return 0;
+    }
+
+    // the arguments after -- are for the workers
+    int own_argc = argc;
+    vector<string> worker_args = { "--worker" };
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--") == 0)
+        {
+            own_argc = i;
+            worker_args.insert(worker_args.end(), argv + i + 1, argv + argc);
+            break;
+        }
+    }
+
+    for (int i = 1; i < own_argc; ++i)
+    {
+        if (argv[i][0] != '-')
+        {
+            worker w = { argv[i], nullptr, 0, nullptr, nullptr };
+            workers.push_back(w);
+        }
+    }
+
+    runner r;
+    // each sample of an executable is next to a sample of the first one
+    r.set_paired(true);
+    r.parse_cmd_line(own_argc, argv);
+
+    if (!r.should_run()) return r.error();
+
+    if (workers.size() < 2)
+    {
+        cerr << "Error: At least two executables are needed\n";
+        return 1;
+    }
+
+    // the labels are the file names, unless two are the same
+    for (auto& w : workers)
+    {
+        w.label = base_name(w.path);
+        for (auto& o : workers)
+        {
+            if (&o != &w && strcmp(base_name(o.path), w.label) == 0)
+            {
+                w.label = w.path.c_str();
+                break;
+            }
+        }
+    }
+
+    // a broken pipe is reported when reading the reply
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<vector<listed_benchmark>> lists(workers.size());
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        if (!start_worker(workers[i], worker_args))
+        {
+            cerr << "Error: Cannot run " << workers[i].path << "\n";
+            return 1;
+        }
+        if (!read_benchmarks(workers[i], lists[i])) return 1;
+    }
+
+    // the benchmarks of the first executable which are in all of them become suites with a
+    // benchmark for each executable
+    // the first executable is the baseline
+    for (auto& lb : lists.front())
+    {
+        vector<size_t> indices = { lb.index };
+        for (size_t i = 1; i < lists.size(); ++i)
+        {
+            for (auto& other : lists[i])
+            {
+                if (other.suite == lb.suite && other.name == lb.name)
+                {
+                    if (other.iterations != lb.iterations)
+                    {
+                        cerr << "Warning: " << lb.name << " has different iterations in " << workers[i].path
+                             << ". Using the ones of " << workers.front().path << ".\n";
+                    }
+                    indices.push_back(other.index);
+                    break;
+                }
+            }
+        }
+
+        if (indices.size() != workers.size())
+        {
+            cerr << "Warning: " << lb.name << " is not in all executables and is skipped\n";
+            continue;
+        }
+
+        names.push_back(lb.suite.empty() ? lb.name : lb.suite + '/' + lb.name);
+        r.set_suite(names.back().c_str());
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            r.add_benchmark(workers[i].label, sample_proc)
+                .iterations(lb.iterations)
+                .user_data(remote.size());
+            remote.push_back({ i, indices[i] });
+        }
+    }
+
+    auto ret = r.run();
+
+    for (auto& w : workers)
+    {
+        stop_worker(w);
+    }
+
+    return ret;
+}
@@ -0,0 +1,102 @@
+// picobench-load
+// loads plugins (shared objects with benchmarks built with PICOBENCH_IMPLEMENT_PLUGIN) and runs
+// all of their benchmarks in a single run
+// the suites of each plugin are in a group named after it
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#define PICOBENCH_IMPLEMENT
+#include "picobench/picobench.hpp"
+
+using namespace picobench;
+using namespace std;
+
+// the plugins are never unloaded, since the runner and the report use their names and functions
+#if defined(_WIN32)
+static void* load_symbol(const char* path, const char* symbol)
+{
+    static_assert(sizeof(FARPROC) == sizeof(void*), "function pointers should fit in void*");
+    auto module = LoadLibraryA(path);
+    if (!module)
+    {
+        cerr << "Error: Cannot load " << path << "\n";
+        return nullptr;
+    }
+    auto sym = reinterpret_cast<void*>(GetProcAddress(module, symbol));
+    if (!sym) cerr << "Error: " << path << " is not a picobench plugin\n";
+    return sym;
+}
+#else
+static void* load_symbol(const char* path, const char* symbol)
+{
+    // local, so that the symbols of one plugin are not used by another
+    auto module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!module)
+    {
+        cerr << "Error: Cannot load " << path << ": " << dlerror() << "\n";
+        return nullptr;
+    }
+    auto sym = dlsym(module, symbol);
+    if (!sym) cerr << "Error: " << path << " is not a picobench plugin\n";
+    return sym;
+}
+#endif
+
+static const char* base_name(const char* path)
+{
+    auto slash = strrchr(path, '/');
+#if defined(_WIN32)
+    auto backslash = strrchr(path, '\\');
+    if (backslash > slash) slash = backslash;
+#endif
+    return slash ? slash + 1 : path;
+}
+
+bool load_plugin(runner& r, const char* path)
+{
+    auto abi = reinterpret_cast<plugin_abi_proc>(load_symbol(path, "picobench_plugin_abi"));
+    if (!abi) return false;
+
+    // the benchmarks are registered when the plugin is loaded, but they're not used before
+    // checking that the plugin has the same layout of the registry
+    if (abi() != plugin_abi())
+    {
+        cerr << "Error: " << path << " is built with a different version or configuration of picobench\n";
+        return false;
+    }
+
+    auto reg = reinterpret_cast<plugin_registry_proc>(load_symbol(path, "picobench_plugin_registry"));
+    if (!reg) return false;
+
+    r.add_module(*reg(), base_name(path));
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 1)
+    {
+        cout << "picobench-load " PICOBENCH_VERSION_STR "\n";
+        cout << "Usage: picobench-load [args] <plugin 1> ... <plugin n>\n";
+        cout << "Type 'picobench-load --help' for help.\n";
+        return 0;
+    }
+
+    runner r;
+
+    // load before parsing, so that filters and -list apply to the benchmarks of the plugins
+    for (int i = 1; i < argc; ++i)
+    {
+        if (argv[i][0] != '-' && !load_plugin(r, argv[i])) return 1;
+    }
+
+    r.parse_cmd_line(argc, argv);
+    return r.run();
+}
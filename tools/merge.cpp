@@ -0,0 +1,108 @@
+// picobench-merge
+// combines reports from several runs (typically shards of the same run) in one report
+#include <cstring>
+#include <string>
+#include <cctype>
+
+#define PICOBENCH_IMPLEMENT
+#include "picobench/picobench.hpp"
+
+using namespace picobench;
+using namespace std;
+
+// json reports start with an object, csv ones don't
+bool read_report(const char* file, report& rpt)
+{
+    ifstream fin(file);
+    if (!fin)
+    {
+        cerr << "Error: Cannot open " << file << "\n";
+        return false;
+    }
+
+    while (isspace(fin.peek())) fin.get();
+    bool ok = fin.peek() == '{' ? rpt.from_json(fin) : rpt.from_csv(fin);
+    if (!ok)
+    {
+        cerr << "Error: " << file << " is not a picobench json or csv report\n";
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 1)
+    {
+        cout << "picobench-merge " PICOBENCH_VERSION_STR "\n";
+        cout << "Usage: picobench-merge [--out-fmt=<txt|con|csv|json>] [--output=<filename>] <report 1> ... <report n>\n";
+        return 0;
+    }
+
+    report_output_format fmt = report_output_format::text;
+    const char* output = nullptr;
+
+    report merged;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--out-fmt=", 10) == 0)
+        {
+            arg += 10;
+            if (strcmp(arg, "txt") == 0) fmt = report_output_format::text;
+            else if (strcmp(arg, "con") == 0) fmt = report_output_format::concise_text;
+            else if (strcmp(arg, "csv") == 0) fmt = report_output_format::csv;
+            else if (strcmp(arg, "json") == 0) fmt = report_output_format::json;
+            else
+            {
+                cerr << "Error: Bad output format: " << arg << "\n";
+                return 1;
+            }
+        }
+        else if (strncmp(arg, "--output=", 9) == 0)
+        {
+            output = arg + 9;
+        }
+        else if (arg[0] == '-')
+        {
+            cerr << "Error: Unknown command-line argument: " << arg << "\n";
+            return 1;
+        }
+        else
+        {
+            report rpt;
+            if (!read_report(arg, rpt)) return 1;
+            merged.merge(rpt);
+        }
+    }
+
+    ostream* out = &cout;
+    ofstream fout;
+    if (output)
+    {
+        fout.open(output);
+        if (!fout)
+        {
+            cerr << "Error: Could not open output file `" << output << "`\n";
+            return 1;
+        }
+        out = &fout;
+    }
+
+    switch (fmt)
+    {
+    case report_output_format::text:
+        merged.to_text(*out);
+        break;
+    case report_output_format::concise_text:
+        merged.to_text_concise(*out);
+        break;
+    case report_output_format::csv:
+        merged.to_csv(*out);
+        break;
+    default:
+        merged.to_json(*out);
+        break;
+    }
+
+    return 0;
+}
@@ -1,4 +1,66 @@
 #include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <vector>
+
+// resources used by a single run of a command
+struct run_stats
+{
+    int exit_code; // -1 if the command could not be run
+    int64_t user_ns; // user cpu time
+    int64_t sys_ns; // system cpu time
+    int64_t max_rss_kb; // peak resident set size
+    int64_t minor_faults;
+    int64_t major_faults;
+    int64_t output_bytes; // only when the output is read
+    uint64_t output_hash; // only when the output is hashed
+};
+
+struct command
+{
+    std::string cmd;
+    std::vector<std::string> args; // cmd split to arguments (when not run through the shell)
+};
+
+// run commands through the system shell instead of parsing their arguments
+static bool use_shell = false;
+
+// what happens to the standard output of the commands
+enum class output_mode
+{
+    null, // redirected to the null device
+    drain, // read through a pipe and discarded
+    hash, // read through a pipe and hashed
+};
+static output_mode stdout_mode = output_mode::null;
+
+// FNV-1a
+static const uint64_t hash_seed = 14695981039346656037ull;
+static uint64_t hash_bytes(uint64_t hash, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= uint8_t(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// reads the output of a command from the pipe until it's closed
+template <typename Read>
+static void read_output(output_mode mode, run_stats& stats, Read read)
+{
+    char buf[65536];
+    stats.output_hash = hash_seed;
+    while (true)
+    {
+        auto n = read(buf, sizeof(buf));
+        if (n <= 0) break;
+        stats.output_bytes += n;
+        if (mode == output_mode::hash) stats.output_hash = hash_bytes(stats.output_hash, buf, size_t(n));
+    }
+}
 
 #if defined(_WIN32)
 #include <Windows.h>
@@ -9,17 +71,46 @@ void zm(T& data)
     ZeroMemory(&data, sizeof(T));
 }
 
-int exec(const char* cmd)
+static int64_t filetime_ns(const FILETIME& ft)
 {
-    const short lim = _MAX_PATH + 10;
-    char cmd_line[lim];
-    strcpy(cmd_line, "cmd /c ");
-    strncat(cmd_line, cmd, _MAX_PATH);
+    ULARGE_INTEGER li;
+    li.LowPart = ft.dwLowDateTime;
+    li.HighPart = ft.dwHighDateTime;
+    return int64_t(li.QuadPart) * 100;
+}
+
+// CreateProcess parses the arguments itself, so only the shell is optional
+// memory usage and page faults are not collected on Windows
+void exec(const command& b, output_mode mode, run_stats& stats)
+{
+    zm(stats);
+    stats.exit_code = -1;
+
+    std::string cmd_line = use_shell ? "cmd /c " + b.cmd : b.cmd;
+
+    SECURITY_ATTRIBUTES sa;
+    zm(sa);
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
 
-    STARTUPINFO s_info;
+    HANDLE out_read = nullptr, out_write = nullptr;
+    if (mode == output_mode::null)
+    {
+        out_write = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, nullptr);
+    }
+    else if (CreatePipe(&out_read, &out_write, &sa, 0))
+    {
+        // only the write end is inherited
+        SetHandleInformation(out_read, HANDLE_FLAG_INHERIT, 0);
+    }
+    if (out_write == nullptr || out_write == INVALID_HANDLE_VALUE) return;
+
+    STARTUPINFOA s_info;
     zm(s_info);
-    s_info.cb = sizeof(STARTUPINFO);
+    s_info.cb = sizeof(STARTUPINFOA);
     s_info.dwFlags = STARTF_USESTDHANDLES;
+    s_info.hStdOutput = out_write;
+    s_info.hStdError = GetStdHandle(STD_ERROR_HANDLE);
 
     PROCESS_INFORMATION proc_info;
     zm(proc_info);
@@ -36,39 +127,154 @@ int exec(const char* cmd)
         &s_info,
         &proc_info);
 
-    if (!success) return -1;
+    CloseHandle(out_write);
+    if (!success)
+    {
+        if (out_read) CloseHandle(out_read);
+        return;
+    }
+
+    if (out_read)
+    {
+        read_output(mode, stats, [out_read](char* buf, size_t size) -> int64_t {
+            DWORD n = 0;
+            if (!ReadFile(out_read, buf, DWORD(size), &n, nullptr)) return 0;
+            return int64_t(n);
+        });
+        CloseHandle(out_read);
+    }
 
-    // spin lock? doesn't seem to do anything different
-    // while (WAIT_TIMEOUT == WaitForSingleObject(proc_info.hProcess, 0));
     WaitForSingleObject(proc_info.hProcess, INFINITE);
 
     DWORD exit_code;
-    success = GetExitCodeProcess(proc_info.hProcess, &exit_code);
+    if (GetExitCodeProcess(proc_info.hProcess, &exit_code))
+    {
+        stats.exit_code = int(exit_code);
+    }
 
-    if (!success) return -1;
+    FILETIME creation, exit, kernel, user;
+    if (GetProcessTimes(proc_info.hProcess, &creation, &exit, &kernel, &user))
+    {
+        stats.user_ns = filetime_ns(user);
+        stats.sys_ns = filetime_ns(kernel);
+    }
 
     CloseHandle(proc_info.hProcess);
     CloseHandle(proc_info.hThread);
-
-    return int(exit_code);
 }
 
 #else
 
-#include <cstdio>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 
-int exec(const char* cmd)
+extern char** environ;
+
+// runs the command with posix_spawn (which uses vfork or an equivalent) and collects
+// its resource usage with wait4
+// the output of the command is handled according to mode
+void exec(const command& b, output_mode mode, run_stats& stats)
 {
-    auto s = popen(cmd, "r");
-    if (!s) return -1;
-    return pclose(s);
+    memset(&stats, 0, sizeof(stats));
+    stats.exit_code = -1;
+
+    std::vector<char*> argv;
+    static const char* shell_args[] = { "/bin/sh", "-c" };
+    if (use_shell)
+    {
+        argv.push_back(const_cast<char*>(shell_args[0]));
+        argv.push_back(const_cast<char*>(shell_args[1]));
+        argv.push_back(const_cast<char*>(b.cmd.c_str()));
+    }
+    else
+    {
+        if (b.args.empty()) return;
+        for (auto& a : b.args)
+        {
+            argv.push_back(const_cast<char*>(a.c_str()));
+        }
+    }
+    argv.push_back(nullptr);
+
+    int out_pipe[2] = { -1, -1 };
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (mode == output_mode::null)
+    {
+        posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    }
+    else
+    {
+        // both ends are close-on-exec, so that commands which are started concurrently from other
+        // threads don't inherit them (dup2 clears the flag of the command's output)
+#if defined(__linux__)
+        if (pipe2(out_pipe, O_CLOEXEC) != 0) return;
+#else
+        if (pipe(out_pipe) != 0) return;
+        fcntl(out_pipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(out_pipe[1], F_SETFD, FD_CLOEXEC);
+#endif
+        posix_spawn_file_actions_adddup2(&actions, out_pipe[1], 1);
+        posix_spawn_file_actions_addclose(&actions, out_pipe[1]);
+    }
+
+    pid_t pid;
+    auto err = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (out_pipe[1] != -1) close(out_pipe[1]);
+    if (err != 0)
+    {
+        if (out_pipe[0] != -1) close(out_pipe[0]);
+        return;
+    }
+
+    if (out_pipe[0] != -1)
+    {
+        // read until the command closes its output, so that it never blocks on a full pipe
+        auto fd = out_pipe[0];
+        read_output(mode, stats, [fd](char* buf, size_t size) -> int64_t {
+            ssize_t n;
+            do
+            {
+                n = read(fd, buf, size);
+            } while (n == -1 && errno == EINTR);
+            return int64_t(n);
+        });
+        close(fd);
+    }
+
+    int status;
+    struct rusage usage;
+    pid_t ret;
+    do
+    {
+        ret = wait4(pid, &status, 0, &usage);
+    } while (ret == -1 && errno == EINTR);
+    if (ret != pid) return;
+
+    if (WIFEXITED(status)) stats.exit_code = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status)) stats.exit_code = 128 + WTERMSIG(status);
+
+    stats.user_ns = int64_t(usage.ru_utime.tv_sec) * 1000000000 + int64_t(usage.ru_utime.tv_usec) * 1000;
+    stats.sys_ns = int64_t(usage.ru_stime.tv_sec) * 1000000000 + int64_t(usage.ru_stime.tv_usec) * 1000;
+#if defined(__APPLE__)
+    stats.max_rss_kb = int64_t(usage.ru_maxrss) / 1024; // bytes on macOS
+#else
+    stats.max_rss_kb = int64_t(usage.ru_maxrss);
+#endif
+    stats.minor_faults = int64_t(usage.ru_minflt);
+    stats.major_faults = int64_t(usage.ru_majflt);
 }
 
 #endif
 
 #include <climits>
-#include <string>
 #include <cctype>
+#include <thread>
 
 #define PICOBENCH_DEBUG
 #define PICOBENCH_IMPLEMENT
@@ -77,42 +283,449 @@ int exec(const char* cmd)
 using namespace picobench;
 using namespace std;
 
-// calculate nanoseconds to spawn an empty process
-// by running some empty commands and taking the minimum
-int64_t calc_spawn_time()
+// splits a command line to arguments like a shell would, but without any expansions
+// supports single quotes, double quotes (with \" and \\ escapes) and backslash escapes
+// returns false if a quote is not closed
+bool split_args(const string& cmd, vector<string>& args)
 {
-    const int lim = 50;
-    int64_t min_sample = LLONG_MAX;
-    for (int i = 0; i < lim; ++i)
+    args.clear();
+    string arg;
+    bool in_arg = false;
+    for (size_t i = 0; i < cmd.size(); ++i)
     {
-        auto start = high_res_clock::now();
-        exec("");
-        auto duration = high_res_clock::now() - start;
-        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
-        if (ns < min_sample) min_sample = ns;
+        auto c = cmd[i];
+        if (isspace(c))
+        {
+            if (in_arg) args.push_back(arg);
+            arg.clear();
+            in_arg = false;
+            continue;
+        }
+
+        in_arg = true;
+        if (c == '\'')
+        {
+            auto end = cmd.find('\'', i + 1);
+            if (end == string::npos) return false;
+            arg.append(cmd, i + 1, end - i - 1);
+            i = end;
+        }
+        else if (c == '"')
+        {
+            for (++i; i < cmd.size() && cmd[i] != '"'; ++i)
+            {
+                if (cmd[i] == '\\' && i + 1 < cmd.size() && (cmd[i + 1] == '"' || cmd[i + 1] == '\\'))
+                {
+                    ++i;
+                }
+                arg += cmd[i];
+            }
+            if (i == cmd.size()) return false;
+        }
+        else if (c == '\\' && i + 1 < cmd.size())
+        {
+            arg += cmd[++i];
+        }
+        else
+        {
+            arg += c;
+        }
     }
-    return min_sample;
+    if (in_arg) args.push_back(arg);
+    return true;
 }
 
-struct bench
+// a parameter of the commands
+// commands reference it as {name} and are expanded for each of its values
+// the values of a dimension parameter are integers and become the dimensions in the report
+struct param
+{
+    string name;
+    vector<string> values;
+    bool is_dim;
+};
+
+vector<param> params;
+
+// a benchmark as it's listed in the bfile or on the command line
+// with placeholders for the parameters
+struct bench_template
 {
     string name;
     string cmd;
+    string prepare; // run before each sample (not timed)
+    string cleanup; // run after each sample (not timed)
+};
+
+vector<bench_template> templates;
+
+// for benchmarks which don't have their own
+string default_prepare, default_cleanup;
+
+// numbers of copies of the commands to run at once
+// when not empty they are the dimensions of all benchmarks
+vector<int64_t> concurrency;
+
+struct bench_variant
+{
+    command cmd, prepare, cleanup;
+};
+
+// a benchmark of the runner
+// swept benchmarks have a variant for each value of their dimension parameter, which is
+// the number of iterations of the state, and run the command once per sample
+// other benchmarks have a single variant whose command is run as many times as the
+// iterations of the state
+struct bench
+{
+    string name;
+    vector<int64_t> dims; // empty if not swept
+    vector<bench_variant> variants; // the same order as dims
 };
 
 vector<bench> benchmarks;
-static int64_t spawn_time;
 
+static bool has_placeholder(const string& str, const string& name)
+{
+    return str.find('{' + name + '}') != string::npos;
+}
+
+// replaces the placeholders of the bound parameters with their values
+// other text in braces is left as is
+static string substitute(string str, const vector<pair<const param*, size_t>>& binding)
+{
+    for (auto& b : binding)
+    {
+        auto placeholder = '{' + b.first->name + '}';
+        auto& value = b.first->values[b.second];
+        for (auto pos = str.find(placeholder); pos != string::npos; pos = str.find(placeholder, pos + value.size()))
+        {
+            str.replace(pos, placeholder.size(), value);
+        }
+    }
+    return str;
+}
+
+// parses "name=values" where the values are separated by any of seps
+// a value a..b (with integers a <= b) is expanded to all integers from a to b
+bool parse_param(const char* decl, bool is_dim, const char* seps)
+{
+    string str = decl;
+    auto eq = str.find('=');
+    if (eq == string::npos) return false;
+
+    param p;
+    p.is_dim = is_dim;
+    auto name_begin = str.find_first_not_of(" \t");
+    auto name_end = str.find_last_not_of(" \t", eq - 1);
+    if (name_begin >= eq || name_end == string::npos) return false;
+    p.name = str.substr(name_begin, name_end - name_begin + 1);
+
+    for (auto pos = str.find_first_not_of(seps, eq + 1); pos != string::npos; )
+    {
+        auto end = str.find_first_of(seps, pos);
+        auto value = str.substr(pos, end == string::npos ? string::npos : end - pos);
+        pos = end == string::npos ? end : str.find_first_not_of(seps, end);
+
+        auto range = value.find("..");
+        char* e1;
+        char* e2;
+        if (range != string::npos)
+        {
+            auto a = strtol(value.c_str(), &e1, 10);
+            auto b = strtol(value.c_str() + range + 2, &e2, 10);
+            if (e1 != value.c_str() + range || *e2 || a > b)
+            {
+                cerr << "Error: Bad range `" << value << "` of parameter " << p.name << "\n";
+                return false;
+            }
+            for (auto i = a; i <= b; ++i) p.values.push_back(to_string(i));
+            continue;
+        }
+
+        if (is_dim)
+        {
+            strtol(value.c_str(), &e1, 10);
+            if (*e1 || e1 == value.c_str())
+            {
+                cerr << "Error: Dimension " << p.name << " has a value which is not an integer: `" << value << "`\n";
+                return false;
+            }
+        }
+        p.values.push_back(value);
+    }
+
+    if (p.values.empty())
+    {
+        cerr << "Error: Parameter " << p.name << " has no values\n";
+        return false;
+    }
+
+    // the values are the iterations of the states
+    if (is_dim)
+    {
+        for (auto& v : p.values)
+        {
+            if (strtoll(v.c_str(), nullptr, 10) <= 0)
+            {
+                cerr << "Error: Dimension " << p.name << " has a value which is not positive: `" << v << "`\n";
+                return false;
+            }
+        }
+    }
+
+    // a parameter can be redefined
+    for (auto& old : params)
+    {
+        if (old.name == p.name)
+        {
+            old = p;
+            return true;
+        }
+    }
+    params.push_back(p);
+    return true;
+}
+
+bool make_command(const string& str, command& c)
+{
+    c.cmd = str;
+    c.args.clear();
+    if (use_shell || str.empty()) return true;
+    if (!split_args(str, c.args) || c.args.empty())
+    {
+        cerr << "Error: Cannot parse command `" << str << "`\n";
+        return false;
+    }
+    return true;
+}
+
+// expands the templates to benchmarks with the cartesian product of the parameters they use
+bool expand_benchmarks()
+{
+    for (auto& t : templates)
+    {
+        auto prepare = t.prepare.empty() ? default_prepare : t.prepare;
+        auto cleanup = t.cleanup.empty() ? default_cleanup : t.cleanup;
+
+        const param* dim = nullptr;
+        vector<const param*> used;
+        for (auto& p : params)
+        {
+            if (!has_placeholder(t.name, p.name) && !has_placeholder(t.cmd, p.name)
+                && !has_placeholder(prepare, p.name) && !has_placeholder(cleanup, p.name))
+            {
+                continue;
+            }
+
+            // with concurrency levels as dimensions, dimension parameters are expanded like others
+            if (!p.is_dim || !concurrency.empty())
+            {
+                used.push_back(&p);
+            }
+            else if (dim)
+            {
+                cerr << "Error: `" << t.cmd << "` uses two dimensions: " << dim->name << " and " << p.name << "\n";
+                return false;
+            }
+            else
+            {
+                dim = &p;
+            }
+        }
+
+        // odometer over the values of the used parameters
+        vector<pair<const param*, size_t>> binding;
+        for (auto p : used) binding.emplace_back(p, 0);
+        while (true)
+        {
+            bench b;
+            b.name = substitute(t.name, binding);
+            for (auto& pb : binding)
+            {
+                // parameters which are not in the name are appended to it
+                if (has_placeholder(t.name, pb.first->name)) continue;
+                b.name += " [" + pb.first->name + '=' + pb.first->values[pb.second] + ']';
+            }
+
+            auto variant_binding = binding;
+            if (dim) variant_binding.emplace_back(dim, 0);
+            auto num_variants = dim ? dim->values.size() : 1;
+            for (size_t i = 0; i < num_variants; ++i)
+            {
+                if (dim)
+                {
+                    variant_binding.back().second = i;
+                    b.dims.push_back(strtoll(dim->values[i].c_str(), nullptr, 10));
+                }
+
+                bench_variant v;
+                if (!make_command(substitute(t.cmd, variant_binding), v.cmd)) return false;
+                if (!make_command(substitute(prepare, variant_binding), v.prepare)) return false;
+                if (!make_command(substitute(cleanup, variant_binding), v.cleanup)) return false;
+                b.variants.push_back(v);
+            }
+
+            benchmarks.push_back(b);
+
+            size_t i = 0;
+            for (; i < binding.size(); ++i)
+            {
+                if (++binding[i].second < binding[i].first->values.size()) break;
+                binding[i].second = 0;
+            }
+            if (i == binding.size()) break;
+        }
+    }
+    return true;
+}
+
+// runs an optional prepare or cleanup command
+// returns its exit code
+static int exec_hook(const command& c)
+{
+    if (c.cmd.empty()) return 0;
+    run_stats rs;
+    exec(c, output_mode::null, rs);
+    return rs.exit_code;
+}
+
+static void add_run(run_stats& total, const run_stats& rs)
+{
+    if (rs.exit_code != 0) total.exit_code = rs.exit_code;
+    total.user_ns += rs.user_ns;
+    total.sys_ns += rs.sys_ns;
+    total.max_rss_kb = max(total.max_rss_kb, rs.max_rss_kb);
+    total.minor_faults += rs.minor_faults;
+    total.major_faults += rs.major_faults;
+    total.output_bytes += rs.output_bytes;
+}
+
+// runs the command once and returns its wall time
+static int64_t timed_exec(const bench_variant& v, run_stats& rs)
+{
+    exec_hook(v.prepare);
+    auto start = high_res_clock::now();
+    exec(v.cmd, stdout_mode, rs);
+    auto duration = high_res_clock::now() - start;
+    exec_hook(v.cleanup);
+    return chrono::duration_cast<chrono::nanoseconds>(duration).count();
+}
+
+// the sample time is the wall time of the runs
+// the cpu times, max rss and page faults are per run (max rss is the maximum of all runs)
 void bench_proc(state& s)
 {
-    const char* cmd = benchmarks[s.user_data()].cmd.c_str();
-    for (auto _ : s)
+    auto& b = benchmarks[s.user_data()];
+
+    size_t variant = 0;
+    auto runs = s.iterations();
+    int copies = 1;
+    if (!concurrency.empty())
+    {
+        copies = int(s.iterations());
+        runs = 1;
+    }
+    else if (!b.dims.empty())
     {
-        exec(cmd);
+        variant = size_t(find(b.dims.begin(), b.dims.end(), s.iterations()) - b.dims.begin());
+        runs = 1;
     }
+    auto& v = b.variants[variant];
 
-    s.add_custom_duration(-spawn_time);
-};
+    // the scaling efficiency is relative to a single copy which is run in the same sample,
+    // so that drift between samples doesn't affect it
+    int64_t single_ns = 0;
+    if (copies > 1)
+    {
+        run_stats rs;
+        single_ns = timed_exec(v, rs);
+    }
+
+    run_stats total = {0, 0, 0, 0, 0, 0, 0, hash_seed};
+    auto prepare_code = exec_hook(v.prepare);
+
+    s.start_timer();
+    if (copies > 1)
+    {
+        // the copies are started from threads, so that each can wait for its process and read its
+        // output independently
+        vector<run_stats> stats(static_cast<size_t>(copies));
+        vector<thread> threads;
+        for (int i = 1; i < copies; ++i)
+        {
+            threads.emplace_back([&v, &stats, i]() { exec(v.cmd, stdout_mode, stats[size_t(i)]); });
+        }
+        exec(v.cmd, stdout_mode, stats[0]);
+        for (auto& t : threads) t.join();
+        s.stop_timer();
+
+        for (auto& rs : stats)
+        {
+            add_run(total, rs);
+            // a copy with a different output changes the result
+            total.output_hash = hash_bytes(total.output_hash, reinterpret_cast<const char*>(&rs.output_hash), sizeof(rs.output_hash));
+        }
+    }
+    else
+    {
+        for (int64_t i = 0; i < runs; ++i)
+        {
+            run_stats rs;
+            exec(v.cmd, stdout_mode, rs);
+            add_run(total, rs);
+            // the same for all runs if the command is deterministic
+            total.output_hash = rs.output_hash;
+        }
+        s.stop_timer();
+    }
+
+    auto cleanup_code = exec_hook(v.cleanup);
+
+    // a failing command (or a failing prepare or cleanup) is a different result
+    if (total.exit_code == 0) total.exit_code = prepare_code ? prepare_code : cleanup_code;
+    if (stdout_mode == output_mode::hash)
+    {
+        auto hash = hash_bytes(total.output_hash, reinterpret_cast<const char*>(&total.exit_code), sizeof(total.exit_code));
+        s.set_result(result_t(hash));
+    }
+    else
+    {
+        s.set_result(result_t(total.exit_code));
+    }
+
+    auto druns = double(runs * copies);
+    s.set_counter("user_ms", double(total.user_ns) / 1000000 / druns);
+    s.set_counter("sys_ms", double(total.sys_ns) / 1000000 / druns);
+    s.set_counter("max_rss_kb", double(total.max_rss_kb));
+    s.set_counter("minor_faults", double(total.minor_faults) / druns);
+    s.set_counter("major_faults", double(total.major_faults) / druns);
+    if (stdout_mode != output_mode::null)
+    {
+        s.set_counter("output_bytes", double(total.output_bytes) / druns);
+    }
+
+    if (!concurrency.empty())
+    {
+        // the makespan is the time until all copies are done
+        auto makespan = double(s.duration_ns());
+        s.set_counter("makespan_ms", makespan / 1000000);
+        s.set_counter("jobs_per_sec", makespan > 0 ? copies * 1e9 / makespan : 0);
+        // 1 means that the copies don't slow each other down
+        s.set_counter("efficiency", copies == 1 ? 1 : (makespan > 0 ? double(single_ns) / makespan : 0));
+    }
+}
+
+// returns the text after a directive (like @param) or nullptr if the line isn't one
+static const char* directive(const string& line, const char* name)
+{
+    auto len = strlen(name);
+    if (line.compare(0, len, name) != 0) return nullptr;
+    if (line.size() > len && !isspace(line[len])) return nullptr;
+    auto p = line.c_str() + len;
+    while (isspace(*p)) ++p;
+    return p;
+}
 
 bool parse_bfile(uintptr_t, const char* file)
 {
@@ -133,6 +746,7 @@ bool parse_bfile(uintptr_t, const char* file)
     int iline = 0;
     string line;
     string name;
+    bool has_benchmark = false; // whether prepare and cleanup apply to a benchmark of this file
     while (!fin.eof())
     {
         getline(fin, line);
@@ -148,6 +762,34 @@ bool parse_bfile(uintptr_t, const char* file)
 
         if (empty) continue;
 
+        // directives can be between benchmarks
+        if (!(iline & 1))
+        {
+            const char* arg;
+            if ((arg = directive(line, "@param")))
+            {
+                if (!parse_param(arg, false, " \t")) return false;
+                continue;
+            }
+            if ((arg = directive(line, "@dim")))
+            {
+                if (!parse_param(arg, true, " \t")) return false;
+                continue;
+            }
+
+            // prepare and cleanup before all benchmarks apply to all of them
+            if ((arg = directive(line, "@prepare")))
+            {
+                (has_benchmark ? templates.back().prepare : default_prepare) = arg;
+                continue;
+            }
+            if ((arg = directive(line, "@cleanup")))
+            {
+                (has_benchmark ? templates.back().cleanup : default_cleanup) = arg;
+                continue;
+            }
+        }
+
         ++iline;
         // odd lines are benchmark names
         // even lines are commands
@@ -157,12 +799,68 @@ bool parse_bfile(uintptr_t, const char* file)
         }
         else
         {
-            benchmarks.push_back({ name, line });
+            templates.push_back({ name, line, "", "" });
+            has_benchmark = true;
         }
     }
     return true;
 }
 
+bool set_shell(uintptr_t, const char* line)
+{
+    if (*line) return false;
+    use_shell = true;
+    return true;
+}
+
+bool set_stdout_mode(uintptr_t, const char* line)
+{
+    if (strcmp(line, "null") == 0) stdout_mode = output_mode::null;
+    else if (strcmp(line, "drain") == 0) stdout_mode = output_mode::drain;
+    else if (strcmp(line, "hash") == 0) stdout_mode = output_mode::hash;
+    else return false;
+    return true;
+}
+
+// hashes the output of the commands and requires all commands to have the same output
+bool set_compare_output(uintptr_t r, const char* line)
+{
+    if (*line) return false;
+    stdout_mode = output_mode::hash;
+    auto& rnr = *reinterpret_cast<runner*>(r);
+    rnr.set_compare_results_across_benchmarks(true);
+    rnr.set_compare_results_across_samples(true);
+    return true;
+}
+
+bool set_param(uintptr_t is_dim, const char* line)
+{
+    return parse_param(line, is_dim != 0, ",");
+}
+
+bool set_concurrency(uintptr_t, const char* line)
+{
+    concurrency.clear();
+    for (const char* p = line; *p; )
+    {
+        char* end;
+        auto n = strtol(p, &end, 10);
+        if (end == p || n <= 0 || n > 4096) return false;
+        concurrency.push_back(n);
+        if (*end == ',') ++end;
+        else if (*end) return false;
+        p = end;
+    }
+    return !concurrency.empty();
+}
+
+bool set_hook(uintptr_t hook, const char* line)
+{
+    if (!*line) return false;
+    *reinterpret_cast<string*>(hook) = line;
+    return true;
+}
+
 int main(int argc, char* argv[])
 {
     if (argc == 1)
@@ -177,7 +875,7 @@ int main(int argc, char* argv[])
     {
         if (argv[i][0] != '-')
         {
-            benchmarks.push_back({ argv[i], argv[i] });
+            templates.push_back({ argv[i], argv[i], "", "" });
         }
     }
 
@@ -186,46 +884,46 @@ int main(int argc, char* argv[])
     r.set_default_samples(1);
 
     r.add_cmd_opt("-bfile=", "<filename>", "Set a file which lists benchmarks", parse_bfile);
+    r.add_cmd_opt("-shell", "", "Run the commands through the shell", set_shell);
+    r.add_cmd_opt("-stdout=", "<null|drain|hash>", "Set what happens to the output of the commands", set_stdout_mode);
+    r.add_cmd_opt("-compare-output", "", "Fail if the commands have different output", set_compare_output, uintptr_t(&r));
+    r.add_cmd_opt("-param=", "<name=v1,v2...>", "Expand {name} in the commands to each value", set_param, 0);
+    r.add_cmd_opt("-dim=", "<name=a..b>", "Expand {name} to each value as a dimension", set_param, 1);
+    r.add_cmd_opt("-concurrency=", "<n1,n2...>", "Run n copies of the commands at once", set_concurrency);
+    r.add_cmd_opt("-prepare=", "<command>", "Run a command before each sample", set_hook, uintptr_t(&default_prepare));
+    r.add_cmd_opt("-cleanup=", "<command>", "Run a command after each sample", set_hook, uintptr_t(&default_cleanup));
 
     r.parse_cmd_line(argc, argv);
 
     if (!r.should_run()) return r.error();
 
+    if (!expand_benchmarks()) return 1;
+
     for (size_t i = 0; i < benchmarks.size(); ++i)
     {
         auto& b = benchmarks[i];
-        r.add_benchmark(b.name.c_str(), bench_proc).user_data(i);
-    }
 
-    spawn_time = calc_spawn_time();
-
-    r.run_benchmarks();
-    auto report = r.generate_report();
-    std::ostream* out = &std::cout;
-    std::ofstream fout;
-    if (r.preferred_output_filename())
-    {
-        fout.open(r.preferred_output_filename());
-        if (!fout.is_open())
+        // check that the (first) command can be run before benchmarking it
+        auto& v = b.variants.front();
+        exec_hook(v.prepare);
+        run_stats rs;
+        exec(v.cmd, output_mode::null, rs);
+        exec_hook(v.cleanup);
+        if (rs.exit_code == -1)
         {
-            std::cerr << "Error: Could not open output file `" << r.preferred_output_filename() << "`\n";
+            cerr << "Error: Cannot run `" << v.cmd.cmd << "`\n";
             return 1;
         }
-        out = &fout;
-    }
+        if (rs.exit_code != 0)
+        {
+            cerr << "Warning: `" << v.cmd.cmd << "` exited with code " << rs.exit_code << "\n";
+        }
 
-    switch (r.preferred_output_format())
-    {
-    case picobench::report_output_format::text:
-        report.to_text(*out);
-        break;
-    case picobench::report_output_format::concise_text:
-        report.to_text_concise(*out);
-        break;
-    case picobench::report_output_format::csv:
-        report.to_csv(*out);
-        break;
+        auto& pb = r.add_benchmark(b.name.c_str(), bench_proc).user_data(i);
+        if (!concurrency.empty()) pb.iterations(concurrency);
+        // a sample is a single run of the command, so it's a single operation in the report
+        else if (!b.dims.empty()) pb.iterations(b.dims).param_dimensions();
     }
 
-    return r.error();
+    return r.run();
 }
@@ -0,0 +1,394 @@
+// picobench-run-all
+// runs several picobench executables (like the ones of all components of a project) with the
+// same seed, filters and other arguments and combines their reports in one
+// the suites of each executable are in a group named after it
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32)
+#error "picobench-run-all is not supported on Windows"
+#endif
+
+#include <spawn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define PICOBENCH_IMPLEMENT
+#include "picobench/picobench.hpp"
+
+using namespace picobench;
+using namespace std;
+using steady_clock = chrono::steady_clock;
+
+extern char** environ;
+
+// exit code of commands which were killed at the deadline
+static const int timed_out = -2;
+
+// runs a command until it exits or until the deadline
+// its output is appended to out, or goes to the standard error if out is null (so that it
+// doesn't mix with the report)
+// returns the exit code (128 + the signal if it was killed by one) or -1 if it cannot be run
+int run_command(const vector<string>& args, string* out, steady_clock::time_point deadline)
+{
+    vector<char*> argv;
+    for (auto& a : args)
+    {
+        argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    int out_pipe[2] = { -1, -1 };
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (out)
+    {
+        if (pipe(out_pipe) != 0) return -1;
+        fcntl(out_pipe[0], F_SETFD, FD_CLOEXEC);
+        fcntl(out_pipe[1], F_SETFD, FD_CLOEXEC);
+        posix_spawn_file_actions_adddup2(&actions, out_pipe[1], 1);
+    }
+    else
+    {
+        posix_spawn_file_actions_adddup2(&actions, 2, 1);
+    }
+
+    pid_t pid;
+    auto err = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (out_pipe[1] != -1) close(out_pipe[1]);
+    if (err != 0)
+    {
+        if (out_pipe[0] != -1) close(out_pipe[0]);
+        return -1;
+    }
+
+    auto ms_left = [&deadline]() {
+        return chrono::duration_cast<chrono::milliseconds>(deadline - steady_clock::now()).count();
+    };
+
+    bool killed = false;
+    if (out)
+    {
+        char buf[4096];
+        pollfd pfd = { out_pipe[0], POLLIN, 0 };
+        while (true)
+        {
+            auto left = ms_left();
+            if (left <= 0)
+            {
+                kill(pid, SIGKILL);
+                killed = true;
+                break;
+            }
+            if (poll(&pfd, 1, int(min<int64_t>(left, 100))) <= 0) continue;
+            auto n = read(out_pipe[0], buf, sizeof(buf));
+            if (n <= 0) break;
+            out->append(buf, size_t(n));
+        }
+        close(out_pipe[0]);
+    }
+
+    int status = 0;
+    while (true)
+    {
+        auto ret = waitpid(pid, &status, killed ? 0 : WNOHANG);
+        if (ret == pid) break;
+        if (ret == -1 && errno != EINTR) return -1;
+        if (!killed && ms_left() <= 0)
+        {
+            kill(pid, SIGKILL);
+            killed = true;
+            continue;
+        }
+        usleep(10000);
+    }
+
+    if (killed) return timed_out;
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+}
+
+static bool is_executable_file(const string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(path.c_str(), X_OK) == 0;
+}
+
+// adds the executables in a directory (not recursively) in alphabetical order or the path
+// itself if it's not a directory
+bool discover(const string& path, vector<string>& executables)
+{
+    auto dir = opendir(path.c_str());
+    if (!dir)
+    {
+        if (!is_executable_file(path))
+        {
+            cerr << "Error: " << path << " is not an executable or a directory\n";
+            return false;
+        }
+        executables.push_back(path);
+        return true;
+    }
+
+    vector<string> found;
+    while (auto entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.') continue;
+        auto file = path + '/' + entry->d_name;
+        if (is_executable_file(file)) found.push_back(file);
+    }
+    closedir(dir);
+
+    sort(found.begin(), found.end());
+    executables.insert(executables.end(), found.begin(), found.end());
+    return true;
+}
+
+// the number of benchmarks in the output of -list
+// returns -1 if it's not such an output
+static int count_listed(const string& list)
+{
+    int suites = 0, benchmarks = 0;
+    size_t begin = 0;
+    while (begin < list.size())
+    {
+        auto end = list.find('\n', begin);
+        if (end == string::npos) end = list.size();
+        auto line = list.substr(begin, end - begin);
+        begin = end + 1;
+
+        // suites are indented with two spaces and benchmarks with four
+        if (line.compare(0, 4, "    ") == 0) ++benchmarks;
+        else if (line.compare(0, 2, "  ") == 0 && line.back() == ':') ++suites;
+    }
+    return suites ? benchmarks : (list.empty() ? 0 : -1);
+}
+
+static const char* base_name(const string& path)
+{
+    auto slash = path.find_last_of('/');
+    return path.c_str() + (slash == string::npos ? 0 : slash + 1);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 1)
+    {
+        cout << "picobench-run-all " PICOBENCH_VERSION_STR "\n";
+        cout << "Usage: picobench-run-all [--budget=<seconds>] [--out-fmt=<txt|con|csv|json>] [--output=<filename>] [--list] [args] <executable or directory> ...\n";
+        return 0;
+    }
+
+    report_output_format fmt = report_output_format::text;
+    const char* output = nullptr;
+    double budget = 0;
+    bool list = false;
+    bool has_seed = false;
+    vector<string> paths;
+    vector<string> forwarded; // the arguments for the executables
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--out-fmt=", 10) == 0)
+        {
+            arg += 10;
+            if (strcmp(arg, "txt") == 0) fmt = report_output_format::text;
+            else if (strcmp(arg, "con") == 0) fmt = report_output_format::concise_text;
+            else if (strcmp(arg, "csv") == 0) fmt = report_output_format::csv;
+            else if (strcmp(arg, "json") == 0) fmt = report_output_format::json;
+            else
+            {
+                cerr << "Error: Bad output format: " << arg << "\n";
+                return 1;
+            }
+        }
+        else if (strncmp(arg, "--output=", 9) == 0)
+        {
+            output = arg + 9;
+        }
+        else if (strncmp(arg, "--budget=", 9) == 0)
+        {
+            char* end;
+            budget = strtod(arg + 9, &end);
+            if (*end || budget <= 0)
+            {
+                cerr << "Error: Bad command-line argument: " << arg << "\n";
+                return 1;
+            }
+        }
+        else if (strcmp(arg, "--list") == 0)
+        {
+            list = true;
+        }
+        else if (arg[0] == '-')
+        {
+            has_seed = has_seed || strncmp(arg, "--seed=", 7) == 0;
+            forwarded.push_back(arg);
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+
+    vector<string> executables;
+    for (auto& p : paths)
+    {
+        if (!discover(p, executables)) return 1;
+    }
+
+    // the same seed for all, so that the run can be repeated
+    if (!has_seed)
+    {
+        forwarded.push_back("--seed=" + to_string(int(random_device()() & 0x7fffffff)));
+    }
+
+    auto start = steady_clock::now();
+    auto deadline = budget > 0 ?
+        start + chrono::duration_cast<steady_clock::duration>(chrono::duration<double>(budget)) :
+        steady_clock::time_point::max();
+
+    // query the selected benchmarks of each executable
+    // the ones which are not picobench executables or have no selected benchmarks are skipped
+    struct selected
+    {
+        string path;
+        const char* label;
+        int benchmarks;
+    };
+    vector<selected> targets;
+    for (auto& e : executables)
+    {
+        vector<string> args = { e, "--list" };
+        args.insert(args.end(), forwarded.begin(), forwarded.end());
+        string listed;
+        auto code = run_command(args, &listed, min(deadline, steady_clock::now() + chrono::seconds(10)));
+        auto count = code == 0 ? count_listed(listed) : -1;
+        if (count < 0)
+        {
+            cerr << "Warning: Skipping " << e << " which is not a picobench executable\n";
+            continue;
+        }
+        if (count == 0) continue;
+        targets.push_back({ e, nullptr, count });
+        if (list)
+        {
+            cout << e << ":\n" << listed;
+        }
+    }
+
+    if (list) return 0;
+
+    // the groups are the file names, unless two are the same
+    for (auto& t : targets)
+    {
+        t.label = base_name(t.path);
+        for (auto& o : targets)
+        {
+            if (&o != &t && strcmp(base_name(o.path), t.label) == 0)
+            {
+                t.label = t.path.c_str();
+                break;
+            }
+        }
+    }
+
+    char report_file[] = "/tmp/picobench-run-all-XXXXXX";
+    auto fd = mkstemp(report_file);
+    if (fd == -1)
+    {
+        cerr << "Error: Cannot create a temporary file\n";
+        return 1;
+    }
+    close(fd);
+
+    int ret = 0;
+    report merged;
+    for (auto& t : targets)
+    {
+        if (steady_clock::now() >= deadline)
+        {
+            cerr << "Warning: Skipping " << t.label << " because the time budget is spent\n";
+            continue;
+        }
+
+        cerr << "Running " << t.label << " (" << t.benchmarks << " benchmarks)\n";
+        vector<string> args = { t.path };
+        args.insert(args.end(), forwarded.begin(), forwarded.end());
+        args.push_back("--out-fmt=json");
+        args.push_back(string("--output=") + report_file);
+
+        auto code = run_command(args, nullptr, deadline);
+        if (code == timed_out)
+        {
+            cerr << "Error: " << t.label << " was stopped because the time budget is spent\n";
+            ret = 1;
+            continue;
+        }
+
+        report rpt;
+        ifstream fin(report_file);
+        if (!fin || !rpt.from_json(fin))
+        {
+            cerr << "Error: " << t.label << " exited with code " << code << " without a report\n";
+            ret = 1;
+            continue;
+        }
+        if (code != 0)
+        {
+            cerr << "Error: " << t.label << " exited with code " << code << "\n";
+            ret = 1;
+        }
+
+        auto group = rpt.store_string(t.label);
+        for (auto& s : rpt.suites)
+        {
+            s.group = group;
+        }
+        merged.merge(rpt);
+    }
+    remove(report_file);
+
+    ostream* out = &cout;
+    ofstream fout;
+    if (output)
+    {
+        fout.open(output);
+        if (!fout)
+        {
+            cerr << "Error: Could not open output file `" << output << "`\n";
+            return 1;
+        }
+        out = &fout;
+    }
+
+    switch (fmt)
+    {
+    case report_output_format::text:
+        merged.to_text(*out);
+        break;
+    case report_output_format::concise_text:
+        merged.to_text_concise(*out);
+        break;
+    case report_output_format::csv:
+        merged.to_csv(*out);
+        break;
+    default:
+        merged.to_json(*out);
+        break;
+    }
+
+    return ret;
+}